@@ -0,0 +1,115 @@
+#include "adaptive_scale.hpp"
+
+#include "face_anonymizer.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+const double kScaleLevel[kScaleLevels] = {1.0, 0.75, 0.5, 0.375, 0.25, 0.1875, 0.125};
+
+namespace {
+
+// Never go below this many pixels on the short side of the detector input.
+const int kMinInputSide = 96;
+
+// Tracked faces may shrink or turn away before the next sweep; keep some room.
+const float kShrinkMargin = 0.8f;
+
+}  // namespace
+
+void AdaptiveScaleStats::print(std::ostream& out) const {
+    out << "detection scale: " << frames << " frames, " << sweeps << " sweeps, avg input "
+        << (frames ? 100.0 * input_share / frames : 0.0) << "% of frame pixels;";
+    for (int i = 0; i < kScaleLevels; ++i) {
+        if (per_level[i] > 0) {
+            out << " " << kScaleLevel[i] << "x:" << per_level[i];
+        }
+    }
+    out << std::endl;
+}
+
+AdaptiveScaleDetector::AdaptiveScaleDetector(cv::Ptr<cv::FaceDetectorYN> detector, float face_padding,
+                                             AdaptiveScaleConfig cfg)
+    : detector_(std::move(detector)),
+      face_padding_(face_padding),
+      cfg_(cfg),
+      clock_(std::make_shared<SweepClock>()),
+      stats_(std::make_shared<AdaptiveScaleStats>()) {}
+
+std::function<bool()> AdaptiveScaleDetector::skip_check() const {
+    return [clock = clock_, every = cfg_.sweep_every] {
+        if (every <= 1 || clock->frame >= clock->next_sweep) {
+            return true;
+        }
+        clock->frame++;
+        return false;
+    };
+}
+
+int AdaptiveScaleDetector::pick_level(bool sweep, cv::Size frame_size) const {
+    double needed = 0.0;
+    if (sweep) {
+        needed = static_cast<double>(cfg_.detect_px) / std::max(1, cfg_.min_face);
+    } else if (smallest_face_ > 0.0f) {
+        needed = cfg_.detect_px / (smallest_face_ * kShrinkMargin);
+    }
+    needed = std::max(needed, static_cast<double>(kMinInputSide) / std::min(frame_size.width, frame_size.height));
+    // Smallest level that is still large enough.
+    for (int i = kScaleLevels - 1; i > 0; --i) {
+        if (kScaleLevel[i] >= needed) {
+            return i;
+        }
+    }
+    return 0;
+}
+
+std::vector<cv::Rect> AdaptiveScaleDetector::detect(const cv::Mat& frame) {
+    const cv::Mat* input = &frame;
+    if (frame.channels() == 4) {
+        cv::cvtColor(frame, bgr_, cv::COLOR_BGRA2BGR);
+        input = &bgr_;
+    }
+
+    SweepClock& clock = *clock_;
+    const bool sweep = cfg_.sweep_every <= 1 || clock.frame >= clock.next_sweep;
+    if (sweep) {
+        clock.next_sweep = clock.frame + cfg_.sweep_every;
+    }
+    const long frame_index = clock.frame++;
+    const int level = pick_level(sweep, frame.size());
+    const double scale = kScaleLevel[level];
+    if (level > 0) {
+        cv::Size size(std::max(1, cvRound(frame.cols * scale)), std::max(1, cvRound(frame.rows * scale)));
+        cv::resize(*input, small_, size, 0, 0, cv::INTER_AREA);
+        input = &small_;
+    }
+    detector_->setInputSize(input->size());
+    detector_->detect(*input, faces_);
+
+    // Back to frame coordinates: box and landmarks (columns 0-13), not the score.
+    float smallest = 0.0f;
+    for (int i = 0; i < faces_.rows; ++i) {
+        float* row = faces_.ptr<float>(i);
+        for (int c = 0; c < std::min(14, faces_.cols); ++c) {
+            row[c] = static_cast<float>(row[c] / scale);
+        }
+        float size = std::min(row[2], row[3]);
+        smallest = smallest > 0.0f ? std::min(smallest, size) : size;
+    }
+    if (faces_.rows > 0) {
+        smallest_face_ = smallest;
+        last_face_frame_ = frame_index;
+    } else if (frame_index - last_face_frame_ > cfg_.sweep_every) {
+        // Nothing seen for a whole sweep interval: the faces are gone.
+        smallest_face_ = 0.0f;
+    }
+
+    stats_->frames++;
+    stats_->sweeps += sweep ? 1 : 0;
+    stats_->input_share += scale * scale;
+    stats_->per_level[level]++;
+    return boxes_from_faces(faces_, face_padding_, frame.size());
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/objdetect.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+// Detection resolution picked per frame.
+//
+// YuNet finds a face once it is about `detect_px` pixels tall at its input, so a
+// frame whose smallest face is 200 px tall can be detected at 1/8 of its size.
+// Most frames are detected at the scale the currently tracked faces need; every
+// `sweep_every` frames a sweep runs at the scale needed for `min_face`, which is
+// where new small faces are found. With no faces tracked the smallest input is used.
+struct AdaptiveScaleConfig {
+    // Smallest face height (frame pixels) the sweeps must still find. 0 = adaptive scale off.
+    int min_face = 0;
+    // Face height YuNet still detects reliably at its input.
+    int detect_px = 20;
+    // A sweep every this many frames.
+    int sweep_every = 15;
+};
+
+// Detection input scales that are used. A fixed set keeps the network from
+// reallocating its buffers for a new input size every frame.
+constexpr int kScaleLevels = 7;
+extern const double kScaleLevel[kScaleLevels];
+
+struct AdaptiveScaleStats {
+    uint64_t frames = 0;
+    uint64_t sweeps = 0;
+    // Sum of (detector input pixels / frame pixels) over all frames.
+    double input_share = 0.0;
+    uint64_t per_level[kScaleLevels] = {};
+
+    void print(std::ostream& out) const;
+};
+
+// Detector stage: frame in, padded face boxes (in frame coordinates) out.
+class AdaptiveScaleDetector {
+public:
+    AdaptiveScaleDetector(cv::Ptr<cv::FaceDetectorYN> detector, float face_padding, AdaptiveScaleConfig cfg);
+
+    // Also takes BGRA (e.g. screen capture); the alpha channel is ignored.
+    std::vector<cv::Rect> detect(const cv::Mat& frame);
+
+    // Stays valid after the detector is moved into a pipeline.
+    std::shared_ptr<const AdaptiveScaleStats> stats() const { return stats_; }
+
+    // For a wrapper that does not pass every frame to detect() (--detect-every):
+    // call the returned function on each frame it skips. It returns true when a
+    // sweep is due, and the frame must be detected after all; otherwise the
+    // frame is counted, so sweeps stay on schedule in frames, not in calls.
+    std::function<bool()> skip_check() const;
+
+private:
+    // Frame count shared with skip_check(), which outlives moves of the detector.
+    struct SweepClock {
+        long frame = 0;
+        long next_sweep = 0;
+    };
+
+    int pick_level(bool sweep, cv::Size frame_size) const;
+
+    cv::Ptr<cv::FaceDetectorYN> detector_;
+    float face_padding_;
+    AdaptiveScaleConfig cfg_;
+    cv::Mat bgr_;
+    cv::Mat small_;
+    cv::Mat faces_;
+    std::shared_ptr<SweepClock> clock_;
+    // Height of the smallest face last detected (frame pixels, 0 = none tracked).
+    float smallest_face_ = 0.0f;
+    long last_face_frame_ = 0;
+    std::shared_ptr<AdaptiveScaleStats> stats_;
+};
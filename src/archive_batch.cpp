@@ -0,0 +1,835 @@
+#include "archive_batch.hpp"
+
+#include "container_limits.hpp"
+#include "follow_file.hpp"
+#include "pipeline.hpp"
+#include "pipeline_stages.hpp"
+
+#include <opencv2/videoio.hpp>
+
+#include <zlib.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+namespace {
+
+// ---------------------------------------------------------------------------
+// Reading
+// ---------------------------------------------------------------------------
+
+bool read_at(int fd, uint64_t offset, void* buf, size_t size) {
+    char* p = static_cast<char*>(buf);
+    while (size > 0) {
+        ssize_t n = pread(fd, p, size, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        offset += static_cast<uint64_t>(n);
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+uint64_t le(const unsigned char* p, int bytes) {
+    uint64_t v = 0;
+    for (int i = bytes - 1; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+// Tar numbers are octal text, or big-endian binary when the top bit is set.
+uint64_t tar_number(const char* field, size_t size) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(field);
+    uint64_t v = 0;
+    if (p[0] & 0x80) {
+        for (size_t i = 1; i < size; ++i) {
+            v = (v << 8) | p[i];
+        }
+        return v;
+    }
+    for (size_t i = 0; i < size && p[i]; ++i) {
+        if (p[i] >= '0' && p[i] <= '7') {
+            v = v * 8 + (p[i] - '0');
+        }
+    }
+    return v;
+}
+
+std::string tar_string(const char* field, size_t size) {
+    return std::string(field, strnlen(field, size));
+}
+
+bool tar_checksum_ok(const char* block) {
+    unsigned sum = 0;
+    for (int i = 0; i < 512; ++i) {
+        sum += (i >= 148 && i < 156) ? ' ' : static_cast<unsigned char>(block[i]);
+    }
+    return sum == tar_number(block + 148, 8);
+}
+
+// Value of `key` in pax extended header records ("<len> key=value\n").
+std::string pax_value(const std::string& records, const std::string& key) {
+    size_t pos = 0;
+    while (pos < records.size()) {
+        size_t space = records.find(' ', pos);
+        if (space == std::string::npos) {
+            break;
+        }
+        size_t len = std::strtoul(records.c_str() + pos, nullptr, 10);
+        if (len == 0 || pos + len > records.size()) {
+            break;
+        }
+        std::string record = records.substr(space + 1, pos + len - space - 2);
+        if (record.compare(0, key.size() + 1, key + "=") == 0) {
+            return record.substr(key.size() + 1);
+        }
+        pos += len;
+    }
+    return "";
+}
+
+bool list_tar(int fd, uint64_t file_size, std::vector<ArchiveMember>& members) {
+    char block[512];
+    uint64_t pos = 0;
+    // Long name / size from a preceding GNU 'L' or pax 'x' entry.
+    std::string next_name;
+    std::string next_size;
+    while (pos + 512 <= file_size) {
+        if (!read_at(fd, pos, block, 512)) {
+            return false;
+        }
+        if (block[0] == '\0') {
+            break;  // end-of-archive block
+        }
+        if (!tar_checksum_ok(block)) {
+            std::cerr << "Damaged tar header at byte " << pos << std::endl;
+            return false;
+        }
+        uint64_t size = tar_number(block + 124, 12);
+        if (!next_size.empty()) {
+            size = std::strtoull(next_size.c_str(), nullptr, 10);
+        }
+        const char type = block[156];
+        const uint64_t data = pos + 512;
+        if (type == 'L' || type == 'x') {
+            std::string text(static_cast<size_t>(std::min<uint64_t>(size, 1 << 20)), '\0');
+            if (!read_at(fd, data, &text[0], text.size())) {
+                return false;
+            }
+            if (type == 'L') {
+                next_name = text.c_str();
+            } else {
+                std::string path = pax_value(text, "path");
+                next_name = path.empty() ? next_name : path;
+                next_size = pax_value(text, "size");
+            }
+        } else {
+            if (type == '0' || type == '\0' || type == '7') {
+                ArchiveMember m;
+                if (!next_name.empty()) {
+                    m.name = next_name;
+                } else {
+                    std::string prefix = tar_string(block + 345, 155);
+                    std::string name = tar_string(block, 100);
+                    m.name = prefix.empty() ? name : prefix + "/" + name;
+                }
+                m.offset = data;
+                m.size = size;
+                members.push_back(m);
+            }
+            next_name.clear();
+            next_size.clear();
+        }
+        pos = data + (size + 511) / 512 * 512;
+    }
+    return true;
+}
+
+bool list_zip(int fd, uint64_t file_size, std::vector<ArchiveMember>& members) {
+    // End of central directory: 22 bytes plus a comment of up to 64 KB, at the end.
+    const uint64_t tail_size = std::min<uint64_t>(file_size, 22 + 65535);
+    std::vector<unsigned char> tail(static_cast<size_t>(tail_size));
+    if (!read_at(fd, file_size - tail_size, tail.data(), tail.size())) {
+        return false;
+    }
+    long eocd = -1;
+    for (long i = static_cast<long>(tail.size()) - 22; i >= 0; --i) {
+        if (le(&tail[i], 4) == 0x06054b50) {
+            eocd = i;
+            break;
+        }
+    }
+    if (eocd < 0) {
+        std::cerr << "No zip central directory found" << std::endl;
+        return false;
+    }
+    uint64_t count = le(&tail[eocd + 10], 2);
+    uint64_t dir_size = le(&tail[eocd + 12], 4);
+    uint64_t dir_offset = le(&tail[eocd + 16], 4);
+    // Zip64: the real values are in a second record, found through a locator just before.
+    if ((count == 0xffff || dir_offset == 0xffffffff) && eocd >= 20 && le(&tail[eocd - 20], 4) == 0x07064b50) {
+        unsigned char z64[56];
+        if (!read_at(fd, le(&tail[eocd - 12], 8), z64, sizeof(z64)) || le(z64, 4) != 0x06064b50) {
+            std::cerr << "Damaged zip64 directory" << std::endl;
+            return false;
+        }
+        count = le(z64 + 32, 8);
+        dir_size = le(z64 + 40, 8);
+        dir_offset = le(z64 + 48, 8);
+    }
+    if (dir_offset + dir_size > file_size) {
+        std::cerr << "Damaged zip central directory" << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> dir(static_cast<size_t>(dir_size));
+    if (!read_at(fd, dir_offset, dir.data(), dir.size())) {
+        return false;
+    }
+    size_t p = 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        if (p + 46 > dir.size() || le(&dir[p], 4) != 0x02014b50) {
+            std::cerr << "Damaged zip central directory" << std::endl;
+            return false;
+        }
+        const unsigned flags = static_cast<unsigned>(le(&dir[p + 8], 2));
+        const unsigned method = static_cast<unsigned>(le(&dir[p + 10], 2));
+        uint64_t packed = le(&dir[p + 20], 4);
+        uint64_t unpacked = le(&dir[p + 24], 4);
+        const size_t name_len = static_cast<size_t>(le(&dir[p + 28], 2));
+        const size_t extra_len = static_cast<size_t>(le(&dir[p + 30], 2));
+        const size_t comment_len = static_cast<size_t>(le(&dir[p + 32], 2));
+        uint64_t local = le(&dir[p + 42], 4);
+        if (p + 46 + name_len + extra_len > dir.size()) {
+            std::cerr << "Damaged zip central directory" << std::endl;
+            return false;
+        }
+        std::string name(reinterpret_cast<const char*>(&dir[p + 46]), name_len);
+
+        // Zip64 extra field: 64-bit values for whichever fields are 0xffffffff, in this order.
+        for (size_t e = p + 46 + name_len; e + 4 <= p + 46 + name_len + extra_len;) {
+            const uint64_t id = le(&dir[e], 2);
+            const size_t len = static_cast<size_t>(le(&dir[e + 2], 2));
+            if (id == 0x0001) {
+                size_t v = e + 4;
+                if (unpacked == 0xffffffff && v + 8 <= e + 4 + len) {
+                    unpacked = le(&dir[v], 8);
+                    v += 8;
+                }
+                if (packed == 0xffffffff && v + 8 <= e + 4 + len) {
+                    packed = le(&dir[v], 8);
+                    v += 8;
+                }
+                if (local == 0xffffffff && v + 8 <= e + 4 + len) {
+                    local = le(&dir[v], 8);
+                }
+            }
+            e += 4 + len;
+        }
+        p += 46 + name_len + extra_len + comment_len;
+
+        if (name.empty() || name.back() == '/') {
+            continue;  // directory
+        }
+        if (flags & 1) {
+            std::cerr << "Skipping encrypted zip member " << name << std::endl;
+            continue;
+        }
+        if (method != 0 && method != 8) {
+            std::cerr << "Skipping zip member " << name << " (compression method " << method << ")" << std::endl;
+            continue;
+        }
+        // The data follows the local header, whose name and extra field may differ in length.
+        unsigned char lh[30];
+        if (!read_at(fd, local, lh, sizeof(lh)) || le(lh, 4) != 0x04034b50) {
+            std::cerr << "Damaged zip member " << name << std::endl;
+            return false;
+        }
+        ArchiveMember m;
+        m.name = name;
+        m.offset = local + 30 + le(lh + 26, 2) + le(lh + 28, 2);
+        m.size = packed;
+        m.storage = method == 0 ? MemberStorage::Stored : MemberStorage::Deflated;
+        if (m.offset + m.size > file_size) {
+            std::cerr << "Damaged zip member " << name << std::endl;
+            return false;
+        }
+        members.push_back(m);
+    }
+    return true;
+}
+
+std::string absolute_path(const std::string& path) {
+    if (!path.empty() && path[0] == '/') {
+        return path;
+    }
+    char cwd[PATH_MAX];
+    return getcwd(cwd, sizeof(cwd)) ? std::string(cwd) + "/" + path : path;
+}
+
+std::string lower_extension(const std::string& name) {
+    size_t slash = name.find_last_of('/');
+    size_t dot = name.find_last_of('.');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return "";
+    }
+    std::string ext = name.substr(dot + 1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext;
+}
+
+bool is_video_name(const std::string& name) {
+    static const char* kVideo[] = {"mp4", "m4v", "mov", "mkv", "webm", "avi", "ts", "mts", "m2ts", "mpg", "mpeg", "wmv", "flv", "3gp"};
+    const std::string ext = lower_extension(name);
+    return std::any_of(std::begin(kVideo), std::end(kVideo), [&](const char* v) { return ext == v; });
+}
+
+// Name of the masked member. MP4/MOV keep their container (mp4v); AVI and MKV
+// take Motion JPEG; anything else becomes .mkv.
+std::string output_name(const std::string& name) {
+    const std::string ext = lower_extension(name);
+    if (ext == "mp4" || ext == "mov" || ext == "avi" || ext == "mkv") {
+        return name;
+    }
+    return name.substr(0, name.size() - ext.size()) + "mkv";
+}
+
+}  // namespace
+
+bool list_archive(const std::string& path, std::vector<ArchiveMember>& members) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cerr << "Cannot open archive " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    unsigned char head[512] = {};
+    bool ok = fstat(fd, &st) == 0 && read_at(fd, 0, head, std::min<size_t>(sizeof(head), st.st_size));
+    const uint64_t size = ok ? static_cast<uint64_t>(st.st_size) : 0;
+    if (!ok) {
+        std::cerr << "Cannot read archive " << path << std::endl;
+    } else if (head[0] == 0x1f && head[1] == 0x8b) {
+        // Nothing in a .tar.gz can be reached without inflating everything before it.
+        std::cerr << path << " is a compressed tar. Members can only be read by unpacking it; "
+                  << "repack it as .tar or .zip first" << std::endl;
+        ok = false;
+    } else if (size >= 22 && le(head, 4) == 0x04034b50) {
+        ok = list_zip(fd, size, members);
+    } else if (size >= 512 && std::memcmp(head + 257, "ustar", 5) == 0) {
+        ok = list_tar(fd, size, members);
+    } else if (size >= 22 && le(head, 4) == 0x06054b50) {
+        ok = true;  // empty zip
+    } else {
+        std::cerr << path << " is neither a tar nor a zip archive" << std::endl;
+        ok = false;
+    }
+    ::close(fd);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Member streams
+// ---------------------------------------------------------------------------
+
+struct MemberStream::Impl {
+    std::string path;
+    // Deflated members only.
+    std::string archive;
+    ArchiveMember member;
+    std::string dir;
+    std::thread feeder;
+    std::atomic<bool> stop{false};
+
+    // Inflate the member into the pipe until it ends or the reader goes away.
+    void feed() {
+        sigset_t pipe_signal;
+        sigemptyset(&pipe_signal);
+        sigaddset(&pipe_signal, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipe_signal, nullptr);
+
+        int out = -1;
+        while (out < 0 && !stop) {
+            out = ::open(path.c_str(), O_WRONLY | O_NONBLOCK);
+            if (out < 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+        int in = ::open(archive.c_str(), O_RDONLY);
+        if (out < 0 || in < 0) {
+            if (out >= 0) {
+                ::close(out);
+            }
+            if (in >= 0) {
+                ::close(in);
+            }
+            return;
+        }
+        fcntl(out, F_SETFL, fcntl(out, F_GETFL) & ~O_NONBLOCK);
+
+        z_stream z{};
+        inflateInit2(&z, -MAX_WBITS);  // raw deflate, as zip stores it
+        std::vector<unsigned char> packed(1 << 16);
+        std::vector<unsigned char> plain(1 << 18);
+        uint64_t pos = member.offset;
+        const uint64_t end = member.offset + member.size;
+        int rc = Z_OK;
+        bool reader_gone = false;
+        while (rc != Z_STREAM_END && !reader_gone && !stop) {
+            if (z.avail_in == 0) {
+                const size_t n = static_cast<size_t>(std::min<uint64_t>(packed.size(), end - pos));
+                if (n == 0 || !read_at(in, pos, packed.data(), n)) {
+                    break;
+                }
+                pos += n;
+                z.next_in = packed.data();
+                z.avail_in = static_cast<uInt>(n);
+            }
+            z.next_out = plain.data();
+            z.avail_out = static_cast<uInt>(plain.size());
+            rc = inflate(&z, Z_NO_FLUSH);
+            if (rc != Z_OK && rc != Z_STREAM_END) {
+                std::cerr << "Damaged compressed data in " << member.name << std::endl;
+                break;
+            }
+            size_t have = plain.size() - z.avail_out;
+            for (size_t done = 0; done < have;) {
+                ssize_t n = ::write(out, plain.data() + done, have - done);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    reader_gone = true;
+                    break;
+                }
+                done += static_cast<size_t>(n);
+            }
+        }
+        inflateEnd(&z);
+        ::close(in);
+        ::close(out);
+    }
+};
+
+MemberStream::MemberStream() : impl_(std::make_unique<Impl>()) {}
+
+MemberStream::~MemberStream() {
+    close();
+}
+
+bool MemberStream::open(const std::string& archive_path, const ArchiveMember& member) {
+    Impl& s = *impl_;
+    close();
+    s.member = member;
+    s.archive = absolute_path(archive_path);
+    if (member.storage == MemberStorage::Stored) {
+        // FFmpeg reads the byte range straight from the archive, seeking as it likes.
+        s.path = "subfile,,start," + std::to_string(member.offset) + ",end," +
+                 std::to_string(member.offset + member.size) + ",,:" + s.archive;
+        return true;
+    }
+
+    const char* tmp = std::getenv("TMPDIR");
+    std::string pattern = std::string(tmp && *tmp ? tmp : "/tmp") + "/face_pixelate_member_XXXXXX";
+    std::vector<char> buf(pattern.begin(), pattern.end());
+    buf.push_back('\0');
+    if (!mkdtemp(buf.data())) {
+        std::cerr << "Cannot create a temporary directory: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    s.dir = buf.data();
+    s.path = s.dir + "/member." + lower_extension(member.name);
+    if (mkfifo(s.path.c_str(), 0600) != 0) {
+        std::cerr << "Cannot create pipe " << s.path << ": " << std::strerror(errno) << std::endl;
+        rmdir(s.dir.c_str());
+        s.dir.clear();
+        return false;
+    }
+    s.stop = false;
+    s.feeder = std::thread([&s] { s.feed(); });
+    return true;
+}
+
+const std::string& MemberStream::path() const {
+    return impl_->path;
+}
+
+void MemberStream::close() {
+    Impl& s = *impl_;
+    s.stop = true;
+    if (s.feeder.joinable()) {
+        s.feeder.join();
+    }
+    if (!s.dir.empty()) {
+        unlink(s.path.c_str());
+        rmdir(s.dir.c_str());
+        s.dir.clear();
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Tar output
+// ---------------------------------------------------------------------------
+
+namespace {
+
+void put_octal(char* field, size_t size, uint64_t value) {
+    // size - 1 digits and a terminating NUL.
+    std::snprintf(field, size, "%0*llo", static_cast<int>(size - 1), static_cast<unsigned long long>(value));
+}
+
+void fill_header(char* block, const std::string& name, uint64_t size, char type) {
+    std::memset(block, 0, 512);
+    std::memcpy(block, name.data(), std::min<size_t>(name.size(), 100));
+    put_octal(block + 100, 8, 0644);
+    put_octal(block + 108, 8, 0);
+    put_octal(block + 116, 8, 0);
+    put_octal(block + 124, 12, size);
+    put_octal(block + 136, 12, static_cast<uint64_t>(std::time(nullptr)));
+    block[156] = type;
+    std::memcpy(block + 257, "ustar", 6);
+    std::memcpy(block + 263, "00", 2);
+}
+
+void finish_header(char* block) {
+    std::memset(block + 148, ' ', 8);
+    unsigned sum = 0;
+    for (int i = 0; i < 512; ++i) {
+        sum += static_cast<unsigned char>(block[i]);
+    }
+    std::snprintf(block + 148, 8, "%06o", sum);
+    block[155] = ' ';
+}
+
+// Split a path into ustar prefix (155) and name (100) at a '/'. False if it does not fit.
+bool split_ustar(const std::string& path, std::string& prefix, std::string& name) {
+    if (path.size() <= 100) {
+        prefix.clear();
+        name = path;
+        return true;
+    }
+    for (size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+        if (slash <= 155 && path.size() - slash - 1 <= 100 && slash + 1 < path.size()) {
+            prefix = path.substr(0, slash);
+            name = path.substr(slash + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+// One "<len> key=value\n" record; the length counts its own digits.
+std::string pax_record(const std::string& key, const std::string& value) {
+    const size_t body = key.size() + value.size() + 3;  // ' ', '=', '\n'
+    size_t len = body + 1;
+    while (std::to_string(len).size() + body != len) {
+        len = std::to_string(len).size() + body;
+    }
+    return std::to_string(len) + " " + key + "=" + value + "\n";
+}
+
+}  // namespace
+
+TarWriter::~TarWriter() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        unlink(part_path_.c_str());
+    }
+}
+
+bool TarWriter::open(const std::string& path) {
+    path_ = path;
+    part_path_ = path + ".part";
+    fd_ = ::open(part_path_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) {
+        std::cerr << "Cannot create " << part_path_ << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool TarWriter::write_all(const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::write(fd_, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= static_cast<size_t>(n);
+        written_ += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+bool TarWriter::add(const std::string& name, const std::string& file) {
+    int in = ::open(file.c_str(), O_RDONLY);
+    struct stat st;
+    if (in < 0 || fstat(in, &st) != 0) {
+        std::cerr << "Cannot read " << file << std::endl;
+        if (in >= 0) {
+            ::close(in);
+        }
+        return false;
+    }
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+
+    std::lock_guard<std::mutex> guard(lock_);
+    char block[512];
+    std::string prefix, short_name;
+    // Long names and sizes of 8 GB and up go into a pax header first.
+    const bool fits = split_ustar(name, prefix, short_name);
+    const bool large = size > 077777777777ull;
+    if (!fits || large) {
+        std::string records;
+        if (!fits) {
+            records += pax_record("path", name);
+            short_name = name.substr(0, 100);
+            prefix.clear();
+        }
+        if (large) {
+            records += pax_record("size", std::to_string(size));
+        }
+        fill_header(block, "PaxHeader", records.size(), 'x');
+        finish_header(block);
+        records.resize((records.size() + 511) / 512 * 512, '\0');
+        if (!write_all(block, 512) || !write_all(records.data(), records.size())) {
+            ::close(in);
+            return false;
+        }
+    }
+    fill_header(block, short_name, large ? 0 : size, '0');
+    std::memcpy(block + 345, prefix.data(), prefix.size());
+    finish_header(block);
+    bool ok = write_all(block, 512);
+
+    // Kernel-side copy where the filesystem supports it, plain read/write otherwise.
+    uint64_t left = size;
+    bool kernel_copy = true;
+    while (ok && left > 0) {
+        if (kernel_copy) {
+            ssize_t n = copy_file_range(in, nullptr, fd_, nullptr, static_cast<size_t>(std::min<uint64_t>(left, 1 << 30)), 0);
+            if (n > 0) {
+                left -= static_cast<uint64_t>(n);
+                written_ += static_cast<uint64_t>(n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            kernel_copy = false;
+        }
+        char buf[1 << 16];
+        ssize_t r = ::read(in, buf, static_cast<size_t>(std::min<uint64_t>(left, sizeof(buf))));
+        ok = r > 0 && write_all(buf, static_cast<size_t>(r));
+        left -= ok ? static_cast<uint64_t>(r) : 0;
+    }
+    ::close(in);
+    static const char zeros[512] = {};
+    const size_t pad = static_cast<size_t>((512 - size % 512) % 512);
+    ok = ok && write_all(zeros, pad);
+    if (!ok) {
+        std::cerr << "Failed to write " << name << " into " << part_path_ << std::endl;
+    }
+    return ok;
+}
+
+bool TarWriter::close() {
+    if (fd_ < 0) {
+        return false;
+    }
+    static const char zeros[1024] = {};
+    bool ok = write_all(zeros, sizeof(zeros)) && fsync(fd_) == 0;
+    ok = ::close(fd_) == 0 && ok;
+    fd_ = -1;
+    if (ok && std::rename(part_path_.c_str(), path_.c_str()) != 0) {
+        std::cerr << "Cannot rename " << part_path_ << " to " << path_ << std::endl;
+        ok = false;
+    }
+    if (!ok) {
+        unlink(part_path_.c_str());
+    }
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Batch run
+// ---------------------------------------------------------------------------
+
+namespace {
+
+// Writes the masked member to its spool file.
+class SpoolSink {
+public:
+    SpoolSink(std::string path, std::string name, double fps)
+        : path_(std::move(path)), name_(std::move(name)), fps_(fps), writer_(std::make_unique<cv::VideoWriter>()) {}
+
+    bool write(cv::Mat& frame, const std::vector<cv::Rect>&) {
+        if (!writer_->isOpened() &&
+            !writer_->open(path_, cv::CAP_FFMPEG, fourcc_for(name_), fps_, frame.size())) {
+            std::cerr << "Failed to open output for " << name_ << std::endl;
+            return false;
+        }
+        writer_->write(frame);
+        return true;
+    }
+
+private:
+    std::string path_;
+    std::string name_;
+    double fps_;
+    // Behind a pointer so the sink can be moved into a pipeline.
+    std::unique_ptr<cv::VideoWriter> writer_;
+};
+
+struct MemberResult {
+    long frames = 0;
+    double seconds = 0.0;
+    bool ok = false;
+};
+
+MemberResult mask_member(const AnonymizerConfig& anon, const ArchiveConfig& cfg, const ArchiveMember& member,
+                         cv::Ptr<cv::FaceDetectorYN>& net, const std::string& spool) {
+    MemberResult result;
+    auto start = std::chrono::steady_clock::now();
+    MemberStream stream;
+    if (!stream.open(cfg.input_path, member)) {
+        return result;
+    }
+    cv::VideoCapture cap;
+    if (!cap.open(stream.path(), cv::CAP_FFMPEG)) {
+        std::cerr << "Cannot decode " << member.name
+                  << (member.storage == MemberStorage::Deflated ? " (compressed member: needs a streamable container)" : "")
+                  << std::endl;
+        return result;
+    }
+    double fps = cap.get(cv::CAP_PROP_FPS);
+    {
+        CaptureMaskPipeline<SpoolSink> pipeline(
+            CaptureSource(cap),
+            YuNetDetector(net, anon.face_padding),
+            FaceTracker(anon.hold_frames),
+            MosaicMasker(anon.mask_style, anon.pixel_block),
+            SpoolSink(spool, output_name(member.name), fps > 0.0 ? fps : 25.0));
+        result.frames = pipeline.run();
+    }
+    cap.release();
+    stream.close();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    result.seconds = elapsed.count();
+    result.ok = result.frames > 0;
+    if (!result.ok) {
+        std::cerr << "No frames decoded from " << member.name << std::endl;
+    }
+    return result;
+}
+
+}  // namespace
+
+int run_archive_batch(const AnonymizerConfig& anon, const ArchiveConfig& cfg) {
+    auto start = std::chrono::steady_clock::now();
+    std::vector<ArchiveMember> all;
+    if (!list_archive(cfg.input_path, all)) {
+        return 1;
+    }
+    std::vector<ArchiveMember> videos;
+    for (const ArchiveMember& m : all) {
+        if (is_video_name(m.name)) {
+            videos.push_back(m);
+        }
+    }
+    std::cout << cfg.input_path << ": " << videos.size() << " videos, " << all.size() - videos.size()
+              << " other members left out" << std::endl;
+    if (videos.empty()) {
+        return 1;
+    }
+
+    TarWriter out;
+    if (!out.open(cfg.output_path)) {
+        return 1;
+    }
+    // Masked videos wait next to the output (same filesystem) until they are appended.
+    std::string out_dir = cfg.output_path.find('/') == std::string::npos
+                              ? "."
+                              : cfg.output_path.substr(0, cfg.output_path.find_last_of('/'));
+    std::string pattern = (out_dir.empty() ? std::string("/") : out_dir) + "/.face_pixelate_spool_XXXXXX";
+    std::vector<char> buf(pattern.begin(), pattern.end());
+    buf.push_back('\0');
+    if (!mkdtemp(buf.data())) {
+        std::cerr << "Cannot create a spool directory in " << out_dir << std::endl;
+        return 1;
+    }
+    const std::string spool_dir = buf.data();
+
+    int workers = cfg.jobs > 0 ? cfg.jobs : available_cpus();
+    workers = std::min<int>(workers, static_cast<int>(videos.size()));
+    if (workers > 1) {
+        // Parallelism comes from members; keep OpenCV from spawning threads per frame too.
+        cv::setNumThreads(1);
+    }
+
+    std::atomic<size_t> next{0};
+    std::atomic<int> failed{0};
+    std::atomic<long> frames{0};
+    std::mutex print_lock;
+    auto worker = [&] {
+        // One detector per worker; its input size follows each member's frames.
+        cv::Ptr<cv::FaceDetectorYN> net = create_yunet(anon, cv::Size(320, 320));
+        for (size_t i = next++; i < videos.size(); i = next++) {
+            const ArchiveMember& m = videos[i];
+            const std::string spool = spool_dir + "/" + std::to_string(i) + "." + lower_extension(output_name(m.name));
+            MemberResult r;
+            if (!net.empty()) {
+                r = mask_member(anon, cfg, m, net, spool);
+            }
+            bool added = r.ok && out.add(output_name(m.name), spool);
+            unlink(spool.c_str());
+            failed += added ? 0 : 1;
+            frames += r.frames;
+            std::lock_guard<std::mutex> guard(print_lock);
+            std::cout << "[" << i + 1 << "/" << videos.size() << "] " << m.name << ": "
+                      << (added ? "masked " : "FAILED after ") << r.frames << " frames in " << r.seconds << " s ("
+                      << (m.storage == MemberStorage::Stored ? "read in place" : "inflated on the fly") << ")"
+                      << std::endl;
+        }
+    };
+    std::vector<std::thread> pool;
+    for (int i = 0; i < workers; ++i) {
+        pool.emplace_back(worker);
+    }
+    for (std::thread& t : pool) {
+        t.join();
+    }
+    rmdir(spool_dir.c_str());
+
+    const bool closed = out.close();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "archive: " << videos.size() - failed << "/" << videos.size() << " videos masked, " << frames
+              << " frames in " << elapsed.count() << " s with " << workers << " jobs; wrote "
+              << out.bytes() / (1024.0 * 1024.0) << " MB to " << cfg.output_path << std::endl;
+    return closed && failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "face_anonymizer.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Batch mode for evidence bundles: mask every video inside a .tar or .zip
+// without extracting the archive first (needs make ARCHIVE=1).
+//
+// Members that are stored uncompressed (every tar member, "stored" zip
+// members) are opened in place: FFmpeg's subfile protocol reads that byte
+// range of the archive, so seeking works and MP4 files with the index at the
+// end are fine. Deflate-compressed zip members are inflated on the fly into a
+// pipe, which only suits containers that need no seeking (MKV, TS, AVI, or
+// "faststart" MP4). Several members are processed at once, and each masked
+// video is appended to a new tar archive as soon as it is done.
+struct ArchiveConfig {
+    // .tar or .zip to read.
+    std::string input_path;
+    // .tar to write. Only the masked videos go in: other members (photos,
+    // documents) could show faces too and are left out.
+    std::string output_path;
+    // Members processed at the same time (0 = one per core the container may use).
+    int jobs = 0;
+};
+
+enum class MemberStorage { Stored, Deflated };
+
+struct ArchiveMember {
+    std::string name;
+    // Where the member's bytes start in the archive, and how many there are.
+    uint64_t offset = 0;
+    uint64_t size = 0;
+    MemberStorage storage = MemberStorage::Stored;
+};
+
+// List the regular files of a tar or zip archive. Prints why on failure.
+bool list_archive(const std::string& path, std::vector<ArchiveMember>& members);
+
+// A member as a path cv::VideoCapture can open (with cv::CAP_FFMPEG).
+class MemberStream {
+public:
+    MemberStream();
+    ~MemberStream();
+
+    bool open(const std::string& archive_path, const ArchiveMember& member);
+    const std::string& path() const;
+    // Call after the capture is released.
+    void close();
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+// Writes a tar archive member by member. The archive is written under a
+// ".part" name and renamed by close(), so a cut-short run leaves no archive
+// that looks complete.
+class TarWriter {
+public:
+    TarWriter() = default;
+    ~TarWriter();
+    TarWriter(const TarWriter&) = delete;
+    TarWriter& operator=(const TarWriter&) = delete;
+
+    bool open(const std::string& path);
+    // Append the contents of `file` as `name`. Safe to call from several threads.
+    bool add(const std::string& name, const std::string& file);
+    bool close();
+
+    uint64_t bytes() const { return written_; }
+
+private:
+    bool write_all(const void* data, size_t size);
+
+    std::string path_;
+    std::string part_path_;
+    int fd_ = -1;
+    uint64_t written_ = 0;
+    std::mutex lock_;
+};
+
+// Returns a process exit code: 0 only if every video member was masked.
+int run_archive_batch(const AnonymizerConfig& anon, const ArchiveConfig& cfg);
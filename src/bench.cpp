@@ -0,0 +1,348 @@
+// Benchmarks the compile-time Pipeline against the runtime (virtual) variant.
+//
+// Two detector setups are measured:
+//   - fixed boxes: no neural network, so stage dispatch and masking dominate;
+//   - yunet: the real detector, i.e. what a deployment actually pays per frame.
+//
+// With --parity the built-in YuNet engine is also checked against OpenCV's
+// FaceDetectorYN on the same frame: faces are paired up and the largest
+// coordinate and score differences are printed with the time per detect().
+//
+// Where the kernel exposes RAPL energy counters (Intel, and AMD Zen on newer
+// kernels) through /sys/class/powercap, every run also reports energy: joules
+// per frame and per megapixel, so a faster setup can be checked for being
+// cheaper in power too. The counters cover whole CPU packages, so keep the
+// machine otherwise idle while measuring.
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include "face_anonymizer.hpp"
+#include "yunet_engine.hpp"
+#include "pipeline.hpp"
+#include "pipeline_stages.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct BenchConfig {
+    std::string model_path = "face_detection_yunet_2023mar.onnx";
+    // Optional still image. A synthetic frame is used when empty.
+    std::string image_path;
+    cv::Size frame_size = cv::Size(1280, 720);
+    long frames = 300;
+    int pixel_block = 28;
+    DetectorEngine engine = DetectorEngine::OpenCV;
+    // Compare the built-in engine with OpenCV's before the runs.
+    bool parity = false;
+};
+
+// Returns the same boxes every frame, standing in for a detector.
+class FixedBoxesDetector {
+public:
+    explicit FixedBoxesDetector(std::vector<cv::Rect> boxes) : boxes_(std::move(boxes)) {}
+    std::vector<cv::Rect> detect(const cv::Mat&) { return boxes_; }
+
+private:
+    std::vector<cv::Rect> boxes_;
+};
+
+// Package energy from the RAPL counters in powercap sysfs.
+class EnergyMeter {
+public:
+    explicit EnergyMeter(const std::string& root = "/sys/class/powercap") {
+        // Top-level zones ("intel-rapl:0", ...) are whole packages; their
+        // subzones (cores, dram) are already counted in them.
+        for (int i = 0;; ++i) {
+            const std::string dir = root + "/intel-rapl:" + std::to_string(i);
+            std::ifstream name_file(dir + "/name");
+            if (!name_file) {
+                break;
+            }
+            Zone zone;
+            std::getline(name_file, zone.name);
+            if (zone.name == "psys") {
+                continue;  // whole platform, would count the packages twice
+            }
+            zone.energy_path = dir + "/energy_uj";
+            std::ifstream range_file(dir + "/max_energy_range_uj");
+            if (!(range_file >> zone.range_uj) || zone.range_uj == 0) {
+                // Without the wrap point a wrapped counter would read as a huge delta.
+                why_ = "cannot read " + dir + "/max_energy_range_uj";
+                continue;
+            }
+            uint64_t value = 0;
+            if (!read_uj(zone.energy_path, value)) {
+                why_ = "cannot read " + zone.energy_path + " (it is root-only on most kernels)";
+                zones_.clear();
+                return;
+            }
+            zones_.push_back(zone);
+        }
+        if (zones_.empty() && why_.empty()) {
+            why_ = "no RAPL zones in " + root;
+        }
+    }
+
+    bool available() const { return !zones_.empty(); }
+
+    // e.g. "package-0, package-1", or why energy is not measured.
+    std::string describe() const {
+        if (!available()) {
+            return why_;
+        }
+        std::string names;
+        for (const Zone& zone : zones_) {
+            names += (names.empty() ? "" : ", ") + zone.name;
+        }
+        return names;
+    }
+
+    // Counter snapshot, one value per zone.
+    std::vector<uint64_t> sample() const {
+        std::vector<uint64_t> values(zones_.size(), 0);
+        for (size_t i = 0; i < zones_.size(); ++i) {
+            read_uj(zones_[i].energy_path, values[i]);
+        }
+        return values;
+    }
+
+    // Joules used between two snapshots. Counters wrap at max_energy_range_uj.
+    double joules(const std::vector<uint64_t>& start, const std::vector<uint64_t>& end) const {
+        double uj = 0.0;
+        for (size_t i = 0; i < zones_.size() && i < start.size() && i < end.size(); ++i) {
+            uint64_t delta = end[i] >= start[i] ? end[i] - start[i] : zones_[i].range_uj - start[i] + end[i];
+            uj += static_cast<double>(delta);
+        }
+        return uj / 1e6;
+    }
+
+private:
+    struct Zone {
+        std::string name;
+        std::string energy_path;
+        uint64_t range_uj = 0;
+    };
+
+    static bool read_uj(const std::string& path, uint64_t& value) {
+        std::ifstream file(path);
+        return static_cast<bool>(file >> value);
+    }
+
+    std::vector<Zone> zones_;
+    std::string why_;
+};
+
+static BenchConfig parse_args(int argc, char** argv) {
+    BenchConfig cfg;
+    for (int i = 1; i < argc; ++i) {
+        std::string key = argv[i];
+        auto need_value = [&](const std::string& name) {
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for " << name << std::endl;
+                std::exit(1);
+            }
+        };
+
+        if (key == "--model") {
+            need_value(key);
+            cfg.model_path = argv[++i];
+        } else if (key == "--image") {
+            need_value(key);
+            cfg.image_path = argv[++i];
+        } else if (key == "--frames") {
+            need_value(key);
+            cfg.frames = std::stol(argv[++i]);
+        } else if (key == "--pixel-block") {
+            need_value(key);
+            cfg.pixel_block = std::stoi(argv[++i]);
+        } else if (key == "--engine") {
+            need_value(key);
+            std::string engine = argv[++i];
+            if (engine == "opencv") {
+                cfg.engine = DetectorEngine::OpenCV;
+            } else if (engine == "builtin") {
+                cfg.engine = DetectorEngine::Builtin;
+            } else {
+                std::cerr << "Unknown engine: " << engine << std::endl;
+                std::exit(1);
+            }
+        } else if (key == "--parity") {
+            cfg.parity = true;
+        } else if (key == "--help" || key == "-h") {
+            std::cout << "Usage: face_pixelate_bench [options]\n"
+                      << "  --model <path>            YuNet model path\n"
+                      << "  --image <path>            Frame to replay (default: synthetic 1280x720)\n"
+                      << "  --frames <int>            Frames per run (default 300)\n"
+                      << "  --pixel-block <int>       Pixelation strength\n"
+                      << "  --engine <name>           opencv (default) or builtin YuNet engine\n"
+                      << "  --parity                  Check the builtin engine against OpenCV first\n";
+            std::exit(0);
+        } else {
+            std::cerr << "Unknown option: " << key << std::endl;
+            std::exit(1);
+        }
+    }
+    cfg.frames = std::max(1L, cfg.frames);
+    return cfg;
+}
+
+// Prints the energy columns of a row: mJ per frame and per megapixel.
+static void print_energy(const EnergyMeter& energy, double joules, long count, double megapixels) {
+    if (!energy.available() || count <= 0) {
+        std::printf(" %10s %10s\n", "-", "-");
+        return;
+    }
+    const double mj = joules * 1000.0 / count;
+    std::printf(" %10.2f %10.2f\n", mj, mj / megapixels);
+}
+
+// Run a pipeline to completion and print one result row.
+template <class P>
+static void report(const std::string& name, P& pipeline, const EnergyMeter& energy, double megapixels) {
+    std::vector<uint64_t> before = energy.sample();
+    auto start = std::chrono::steady_clock::now();
+    long frames = pipeline.run();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    double joules = energy.joules(before, energy.sample());
+    double ms_per_frame = frames > 0 ? elapsed.count() / frames : 0.0;
+    std::printf("%-28s %8ld %12.3f %10.1f", name.c_str(), frames, ms_per_frame,
+        ms_per_frame > 0.0 ? 1000.0 / ms_per_frame : 0.0);
+    print_energy(energy, joules, frames, megapixels);
+}
+
+// Average ms per detect() call, the faces of the last call, and the joules all runs used.
+static double time_detect(cv::FaceDetectorYN& net, const cv::Mat& frame, int runs, cv::Mat& faces,
+                          const EnergyMeter& energy, double& joules) {
+    net.detect(frame, faces);  // warm-up
+    std::vector<uint64_t> before = energy.sample();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < runs; ++i) {
+        net.detect(frame, faces);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    joules = energy.joules(before, energy.sample());
+    return elapsed.count() / runs;
+}
+
+// Run both engines on `frame` and compare their rows. Returns false on a mismatch.
+static bool check_parity(const BenchConfig& cfg, const cv::Mat& frame, const EnergyMeter& energy) {
+    AnonymizerConfig acfg;
+    acfg.model_path = cfg.model_path;
+    cv::Ptr<cv::FaceDetectorYN> reference = create_yunet(acfg, frame.size());
+    acfg.engine = DetectorEngine::Builtin;
+    cv::Ptr<cv::FaceDetectorYN> builtin = create_yunet(acfg, frame.size());
+    if (reference.empty() || builtin.empty()) {
+        std::cerr << "Parity check skipped: failed to load " << cfg.model_path << std::endl;
+        return false;
+    }
+
+    const int runs = static_cast<int>(std::min(50L, cfg.frames));
+    cv::Mat ref_faces, our_faces;
+    double ref_joules = 0.0, our_joules = 0.0;
+    double ref_ms = time_detect(*reference, frame, runs, ref_faces, energy, ref_joules);
+    double our_ms = time_detect(*builtin, frame, runs, our_faces, energy, our_joules);
+
+    const YuNetParity parity = compare_yunet_faces(ref_faces, our_faces);
+
+    // Weights are shared, so the built-in figure is the arena only.
+    const double arena_mb = static_cast<const YuNetEngine&>(*builtin).arena_bytes() / (1024.0 * 1024.0);
+    acfg.engine = DetectorEngine::OpenCV;
+    ModelFootprint cv_fp = model_footprint(acfg, frame.size());
+    const bool same = parity.same();
+    std::printf("parity: opencv %d faces, builtin %d faces, %d matched; max coordinate diff %.3f px, "
+                "max score diff %.4f -> %s\n",
+                parity.reference_faces, parity.engine_faces, parity.matched, parity.max_coord, parity.max_score,
+                same ? "OK" : "MISMATCH");
+    std::printf("parity: detect() opencv %.2f ms, builtin %.2f ms; workspace opencv %.1f MB, builtin %.1f MB\n",
+                ref_ms, our_ms, cv_fp.workspace_bytes / (1024.0 * 1024.0), arena_mb);
+    if (energy.available()) {
+        std::printf("parity: detect() opencv %.2f mJ, builtin %.2f mJ\n", ref_joules * 1000.0 / runs,
+                    our_joules * 1000.0 / runs);
+    }
+    std::printf("\n");
+    return same;
+}
+
+int main(int argc, char** argv) {
+    BenchConfig cfg = parse_args(argc, argv);
+
+    cv::Mat frame;
+    if (!cfg.image_path.empty()) {
+        frame = cv::imread(cfg.image_path, cv::IMREAD_COLOR);
+        if (frame.empty()) {
+            std::cerr << "Failed to read image " << cfg.image_path << std::endl;
+            return 1;
+        }
+    } else {
+        frame = cv::Mat(cfg.frame_size, CV_8UC3);
+        cv::randu(frame, cv::Scalar::all(0), cv::Scalar::all(255));
+    }
+
+    // Three face-sized boxes so the masking cost is realistic.
+    const int w = frame.cols;
+    const int h = frame.rows;
+    std::vector<cv::Rect> boxes = {
+        cv::Rect(w / 10, h / 6, w / 5, h / 3),
+        cv::Rect(w * 2 / 5, h / 4, w / 6, h / 4),
+        cv::Rect(w * 7 / 10, h / 3, w / 8, h / 5),
+    };
+    // Energy differs a lot between the mask styles, so every row runs with both.
+    const MaskStyle styles[] = {MaskStyle::Pixelate, MaskStyle::Blur};
+    auto style_name = [](MaskStyle style) { return style == MaskStyle::Blur ? "blur" : "pixelate"; };
+
+    const double megapixels = w * static_cast<double>(h) / 1e6;
+    EnergyMeter energy;
+    std::printf("frame %dx%d, %ld frames per run\n", w, h, cfg.frames);
+    std::printf("energy: %s%s\n\n", energy.available() ? "RAPL " : "not measured, ", energy.describe().c_str());
+    bool parity_ok = !cfg.parity || check_parity(cfg, frame, energy);
+    std::printf("%-28s %8s %12s %10s %10s %10s\n", "pipeline", "frames", "ms/frame", "fps", "mJ/frame", "mJ/MP");
+
+    for (MaskStyle style : styles) {
+        {
+            Pipeline<RepeatSource, FixedBoxesDetector, FaceTracker, MosaicMasker, NullSink> p(
+                RepeatSource(frame, cfg.frames), FixedBoxesDetector(boxes), FaceTracker(0),
+                MosaicMasker(style, cfg.pixel_block), NullSink());
+            report(std::string("static  / fixed / ") + style_name(style), p, energy, megapixels);
+        }
+        {
+            RuntimePipeline p(
+                make_source(RepeatSource(frame, cfg.frames)), make_detector(FixedBoxesDetector(boxes)),
+                make_tracker(FaceTracker(0)), make_masker(MosaicMasker(style, cfg.pixel_block)), make_sink(NullSink()));
+            report(std::string("runtime / fixed / ") + style_name(style), p, energy, megapixels);
+        }
+    }
+
+    AnonymizerConfig acfg;
+    acfg.model_path = cfg.model_path;
+    acfg.engine = cfg.engine;
+    cv::Ptr<cv::FaceDetectorYN> yunet = create_yunet(acfg, frame.size());
+    if (yunet.empty()) {
+        std::cerr << "\nSkipping YuNet runs: failed to load " << cfg.model_path << std::endl;
+        return parity_ok ? 0 : 1;
+    }
+    for (MaskStyle style : styles) {
+        {
+            Pipeline<RepeatSource, YuNetDetector, FaceTracker, MosaicMasker, NullSink> p(
+                RepeatSource(frame, cfg.frames), YuNetDetector(yunet, acfg.face_padding), FaceTracker(acfg.hold_frames),
+                MosaicMasker(style, cfg.pixel_block), NullSink());
+            report(std::string("static  / yunet / ") + style_name(style), p, energy, megapixels);
+        }
+        {
+            RuntimePipeline p(
+                make_source(RepeatSource(frame, cfg.frames)), make_detector(YuNetDetector(yunet, acfg.face_padding)),
+                make_tracker(FaceTracker(acfg.hold_frames)), make_masker(MosaicMasker(style, cfg.pixel_block)),
+                make_sink(NullSink()));
+            report(std::string("runtime / yunet / ") + style_name(style), p, energy, megapixels);
+        }
+    }
+    return parity_ok ? 0 : 1;
+}
@@ -0,0 +1,232 @@
+#include "container_limits.hpp"
+
+#include <unistd.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Where one cgroup hierarchy is mounted.
+struct CgroupMount {
+    // Mount point, e.g. /sys/fs/cgroup/cpu,cpuacct.
+    std::string point;
+    // Which cgroup of the hierarchy is mounted there ("/" unless it is a container's view).
+    std::string root;
+};
+
+bool read_line(const std::string& path, std::string& line) {
+    std::ifstream file(path);
+    return static_cast<bool>(std::getline(file, line));
+}
+
+bool has_option(const std::string& options, const std::string& name) {
+    std::stringstream list(options);
+    std::string item;
+    while (std::getline(list, item, ',')) {
+        if (item == name) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Mount of the v1 hierarchy with `controller`, or of the v2 hierarchy (empty controller).
+bool find_mount(const std::string& controller, CgroupMount& mount) {
+    std::ifstream file("/proc/self/mountinfo");
+    std::string line;
+    while (std::getline(file, line)) {
+        // id parent major:minor root mount-point options [optional...] - fstype source super-options
+        std::stringstream fields(line);
+        std::string id, parent, device, root, point, field;
+        fields >> id >> parent >> device >> root >> point;
+        while (fields >> field && field != "-") {
+        }
+        std::string fstype, source, super_options;
+        fields >> fstype >> source >> super_options;
+        const bool match = controller.empty() ? fstype == "cgroup2"
+                                              : fstype == "cgroup" && has_option(super_options, controller);
+        if (match) {
+            mount.point = point;
+            mount.root = root;
+            return true;
+        }
+    }
+    return false;
+}
+
+// This process's cgroup in the v1 hierarchy with `controller`, or in v2 (empty controller).
+std::string own_cgroup(const std::string& controller) {
+    std::ifstream file("/proc/self/cgroup");
+    std::string line;
+    while (std::getline(file, line)) {
+        // hierarchy-id:controllers:path
+        size_t first = line.find(':');
+        size_t second = line.find(':', first + 1);
+        if (first == std::string::npos || second == std::string::npos) {
+            continue;
+        }
+        std::string controllers = line.substr(first + 1, second - first - 1);
+        if (controller.empty() ? controllers.empty() : has_option(controllers, controller)) {
+            return line.substr(second + 1);
+        }
+    }
+    return "";
+}
+
+// Directories from our own cgroup up to the mount point. A limit set on any of
+// them applies, so the caller keeps the smallest.
+std::vector<std::string> cgroup_dirs(const CgroupMount& mount, const std::string& cgroup) {
+    std::string relative;
+    if (mount.root == "/") {
+        relative = cgroup;
+    } else if (cgroup.compare(0, mount.root.size(), mount.root) == 0) {
+        relative = cgroup.substr(mount.root.size());
+    }
+    // Otherwise the container only sees its own cgroup, mounted at the mount point.
+    std::vector<std::string> dirs;
+    while (!relative.empty() && relative != "/") {
+        dirs.push_back(mount.point + relative);
+        relative = relative.substr(0, relative.find_last_of('/'));
+    }
+    dirs.push_back(mount.point);
+    return dirs;
+}
+
+void keep_smaller(double& current, double value) {
+    if (value > 0.0 && (current == 0.0 || value < current)) {
+        current = value;
+    }
+}
+
+void keep_smaller(int64_t& current, int64_t value) {
+    if (value > 0 && (current == 0 || value < current)) {
+        current = value;
+    }
+}
+
+ContainerLimits read_limits() {
+    ContainerLimits limits;
+    limits.host_cpus = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    limits.affinity_cpus = limits.host_cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        limits.affinity_cpus = std::max(1, CPU_COUNT(&set));
+    }
+    const int64_t physical = static_cast<int64_t>(sysconf(_SC_PHYS_PAGES)) * sysconf(_SC_PAGESIZE);
+
+    CgroupMount mount;
+    std::string line;
+    if (find_mount("cpu", mount)) {
+        limits.cgroup = "v1";
+        std::vector<std::string> dirs = cgroup_dirs(mount, own_cgroup("cpu"));
+        limits.cpu_stat_path = dirs.front() + "/cpu.stat";
+        for (const std::string& dir : dirs) {
+            std::string quota, period;
+            if (read_line(dir + "/cpu.cfs_quota_us", quota) && read_line(dir + "/cpu.cfs_period_us", period) &&
+                std::stoll(quota) > 0 && std::stoll(period) > 0) {
+                keep_smaller(limits.cpu_quota, static_cast<double>(std::stoll(quota)) / std::stoll(period));
+            }
+        }
+    } else if (find_mount("", mount)) {
+        limits.cgroup = "v2";
+        std::vector<std::string> dirs = cgroup_dirs(mount, own_cgroup(""));
+        limits.cpu_stat_path = dirs.front() + "/cpu.stat";
+        for (const std::string& dir : dirs) {
+            // "max 100000" or "<quota> <period>", in microseconds.
+            std::stringstream max(read_line(dir + "/cpu.max", line) ? line : "");
+            std::string quota;
+            long long period = 0;
+            if (max >> quota >> period && quota != "max" && period > 0) {
+                keep_smaller(limits.cpu_quota, static_cast<double>(std::stoll(quota)) / period);
+            }
+        }
+    }
+    if (find_mount("memory", mount)) {
+        limits.cgroup = limits.cgroup.empty() ? "v1" : limits.cgroup;
+        for (const std::string& dir : cgroup_dirs(mount, own_cgroup("memory"))) {
+            // "No limit" is a huge number here, larger than the machine's memory.
+            if (read_line(dir + "/memory.limit_in_bytes", line) && std::stoll(line) < physical) {
+                keep_smaller(limits.memory_limit, std::stoll(line));
+            }
+        }
+    } else if (find_mount("", mount)) {
+        limits.cgroup = limits.cgroup.empty() ? "v2" : limits.cgroup;
+        for (const std::string& dir : cgroup_dirs(mount, own_cgroup(""))) {
+            if (read_line(dir + "/memory.max", line) && line != "max") {
+                keep_smaller(limits.memory_limit, std::stoll(line));
+            }
+        }
+    }
+#endif
+
+    limits.cpus = limits.affinity_cpus;
+    if (limits.cpu_quota > 0.0) {
+        // Whole cores only: 1.5 cores run one busy thread without throttling, two would not.
+        limits.cpus = std::min(limits.cpus, std::max(1, static_cast<int>(std::floor(limits.cpu_quota + 0.01))));
+    }
+    return limits;
+}
+
+}  // namespace
+
+void ContainerLimits::print(std::ostream& out) const {
+    out << "container: cgroup " << (cgroup.empty() ? "none" : cgroup) << ", " << affinity_cpus << " of " << host_cpus
+        << " CPUs allowed";
+    if (cpu_quota > 0.0) {
+        out << ", quota " << cpu_quota << " cores";
+    }
+    if (memory_limit > 0) {
+        out << ", memory limit " << memory_limit / (1024 * 1024) << " MB";
+    }
+    out << " -> " << cpus << (cpus == 1 ? " thread" : " threads") << std::endl;
+}
+
+const ContainerLimits& container_limits() {
+    static const ContainerLimits limits = read_limits();
+    return limits;
+}
+
+int available_cpus() {
+    return container_limits().cpus;
+}
+
+CpuThrottling read_cpu_throttling() {
+    CpuThrottling t;
+    const std::string& path = container_limits().cpu_stat_path;
+    if (path.empty()) {
+        return t;
+    }
+    std::ifstream file(path);
+    std::string key;
+    long long value = 0;
+    while (file >> key >> value) {
+        if (key == "nr_periods") {
+            t.periods = static_cast<uint64_t>(value);
+        } else if (key == "nr_throttled") {
+            t.throttled_periods = static_cast<uint64_t>(value);
+        } else if (key == "throttled_usec") {  // v2
+            t.throttled_us = value;
+        } else if (key == "throttled_time") {  // v1, in nanoseconds
+            t.throttled_us = value / 1000;
+        }
+    }
+    return t;
+}
+
+void print_throttling(std::ostream& out, const CpuThrottling& start, const CpuThrottling& end) {
+    const uint64_t periods = end.periods - start.periods;
+    if (periods == 0) {
+        return;  // no quota, or no counters
+    }
+    out << "container: throttled in " << end.throttled_periods - start.throttled_periods << " of " << periods
+        << " CPU periods (" << (end.throttled_us - start.throttled_us) / 1000.0 << " ms)" << std::endl;
+}
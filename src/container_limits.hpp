@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+// CPU and memory limits of the container (cgroup v1 or v2) the app runs in.
+//
+// A Kubernetes pod on a 64-core node may only have a quota of 2 cores. OpenCV,
+// FFmpeg and the worker pools would still start one thread per host core, use
+// up the quota early in each scheduling period (100 ms by default) and then sit
+// throttled for the rest of it. Sizing from these numbers instead avoids that.
+struct ContainerLimits {
+    // "v1", "v2", or empty when no cgroup filesystem was found (e.g. macOS).
+    std::string cgroup;
+    // Online CPUs of the machine.
+    int host_cpus = 1;
+    // CPUs this process may run on (cpuset, taskset).
+    int affinity_cpus = 1;
+    // Cores' worth of CPU time per period (0 = no quota).
+    double cpu_quota = 0.0;
+    // Bytes (0 = no limit).
+    int64_t memory_limit = 0;
+    // Threads worth running at once: the allowed CPUs, capped by the quota.
+    int cpus = 1;
+    // Where the throttling counters are (empty = none).
+    std::string cpu_stat_path;
+
+    bool limited() const { return cpus < host_cpus || memory_limit > 0; }
+    void print(std::ostream& out) const;
+};
+
+// Read once at first use; later calls return the same values.
+const ContainerLimits& container_limits();
+
+// container_limits().cpus: the default size of worker pools.
+int available_cpus();
+
+// Counters from the cgroup's cpu.stat. All zero when there are none.
+struct CpuThrottling {
+    uint64_t periods = 0;
+    uint64_t throttled_periods = 0;
+    int64_t throttled_us = 0;
+};
+
+CpuThrottling read_cpu_throttling();
+
+// "container: throttled in 3 of 1200 CPU periods (45.0 ms)", if the counters moved.
+void print_throttling(std::ostream& out, const CpuThrottling& start, const CpuThrottling& end);
@@ -0,0 +1,191 @@
+#include "decode_ahead.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+int64_t elapsed_us(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void record_max(std::atomic<int64_t>& slot, int64_t value) {
+    int64_t seen = slot.load();
+    while (value > seen && !slot.compare_exchange_weak(seen, value)) {
+    }
+}
+
+}  // namespace
+
+bool open_capture(cv::VideoCapture& cap, const std::string& input, int camera_index, const DecoderOptions& opts) {
+    if (input.empty()) {
+        return cap.open(camera_index);
+    }
+
+    // OpenCV has no property for FFmpeg's thread_type, so it goes through the
+    // backend's option string ("key;value|key;value"). OpenCV only uses RTSP over
+    // TCP by default while that variable is unset, so keep that default when
+    // setting it. Options the user already exported are kept, and win.
+    if (!opts.thread_type.empty()) {
+        const char* exported = std::getenv("OPENCV_FFMPEG_CAPTURE_OPTIONS");
+        std::string value = exported ? exported : "rtsp_transport;tcp";
+        const std::string option = "thread_type;" + opts.thread_type;
+        if (value.find("thread_type;") == std::string::npos) {
+            value += (value.empty() ? "" : "|") + option;
+            setenv("OPENCV_FFMPEG_CAPTURE_OPTIONS", value.c_str(), 1);
+        } else if (value.find(option) == std::string::npos) {
+            std::cerr << "Warning: --decode-thread-type ignored, OPENCV_FFMPEG_CAPTURE_OPTIONS already sets thread_type"
+                      << std::endl;
+        }
+    }
+
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 7)
+    if (opts.threads > 0) {
+        return cap.open(input, cv::CAP_ANY, {cv::CAP_PROP_N_THREADS, opts.threads});
+    }
+#endif
+    return cap.open(input);
+}
+
+void DecodeStats::print(std::ostream& out, int queue_depth) const {
+    uint64_t n = frames;
+    double avg_ms = n ? total_us / 1000.0 / n : 0.0;
+    out << "decode: " << n << " frames, avg " << avg_ms << " ms, max " << max_us / 1000.0 << " ms";
+    if (queue_depth > 0) {
+        out << "; pipeline waited " << stalls << " times (" << stall_us / 1000.0 << " ms)"
+            << ", queue peak " << queue_peak << "/" << queue_depth;
+    }
+    out << std::endl;
+}
+
+struct DecodeAheadSource::Impl {
+    cv::VideoCapture* cap = nullptr;
+    size_t depth = 0;
+    std::function<void(cv::Mat&)> on_decoded;
+    std::shared_ptr<DecodeStats> stats = std::make_shared<DecodeStats>();
+
+    std::mutex lock;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    std::deque<cv::Mat> ready;
+    // Buffers handed back by the pipeline, reused by the decoder.
+    std::vector<cv::Mat> spare;
+    bool eof = false;
+    bool stop = false;
+    std::thread thread;
+
+    // Time one cap->read() and fold it into the stats.
+    bool decode(cv::Mat& frame) {
+        auto start = std::chrono::steady_clock::now();
+        bool ok = cap->read(frame) && !frame.empty();
+        if (ok) {
+            int64_t us = elapsed_us(start);
+            stats->frames++;
+            stats->total_us += us;
+            record_max(stats->max_us, us);
+            if (on_decoded) {
+                on_decoded(frame);
+            }
+        }
+        return ok;
+    }
+
+    void run() {
+        while (true) {
+            cv::Mat frame;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                not_full.wait(guard, [&] { return stop || ready.size() < depth; });
+                if (stop) {
+                    return;
+                }
+                if (!spare.empty()) {
+                    frame = std::move(spare.back());
+                    spare.pop_back();
+                }
+            }
+
+            bool ok = decode(frame);
+
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (!ok) {
+                    eof = true;
+                } else {
+                    ready.push_back(std::move(frame));
+                    stats->queue_peak = std::max(stats->queue_peak.load(), static_cast<int>(ready.size()));
+                }
+            }
+            not_empty.notify_one();
+            if (!ok) {
+                return;
+            }
+        }
+    }
+
+    ~Impl() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        not_full.notify_all();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+};
+
+DecodeAheadSource::DecodeAheadSource(cv::VideoCapture& cap, int decode_ahead,
+                                     std::function<void(cv::Mat&)> on_decoded)
+    : impl_(std::make_unique<Impl>()) {
+    impl_->cap = &cap;
+    impl_->on_decoded = std::move(on_decoded);
+    impl_->depth = static_cast<size_t>(std::max(0, decode_ahead));
+    if (impl_->depth > 0) {
+        Impl* raw = impl_.get();
+        impl_->thread = std::thread([raw] { raw->run(); });
+    }
+}
+
+DecodeAheadSource::~DecodeAheadSource() = default;
+DecodeAheadSource::DecodeAheadSource(DecodeAheadSource&&) noexcept = default;
+DecodeAheadSource& DecodeAheadSource::operator=(DecodeAheadSource&&) noexcept = default;
+
+bool DecodeAheadSource::read(cv::Mat& frame) {
+    Impl& s = *impl_;
+    if (s.depth == 0) {
+        return s.decode(frame);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> guard(s.lock);
+    if (s.ready.empty() && !s.eof) {
+        s.stats->stalls++;
+        s.not_empty.wait(guard, [&] { return !s.ready.empty() || s.eof; });
+        s.stats->stall_us += elapsed_us(start);
+    }
+    if (s.ready.empty()) {
+        return false;
+    }
+
+    // Give the previous frame's buffer back to the decoder, unless a sink still shares it.
+    if (!frame.empty() && frame.u && frame.u->refcount == 1) {
+        s.spare.push_back(std::move(frame));
+    }
+    frame = std::move(s.ready.front());
+    s.ready.pop_front();
+    guard.unlock();
+    s.not_full.notify_one();
+    return true;
+}
+
+std::shared_ptr<const DecodeStats> DecodeAheadSource::stats() const {
+    return impl_->stats;
+}
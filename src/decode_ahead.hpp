@@ -0,0 +1,59 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <string>
+
+// How the input is decoded.
+struct DecoderOptions {
+    // FFmpeg decoder threads (0 = backend default).
+    int threads = 0;
+    // "frame", "slice" or empty for the backend default.
+    std::string thread_type;
+    // Frames decoded ahead on a background thread (0 = decode inline).
+    int decode_ahead = 0;
+};
+
+// Open the camera (empty `input`) or a file/URL with the decoder options applied.
+bool open_capture(cv::VideoCapture& cap, const std::string& input, int camera_index, const DecoderOptions& opts);
+
+// Decode timing, kept apart from detection and masking.
+struct DecodeStats {
+    std::atomic<uint64_t> frames{0};
+    std::atomic<int64_t> total_us{0};
+    std::atomic<int64_t> max_us{0};
+    // Times the pipeline found the decode-ahead queue empty and had to wait.
+    std::atomic<uint64_t> stalls{0};
+    std::atomic<int64_t> stall_us{0};
+    std::atomic<int> queue_peak{0};
+
+    void print(std::ostream& out, int queue_depth) const;
+};
+
+// Source stage that decodes on its own thread, `decode_ahead` frames in front
+// of the pipeline. Frame buffers are recycled, so steady state does not allocate.
+// With decode_ahead == 0 it simply reads inline and still records decode time.
+class DecodeAheadSource {
+public:
+    // `cap` must outlive the source. `on_decoded`, if set, runs on every frame
+    // right after it is decoded (on the decode thread), before it is queued.
+    DecodeAheadSource(cv::VideoCapture& cap, int decode_ahead, std::function<void(cv::Mat&)> on_decoded = {});
+    ~DecodeAheadSource();
+    DecodeAheadSource(DecodeAheadSource&&) noexcept;
+    DecodeAheadSource& operator=(DecodeAheadSource&&) noexcept;
+
+    bool read(cv::Mat& frame);
+
+    // Stays valid after the source is moved into a pipeline.
+    std::shared_ptr<const DecodeStats> stats() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,245 @@
+#include "event_stream.hpp"
+
+#include "latency_probe.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+namespace {
+
+const char* kTypeNames[] = {"frame", "box", "birth", "death"};
+const uint32_t kBinaryVersion = 1;
+
+template <class T>
+void put_le(std::string& out, T value) {
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out.push_back(static_cast<char>((static_cast<uint64_t>(value) >> (8 * i)) & 0xff));
+    }
+}
+
+void format_jsonl(const Event& e, std::string& out) {
+    char line[192];
+    int n;
+    switch (e.type) {
+    case EventType::Frame:
+        n = std::snprintf(line, sizeof(line), "{\"t\":\"frame\",\"frame\":%u,\"us\":%lld,\"faces\":%u}\n", e.frame,
+                          static_cast<long long>(e.unix_us), e.id);
+        break;
+    case EventType::Box:
+        n = std::snprintf(line, sizeof(line),
+                          "{\"t\":\"box\",\"frame\":%u,\"us\":%lld,\"track\":%u,\"box\":[%d,%d,%d,%d]}\n", e.frame,
+                          static_cast<long long>(e.unix_us), e.id, e.box.x, e.box.y, e.box.width, e.box.height);
+        break;
+    default:
+        n = std::snprintf(line, sizeof(line), "{\"t\":\"%s\",\"frame\":%u,\"us\":%lld,\"track\":%u}\n",
+                          kTypeNames[static_cast<int>(e.type)], e.frame, static_cast<long long>(e.unix_us), e.id);
+        break;
+    }
+    out.append(line, static_cast<size_t>(std::max(0, std::min<int>(n, sizeof(line) - 1))));
+}
+
+void format_binary(const Event& e, std::string& out) {
+    out.push_back(static_cast<char>(e.type));
+    out.append(3, '\0');
+    put_le<uint32_t>(out, e.frame);
+    put_le<uint32_t>(out, e.id);
+    put_le<int32_t>(out, e.box.x);
+    put_le<int32_t>(out, e.box.y);
+    put_le<int32_t>(out, e.box.width);
+    put_le<int32_t>(out, e.box.height);
+    put_le<int64_t>(out, e.unix_us);
+}
+
+double overlap(const cv::Rect& a, const cv::Rect& b) {
+    double inter = (a & b).area();
+    double uni = a.area() + b.area() - inter;
+    return uni > 0.0 ? inter / uni : 0.0;
+}
+
+}  // namespace
+
+bool parse_event_format(const std::string& name, EventFormat& format) {
+    if (name == "jsonl") {
+        format = EventFormat::Jsonl;
+    } else if (name == "binary") {
+        format = EventFormat::Binary;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+struct EventStream::Impl {
+    EventConfig cfg;
+    FILE* out = nullptr;
+    SpscRing<Event> ring;
+    std::atomic<bool> stop{false};
+    // Producer-side counters are only touched by the pipeline thread; atomics
+    // (relaxed) just make reading them from elsewhere well defined.
+    std::atomic<uint64_t> emitted{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> written{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> batches{0};
+    std::thread thread;
+
+    Impl(EventConfig c, FILE* f) : cfg(std::move(c)), out(f), ring(cfg.capacity) {}
+
+    ~Impl() {
+        if (out && out != stdout) {
+            std::fclose(out);
+        } else if (out) {
+            std::fflush(out);
+        }
+    }
+
+    // Drain whatever is queued into one buffer and write it with a single call.
+    bool drain(std::string& batch) {
+        batch.clear();
+        Event e;
+        uint64_t n = 0;
+        while (ring.try_pop(e)) {
+            if (cfg.format == EventFormat::Jsonl) {
+                format_jsonl(e, batch);
+            } else {
+                format_binary(e, batch);
+            }
+            n++;
+        }
+        if (n == 0) {
+            return false;
+        }
+        std::fwrite(batch.data(), 1, batch.size(), out);
+        std::fflush(out);
+        written.fetch_add(n, std::memory_order_relaxed);
+        bytes.fetch_add(batch.size(), std::memory_order_relaxed);
+        batches.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void run() {
+        std::string batch;
+        batch.reserve(64 * 1024);
+        while (!stop.load(std::memory_order_acquire)) {
+            if (!drain(batch)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(cfg.poll_ms));
+            }
+        }
+        drain(batch);
+    }
+};
+
+std::shared_ptr<EventStream> EventStream::create(const EventConfig& cfg) {
+    FILE* f = cfg.path == "-" ? stdout : std::fopen(cfg.path.c_str(), "wb");
+    if (!f) {
+        return {};
+    }
+    if (cfg.format == EventFormat::Binary) {
+        std::string header = "FPEV";
+        put_le<uint32_t>(header, kBinaryVersion);
+        std::fwrite(header.data(), 1, header.size(), f);
+    }
+    return std::make_shared<EventStream>(std::make_unique<Impl>(cfg, f));
+}
+
+EventStream::EventStream(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {
+    Impl* raw = impl_.get();
+    impl_->thread = std::thread([raw] { raw->run(); });
+}
+
+EventStream::~EventStream() {
+    close();
+}
+
+void EventStream::close() {
+    impl_->stop.store(true, std::memory_order_release);
+    if (impl_->thread.joinable()) {
+        impl_->thread.join();
+    }
+}
+
+void EventStream::emit(const Event& event) {
+    impl_->emitted.fetch_add(1, std::memory_order_relaxed);
+    if (impl_->stop.load(std::memory_order_relaxed) || !impl_->ring.try_push(event)) {
+        impl_->dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+EventStats EventStream::stats() const {
+    EventStats s;
+    s.emitted = impl_->emitted.load(std::memory_order_relaxed);
+    s.dropped = impl_->dropped.load(std::memory_order_relaxed);
+    s.written = impl_->written.load(std::memory_order_relaxed);
+    s.bytes = impl_->bytes.load(std::memory_order_relaxed);
+    s.batches = impl_->batches.load(std::memory_order_relaxed);
+    return s;
+}
+
+TrackIds::Update TrackIds::update(const std::vector<cv::Rect>& boxes) {
+    Update u;
+    u.ids.assign(boxes.size(), 0);
+    std::vector<bool> matched(tracks_.size(), false);
+    // Greedy: each box takes the free track it overlaps most (IoU >= 0.3).
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        double best = 0.3;
+        size_t best_j = tracks_.size();
+        for (size_t j = 0; j < tracks_.size(); ++j) {
+            double o = matched[j] ? 0.0 : overlap(boxes[i], tracks_[j].box);
+            if (o >= best) {
+                best = o;
+                best_j = j;
+            }
+        }
+        if (best_j < tracks_.size()) {
+            matched[best_j] = true;
+            u.ids[i] = tracks_[best_j].id;
+        } else {
+            u.ids[i] = next_id_++;
+            u.born.push_back(u.ids[i]);
+        }
+    }
+    for (size_t j = 0; j < tracks_.size(); ++j) {
+        if (!matched[j]) {
+            u.died.push_back(tracks_[j].id);
+        }
+    }
+    tracks_.clear();
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        tracks_.push_back(Track{u.ids[i], boxes[i]});
+    }
+    return u;
+}
+
+bool EventSink::write(cv::Mat&, const std::vector<cv::Rect>& boxes) {
+    const uint32_t frame = frame_index_++;
+    const int64_t now = unix_us_now();
+    TrackIds::Update u = tracks_.update(boxes);
+
+    Event e;
+    e.frame = frame;
+    e.unix_us = now;
+    for (uint32_t id : u.died) {
+        e.type = EventType::TrackDeath;
+        e.id = id;
+        stream_->emit(e);
+    }
+    for (uint32_t id : u.born) {
+        e.type = EventType::TrackBirth;
+        e.id = id;
+        stream_->emit(e);
+    }
+    e.type = EventType::Box;
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        e.id = u.ids[i];
+        e.box = boxes[i];
+        stream_->emit(e);
+    }
+    e.type = EventType::Frame;
+    e.id = static_cast<uint32_t>(boxes.size());
+    e.box = cv::Rect();
+    stream_->emit(e);
+    return true;
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Detection event output for downstream analytics.
+//
+// The pipeline thread only drops fixed-size events into a lock-free ring; a
+// background thread formats them and writes them out in batches. When the ring
+// is full the event is dropped and counted: processing never waits for disk.
+
+enum class EventFormat { Jsonl, Binary };
+
+// Accepts "jsonl" or "binary".
+bool parse_event_format(const std::string& name, EventFormat& format);
+
+struct EventConfig {
+    // Output file ("-" = stdout).
+    std::string path;
+    EventFormat format = EventFormat::Jsonl;
+    // Ring size in events, rounded up to a power of two.
+    size_t capacity = 8192;
+    // How long the writer sleeps when the ring is empty.
+    int poll_ms = 20;
+};
+
+enum class EventType : uint8_t { Frame = 0, Box = 1, TrackBirth = 2, TrackDeath = 3 };
+
+// One event. For Frame events `id` holds the number of faces in the frame.
+//
+// Binary layout (little endian, 36 bytes per event, after an 8-byte "FPEV" +
+// uint32 version header): u8 type, 3 pad bytes, u32 frame, u32 id,
+// i32 x, y, w, h, i64 unix time in microseconds.
+struct Event {
+    EventType type = EventType::Frame;
+    uint32_t frame = 0;
+    uint32_t id = 0;
+    cv::Rect box;
+    int64_t unix_us = 0;
+};
+
+// Single-producer / single-consumer ring buffer. No locks: each side owns one index.
+template <class T>
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity) {
+        size_t n = 2;
+        while (n < capacity) {
+            n <<= 1;
+        }
+        slots_.resize(n);
+        mask_ = n - 1;
+    }
+
+    // Producer side. False when full.
+    bool try_push(const T& value) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) > mask_) {
+            return false;
+        }
+        slots_[head & mask_] = value;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. False when empty.
+    bool try_pop(T& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots_[tail & mask_];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t capacity() const { return slots_.size(); }
+
+private:
+    std::vector<T> slots_;
+    size_t mask_ = 0;
+    // Kept on separate cache lines so producer and consumer do not fight over one.
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+struct EventStats {
+    uint64_t emitted = 0;
+    uint64_t dropped = 0;
+    uint64_t written = 0;
+    uint64_t bytes = 0;
+    uint64_t batches = 0;
+};
+
+class EventStream {
+public:
+    // Returns an empty pointer if the output cannot be opened.
+    static std::shared_ptr<EventStream> create(const EventConfig& cfg);
+    ~EventStream();
+    EventStream(const EventStream&) = delete;
+    EventStream& operator=(const EventStream&) = delete;
+
+    // Never blocks. Call from one thread only.
+    void emit(const Event& event);
+
+    // Write out what is queued and stop the writer. Later events are dropped.
+    void close();
+
+    // Approximate while running, exact after close().
+    EventStats stats() const;
+
+    struct Impl;
+    explicit EventStream(std::unique_ptr<Impl> impl);
+
+private:
+    std::unique_ptr<Impl> impl_;
+};
+
+// Gives boxes stable track IDs from frame to frame (best overlap wins) and
+// reports births and deaths.
+class TrackIds {
+public:
+    struct Update {
+        std::vector<uint32_t> ids;  // one per input box
+        std::vector<uint32_t> born;
+        std::vector<uint32_t> died;
+    };
+    Update update(const std::vector<cv::Rect>& boxes);
+
+private:
+    struct Track {
+        uint32_t id;
+        cv::Rect box;
+    };
+    std::vector<Track> tracks_;
+    uint32_t next_id_ = 1;
+};
+
+// Sink stage that emits frame, box and track events for every output frame.
+class EventSink {
+public:
+    explicit EventSink(std::shared_ptr<EventStream> stream) : stream_(std::move(stream)) {}
+    bool write(cv::Mat& frame, const std::vector<cv::Rect>& boxes);
+
+private:
+    std::shared_ptr<EventStream> stream_;
+    TrackIds tracks_;
+    uint32_t frame_index_ = 0;
+};
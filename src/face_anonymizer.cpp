@@ -0,0 +1,357 @@
+#include "face_anonymizer.hpp"
+
+#include "yunet_engine.hpp"
+
+#include <opencv2/dnn.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+
+namespace {
+
+// Model files are read once per path and the bytes are shared by every detector.
+std::mutex g_models_lock;
+std::map<std::string, std::shared_ptr<const std::vector<uchar>>> g_models;
+std::atomic<int> g_instances{0};
+
+std::shared_ptr<const std::vector<uchar>> model_bytes(const std::string& path) {
+    std::lock_guard<std::mutex> guard(g_models_lock);
+    auto it = g_models.find(path);
+    if (it != g_models.end()) {
+        return it->second;
+    }
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        return nullptr;
+    }
+    auto bytes = std::make_shared<const std::vector<uchar>>(std::istreambuf_iterator<char>(in),
+                                                            std::istreambuf_iterator<char>());
+    if (bytes->empty()) {
+        return nullptr;
+    }
+    g_models[path] = bytes;
+    return bytes;
+}
+
+// Parsed networks for the built-in engine, also once per path.
+std::map<std::string, std::shared_ptr<const YuNetModel>> g_engine_models;
+
+std::shared_ptr<const YuNetModel> engine_model(const std::string& path) {
+    auto bytes = model_bytes(path);
+    if (!bytes) {
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> guard(g_models_lock);
+    auto it = g_engine_models.find(path);
+    if (it != g_engine_models.end()) {
+        return it->second;
+    }
+    auto model = load_yunet_model(*bytes);
+    if (model) {
+        g_engine_models[path] = model;
+    }
+    return model;
+}
+
+// Boxes are split into horizontal strips of about this many bytes, so a strip
+// stays in the L2 cache while it is written. Smaller boxes are one strip.
+constexpr size_t kStripBytes = 256 * 1024;
+
+// Write `count` pixels of `color` (N bytes each) from `dst` on.
+template <int N>
+void fill_pixels(uchar* dst, const uchar* color, int count) {
+    for (int i = 0; i < count; ++i, dst += N) {
+        for (int c = 0; c < N; ++c) {
+            dst[c] = color[c];
+        }
+    }
+}
+
+void fill_run(uchar* dst, const uchar* color, int count, size_t pixel) {
+    switch (pixel) {
+    case 1:
+        std::memset(dst, color[0], static_cast<size_t>(count));
+        break;
+    case 3:
+        fill_pixels<3>(dst, color, count);
+        break;
+    case 4:
+        fill_pixels<4>(dst, color, count);
+        break;
+    default:
+        for (int i = 0; i < count; ++i) {
+            std::memcpy(dst + i * pixel, color, pixel);
+        }
+    }
+}
+
+// Pixelate `roi` (part of a frame) in place, writing every pixel once.
+// The result is the same as pixelate_roi(roi).copyTo(roi): the small image is
+// made the same way, and each pixel takes its cell with the same
+// nearest-neighbor mapping cv::resize uses. Large boxes (close-ups) are
+// filled strip by strip on all threads instead of on one. Cells are
+// `cell.width` x `cell.height` pixels.
+void pixelate_in_place(cv::Mat& roi, cv::Size cell) {
+    const int small_w = std::max(1, roi.cols / std::max(1, cell.width));
+    const int small_h = std::max(1, roi.rows / std::max(1, cell.height));
+    cv::Mat small;
+    cv::resize(roi, small, cv::Size(small_w, small_h), 0, 0, cv::INTER_LINEAR);
+
+    // Each cell covers the output columns [cell_x[i], cell_x[i + 1]).
+    const double ifx = 1.0 / (static_cast<double>(roi.cols) / small_w);
+    const double ify = 1.0 / (static_cast<double>(roi.rows) / small_h);
+    std::vector<int> cell_x(small_w + 1, roi.cols);
+    for (int x = roi.cols - 1; x >= 0; --x) {
+        cell_x[std::min(cvFloor(x * ifx), small_w - 1)] = x;
+    }
+    const size_t pixel = roi.elemSize();
+    const size_t row_bytes = roi.cols * pixel;
+
+    auto fill_rows = [&](const cv::Range& rows) {
+        int built_for = -1;  // cell row the previous output row was built from
+        for (int y = rows.start; y < rows.end; ++y) {
+            const int cy = std::min(cvFloor(y * ify), small_h - 1);
+            uchar* out = roi.ptr<uchar>(y);
+            if (cy == built_for) {
+                std::memcpy(out, roi.ptr<uchar>(y - 1), row_bytes);
+                continue;
+            }
+            const uchar* cells = small.ptr<uchar>(cy);
+            for (int cx = 0; cx < small_w; ++cx) {
+                fill_run(out + cell_x[cx] * pixel, cells + cx * pixel, cell_x[cx + 1] - cell_x[cx], pixel);
+            }
+            built_for = cy;
+        }
+    };
+
+    const int rows_per_strip = static_cast<int>(std::max<size_t>(1, kStripBytes / std::max<size_t>(1, row_bytes)));
+    const int strips = (roi.rows + rows_per_strip - 1) / rows_per_strip;
+    if (strips <= 1) {
+        fill_rows(cv::Range(0, roi.rows));
+        return;
+    }
+    cv::parallel_for_(cv::Range(0, strips), [&](const cv::Range& range) {
+        fill_rows(cv::Range(range.start * rows_per_strip, std::min(roi.rows, range.end * rows_per_strip)));
+    });
+}
+
+}  // namespace
+
+cv::Rect clamp_rect(const cv::Rect& r, int width, int height) {
+    int x1 = std::max(0, r.x);
+    int y1 = std::max(0, r.y);
+    int x2 = std::min(width, r.x + r.width);
+    int y2 = std::min(height, r.y + r.height);
+    return cv::Rect(x1, y1, std::max(0, x2 - x1), std::max(0, y2 - y1));
+}
+
+cv::Rect expand_rect(const cv::Rect& r, float pad_ratio, int width, int height) {
+    int pad_w = static_cast<int>(r.width * pad_ratio);
+    int pad_h = static_cast<int>(r.height * pad_ratio);
+    cv::Rect expanded(r.x - pad_w, r.y - pad_h, r.width + 2 * pad_w, r.height + 2 * pad_h);
+    return clamp_rect(expanded, width, height);
+}
+
+cv::Mat pixelate_roi(const cv::Mat& roi, int block_size) {
+    if (roi.empty()) {
+        return roi;
+    }
+    block_size = std::max(2, block_size);
+    int small_w = std::max(1, roi.cols / block_size);
+    int small_h = std::max(1, roi.rows / block_size);
+
+    cv::Mat small;
+    cv::resize(roi, small, cv::Size(small_w, small_h), 0, 0, cv::INTER_LINEAR);
+
+    cv::Mat pixelated;
+    cv::resize(small, pixelated, roi.size(), 0, 0, cv::INTER_NEAREST);
+    return pixelated;
+}
+
+cv::Mat blur_roi(const cv::Mat& roi, int block_size) {
+    if (roi.empty()) {
+        return roi;
+    }
+    // Sigma of half a block removes roughly the same detail as the mosaic.
+    double sigma = std::max(1.0, block_size / 2.0);
+    cv::Mat blurred;
+    cv::GaussianBlur(roi, blurred, cv::Size(0, 0), sigma, sigma, cv::BORDER_REPLICATE);
+    return blurred;
+}
+
+void pixelate_boxes(cv::Mat& frame, const std::vector<cv::Rect>& boxes, int block_size) {
+    mask_boxes(frame, boxes, MaskStyle::Pixelate, block_size);
+}
+
+void mask_boxes(cv::Mat& frame, const std::vector<cv::Rect>& boxes, MaskStyle style, int block_size) {
+    block_size = std::max(2, block_size);
+    mask_boxes(frame, boxes, style, cv::Size(block_size, block_size));
+}
+
+void mask_boxes(cv::Mat& frame, const std::vector<cv::Rect>& boxes, MaskStyle style, cv::Size cell) {
+    for (const auto& box : boxes) {
+        cv::Rect clamped = clamp_rect(box, frame.cols, frame.rows);
+        if (clamped.empty()) {
+            continue;
+        }
+        cv::Mat roi = frame(clamped);
+        if (style == MaskStyle::Blur) {
+            // Same sigma rule as blur_roi, per axis.
+            cv::Mat blurred;
+            cv::GaussianBlur(roi, blurred, cv::Size(0, 0), std::max(1.0, cell.width / 2.0),
+                             std::max(1.0, cell.height / 2.0), cv::BORDER_REPLICATE);
+            blurred.copyTo(roi);
+        } else {
+            pixelate_in_place(roi, cell);
+        }
+    }
+}
+
+std::vector<cv::Rect> scale_boxes(const std::vector<cv::Rect>& boxes, int sx, int sy) {
+    std::vector<cv::Rect> scaled;
+    scaled.reserve(boxes.size());
+    for (const auto& b : boxes) {
+        // Round outwards so the scaled box still covers the whole face.
+        int x1 = b.x / sx;
+        int y1 = b.y / sy;
+        int x2 = (b.x + b.width + sx - 1) / sx;
+        int y2 = (b.y + b.height + sy - 1) / sy;
+        scaled.emplace_back(x1, y1, x2 - x1, y2 - y1);
+    }
+    return scaled;
+}
+
+std::vector<cv::Rect> boxes_from_faces(const cv::Mat& faces, float pad_ratio, cv::Size frame_size) {
+    std::vector<cv::Rect> boxes;
+    // YuNet returns rows of floats. First 4 values are x, y, w, h.
+    for (int i = 0; i < faces.rows; ++i) {
+        const float* row = faces.ptr<float>(i);
+        cv::Rect box(
+            static_cast<int>(row[0]),
+            static_cast<int>(row[1]),
+            static_cast<int>(row[2]),
+            static_cast<int>(row[3]));
+        box = expand_rect(box, pad_ratio, frame_size.width, frame_size.height);
+        if (box.width > 0 && box.height > 0) {
+            boxes.push_back(box);
+        }
+    }
+    return boxes;
+}
+
+std::vector<cv::Rect> FaceTracker::update(const std::vector<cv::Rect>& detected) {
+    if (!detected.empty()) {
+        // Fresh detection: remember boxes and reset dropout counter.
+        last_boxes_ = detected;
+        missed_frames_ = 0;
+        return detected;
+    }
+    if (!last_boxes_.empty() && missed_frames_ < hold_frames_) {
+        // Detection dropped this frame: keep previous boxes temporarily.
+        missed_frames_++;
+        return last_boxes_;
+    }
+    // Too many misses: stop using stale boxes.
+    last_boxes_.clear();
+    return {};
+}
+
+cv::Ptr<cv::FaceDetectorYN> create_yunet(const AnonymizerConfig& cfg, cv::Size frame_size) {
+    try {
+        cv::Ptr<cv::FaceDetectorYN> detector;
+        if (cfg.engine == DetectorEngine::Builtin) {
+            auto model = engine_model(cfg.model_path);
+            if (!model) {
+                return {};
+            }
+            g_instances++;
+            return cv::makePtr<YuNetEngine>(model, frame_size, cfg.score_threshold, cfg.nms_threshold, cfg.top_k);
+        }
+#if CV_VERSION_MAJOR > 4 || (CV_VERSION_MAJOR == 4 && CV_VERSION_MINOR >= 8)
+        // Build from the cached bytes instead of reading and parsing the file again.
+        auto bytes = model_bytes(cfg.model_path);
+        if (!bytes) {
+            return {};
+        }
+        detector = cv::FaceDetectorYN::create(
+            "onnx", *bytes, std::vector<uchar>(), frame_size, cfg.score_threshold, cfg.nms_threshold, cfg.top_k);
+#else
+        detector = cv::FaceDetectorYN::create(
+            cfg.model_path, "", frame_size, cfg.score_threshold, cfg.nms_threshold, cfg.top_k);
+#endif
+        if (!detector.empty()) {
+            g_instances++;
+        }
+        return detector;
+    } catch (const cv::Exception&) {
+        return {};
+    }
+}
+
+ModelFootprint model_footprint(const AnonymizerConfig& cfg, cv::Size input_size) {
+    ModelFootprint f;
+    f.instances = g_instances;
+    auto bytes = model_bytes(cfg.model_path);
+    if (!bytes) {
+        return f;
+    }
+    f.model_bytes = bytes->size();
+    if (cfg.engine == DetectorEngine::Builtin) {
+        auto model = engine_model(cfg.model_path);
+        if (model) {
+            f.weights_bytes = yunet_weight_bytes(*model);
+            f.workspace_bytes = yunet_arena_bytes(*model, input_size);
+            f.shared_weights = true;
+        }
+        return f;
+    }
+    try {
+        // YuNet pads its input up to a multiple of 32.
+        int w = (input_size.width + 31) / 32 * 32;
+        int h = (input_size.height + 31) / 32 * 32;
+        cv::dnn::Net net = cv::dnn::readNetFromONNX(*bytes);
+        net.getMemoryConsumption(cv::dnn::MatShape{1, 3, h, w}, f.weights_bytes, f.workspace_bytes);
+    } catch (const cv::Exception&) {
+    }
+    return f;
+}
+
+std::vector<cv::Rect> YuNetDetector::detect(const cv::Mat& bgr) {
+    const cv::Mat* input = &bgr;
+    if (bgr.channels() == 4) {
+        // YuNet wants 3 channels; the buffer is reused from frame to frame.
+        cv::cvtColor(bgr, bgr_, cv::COLOR_BGRA2BGR);
+        input = &bgr_;
+    }
+    detector_->setInputSize(input->size());
+    cv::Mat faces;
+    detector_->detect(*input, faces);
+    return boxes_from_faces(faces, face_padding_, bgr.size());
+}
+
+FaceAnonymizer::FaceAnonymizer(const AnonymizerConfig& cfg, cv::Ptr<cv::FaceDetectorYN> detector)
+    : cfg_(cfg), detector_(std::move(detector), cfg.face_padding), tracker_(cfg.hold_frames) {}
+
+cv::Ptr<FaceAnonymizer> FaceAnonymizer::create(const AnonymizerConfig& cfg, cv::Size frame_size) {
+    cv::Ptr<cv::FaceDetectorYN> detector = create_yunet(cfg, frame_size);
+    if (detector.empty()) {
+        return {};
+    }
+    return cv::makePtr<FaceAnonymizer>(cfg, detector);
+}
+
+std::vector<cv::Rect> FaceAnonymizer::detect(const cv::Mat& bgr) {
+    return tracker_.update(detector_.detect(bgr));
+}
+
+std::vector<cv::Rect> FaceAnonymizer::process(cv::Mat& frame) {
+    std::vector<cv::Rect> boxes = detect(frame);
+    mask_boxes(frame, boxes, cfg_.mask_style, cfg_.pixel_block);
+    return boxes;
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/objdetect.hpp>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// How a face region is hidden.
+enum class MaskStyle {
+    Pixelate,
+    Blur,
+};
+
+// Which code runs YuNet.
+enum class DetectorEngine {
+    // cv::FaceDetectorYN on OpenCV's DNN module.
+    OpenCV,
+    // The network-specific engine in yunet_engine.hpp.
+    Builtin,
+};
+
+// Detection, hold and pixelation knobs shared by the app and the plugins.
+struct AnonymizerConfig {
+    // Path to YuNet ONNX model file.
+    std::string model_path = "face_detection_yunet_2023mar.onnx";
+    // OpenCV DNN (default) or the built-in engine.
+    DetectorEngine engine = DetectorEngine::OpenCV;
+    // Minimum confidence score for a detected face.
+    float score_threshold = 0.8f;
+    // Non-maximum suppression threshold for overlapping detections.
+    float nms_threshold = 0.3f;
+    // Candidate boxes before NMS. Keep high unless performance issues appear.
+    int top_k = 5000;
+    // Pixelation strength. Higher => larger blocks => stronger anonymization.
+    int pixel_block = 28;
+    // Pixelate (default) or Gaussian blur. Blur strength also follows pixel_block.
+    MaskStyle mask_style = MaskStyle::Pixelate;
+    // Expand face box on all sides. Helps hide face edges better.
+    float face_padding = 0.5f;
+    // Keep using previous face boxes for a few frames if detection drops briefly.
+    int hold_frames = 20;
+};
+
+// Ensure rectangle is inside frame boundaries.
+cv::Rect clamp_rect(const cv::Rect& r, int width, int height);
+
+// Expand a detected face rectangle for safer privacy masking.
+cv::Rect expand_rect(const cv::Rect& r, float pad_ratio, int width, int height);
+
+// Pixelate region by downscaling and scaling back with nearest-neighbor.
+// Works on 8-bit and 16-bit data with any channel count.
+cv::Mat pixelate_roi(const cv::Mat& roi, int block_size);
+
+// Gaussian blur sized so it hides detail similar to a `block_size` mosaic.
+cv::Mat blur_roi(const cv::Mat& roi, int block_size);
+
+// Pixelate every box of `frame` in place.
+void pixelate_boxes(cv::Mat& frame, const std::vector<cv::Rect>& boxes, int block_size);
+
+// Pixelate or blur every box of `frame` in place. Pixelation writes each
+// pixel once, and big boxes are split into strips that run on all threads.
+void mask_boxes(cv::Mat& frame, const std::vector<cv::Rect>& boxes, MaskStyle style, int block_size);
+
+// Same with separate cell width and height, for planes subsampled more in
+// one direction than the other (e.g. 4:2:2 chroma).
+void mask_boxes(cv::Mat& frame, const std::vector<cv::Rect>& boxes, MaskStyle style, cv::Size cell);
+
+// Scale full-resolution boxes down to a subsampled (e.g. chroma) plane.
+std::vector<cv::Rect> scale_boxes(const std::vector<cv::Rect>& boxes, int sx, int sy);
+
+// Turn YuNet output rows into padded, clamped boxes.
+std::vector<cv::Rect> boxes_from_faces(const cv::Mat& faces, float pad_ratio, cv::Size frame_size);
+
+// Keeps the last boxes alive for a few frames when the detector flickers.
+class FaceTracker {
+public:
+    explicit FaceTracker(int hold_frames) : hold_frames_(hold_frames) {}
+
+    // Feed this frame's detections, get the boxes that should be masked.
+    std::vector<cv::Rect> update(const std::vector<cv::Rect>& detected);
+
+    const std::vector<cv::Rect>& last_boxes() const { return last_boxes_; }
+    int missed_frames() const { return missed_frames_; }
+
+    // Put back state saved by an earlier run (see tracker_state.hpp).
+    void restore(const std::vector<cv::Rect>& boxes, int missed_frames) {
+        last_boxes_ = boxes;
+        missed_frames_ = missed_frames;
+    }
+
+private:
+    int hold_frames_;
+    std::vector<cv::Rect> last_boxes_;
+    int missed_frames_ = 0;
+};
+
+// Load YuNet with the config's thresholds. Returns an empty pointer on failure.
+// The model file is read once per process; later instances are built from the
+// cached bytes (OpenCV 4.8+), so only their own layers and workspace are new.
+// With the built-in engine the parsed weights themselves are shared too.
+cv::Ptr<cv::FaceDetectorYN> create_yunet(const AnonymizerConfig& cfg, cv::Size frame_size);
+
+// What YuNet instances cost. OpenCV gives every network its own copy of the
+// weights, so per instance that is weights + workspace, and the workspace
+// grows with the input size. The built-in engine shares one copy of the weights.
+struct ModelFootprint {
+    size_t model_bytes = 0;      // model file, loaded once
+    size_t weights_bytes = 0;    // per instance, or once if shared_weights
+    size_t workspace_bytes = 0;  // per instance, at the given input size
+    int instances = 0;           // created so far by create_yunet()
+    bool shared_weights = false;
+};
+ModelFootprint model_footprint(const AnonymizerConfig& cfg, cv::Size input_size);
+
+// YuNet wrapped as a detector stage: frame in, padded face boxes out.
+// Copies share the same underlying network.
+class YuNetDetector {
+public:
+    YuNetDetector(cv::Ptr<cv::FaceDetectorYN> detector, float face_padding)
+        : detector_(std::move(detector)), face_padding_(face_padding) {}
+
+    // Also takes BGRA (e.g. screen capture); the alpha channel is ignored.
+    std::vector<cv::Rect> detect(const cv::Mat& bgr);
+
+private:
+    cv::Ptr<cv::FaceDetectorYN> detector_;
+    float face_padding_;
+    cv::Mat bgr_;
+};
+
+// YuNet detector + tracker. One instance per stream.
+class FaceAnonymizer {
+public:
+    // Returns an empty pointer if the model cannot be loaded.
+    static cv::Ptr<FaceAnonymizer> create(const AnonymizerConfig& cfg, cv::Size frame_size);
+
+    // Detect on a BGR frame (or proxy) and return the boxes to mask.
+    std::vector<cv::Rect> detect(const cv::Mat& bgr);
+
+    // Detect, then pixelate the faces of a BGR frame in place.
+    std::vector<cv::Rect> process(cv::Mat& frame);
+
+    const AnonymizerConfig& config() const { return cfg_; }
+    FaceTracker& tracker() { return tracker_; }
+
+    FaceAnonymizer(const AnonymizerConfig& cfg, cv::Ptr<cv::FaceDetectorYN> detector);
+
+private:
+    AnonymizerConfig cfg_;
+    YuNetDetector detector_;
+    FaceTracker tracker_;
+};
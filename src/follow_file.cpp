@@ -0,0 +1,194 @@
+#include "follow_file.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// "out/masked_00001.avi" -> "out/masked_00001.part.avi"
+std::string part_name(const std::string& name) {
+    size_t dot = name.rfind('.');
+    size_t slash = name.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return name + ".part";
+    }
+    return name.substr(0, dot) + ".part" + name.substr(dot);
+}
+
+}  // namespace
+
+int fourcc_for(const std::string& name) {
+    size_t dot = name.rfind('.');
+    std::string ext = dot == std::string::npos ? "" : name.substr(dot);
+    if (ext == ".mp4" || ext == ".mov") {
+        return cv::VideoWriter::fourcc('m', 'p', '4', 'v');
+    }
+    // Motion JPEG is available in every OpenCV build.
+    return cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+}
+
+FollowSource::FollowSource(std::string path, DecoderOptions decoder, FollowConfig cfg)
+    : path_(std::move(path)),
+      decoder_(std::move(decoder)),
+      cfg_(std::move(cfg)),
+      cap_(std::make_unique<cv::VideoCapture>()),
+      stats_(std::make_shared<FollowStats>()),
+      last_change_(std::chrono::steady_clock::now()) {}
+
+bool FollowSource::open() {
+    last_change_ = std::chrono::steady_clock::now();
+    // The recorder may not have created the file (or written a header) yet.
+    while (!reopen()) {
+        if (!wait_for_change()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FollowSource::reopen() {
+    cap_->release();
+    std::error_code ec;
+    uintmax_t size = std::filesystem::file_size(path_, ec);
+    if (!ec) {
+        last_size_ = size;
+        last_mtime_ = std::filesystem::last_write_time(path_, ec).time_since_epoch().count();
+    }
+    if (!open_capture(*cap_, path_, 0, decoder_) || !cap_->isOpened()) {
+        return false;
+    }
+    frames_in_file_ = 0;
+    if (stats_->frames > 0) {
+        stats_->reopens++;
+        resuming_ = true;
+        // Jump close to where we stopped instead of decoding the whole file again.
+        // Seeks land on a keyframe at or before it; read() skips the frames already done.
+        if (has_timestamps_) {
+            cap_->set(cv::CAP_PROP_POS_MSEC, last_ms_);
+        } else if (cap_->set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(stats_->frames))) {
+            // No timestamps: seek by frame number and count on from where it landed.
+            frames_in_file_ = static_cast<uint64_t>(std::max(0.0, cap_->get(cv::CAP_PROP_POS_FRAMES)));
+        } else if (!warned_rescan_) {
+            warned_rescan_ = true;
+            std::cerr << "Warning: " << path_ << " has no timestamps and cannot seek by frame; every reopen "
+                      << "decodes it from the start, so following it gets slower as it grows" << std::endl;
+        }
+    }
+    return true;
+}
+
+bool FollowSource::wait_for_change() {
+    while (true) {
+        std::error_code ec;
+        uintmax_t size = std::filesystem::file_size(path_, ec);
+        long long mtime = ec ? 0 : std::filesystem::last_write_time(path_, ec).time_since_epoch().count();
+        auto now = std::chrono::steady_clock::now();
+        // A finalizing writer may rewrite the header without growing the file, so mtime counts too.
+        if (!ec && (size != last_size_ || mtime != last_mtime_)) {
+            last_size_ = size;
+            last_mtime_ = mtime;
+            last_change_ = now;
+            return true;
+        }
+        if (now - last_change_ >= std::chrono::milliseconds(cfg_.idle_timeout_ms)) {
+            return false;
+        }
+        if (on_idle_) {
+            on_idle_();
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(cfg_.poll_ms));
+    }
+}
+
+bool FollowSource::read(cv::Mat& frame) {
+    while (true) {
+        if (cap_->isOpened() && cap_->read(frame) && !frame.empty()) {
+            frames_in_file_++;
+            double ms = cap_->get(cv::CAP_PROP_POS_MSEC);
+            if (!resuming_ && has_timestamps_ && stats_->frames > 0 && ms <= last_ms_) {
+                // Time does not move forward while reading straight through: no usable timestamps.
+                has_timestamps_ = false;
+            }
+            bool seen = has_timestamps_ ? ms <= last_ms_ : frames_in_file_ <= stats_->frames;
+            if (resuming_ && seen) {
+                stats_->skipped++;
+                continue;
+            }
+            resuming_ = false;
+            last_ms_ = ms;
+            stats_->frames++;
+            return true;
+        }
+        // End of what is on disk so far: wait for the recorder, then pick up where we left off.
+        if (!wait_for_change()) {
+            return false;
+        }
+        reopen();
+    }
+}
+
+cv::Size FollowSource::frame_size() const {
+    return cv::Size(static_cast<int>(cap_->get(cv::CAP_PROP_FRAME_WIDTH)),
+                    static_cast<int>(cap_->get(cv::CAP_PROP_FRAME_HEIGHT)));
+}
+
+double FollowSource::fps() const {
+    double fps = cap_->get(cv::CAP_PROP_FPS);
+    return fps > 0.0 ? fps : 25.0;
+}
+
+SegmentWriter::SegmentWriter(FollowConfig cfg, double fps) : cfg_(std::move(cfg)), fps_(fps) {}
+
+SegmentWriter::~SegmentWriter() {
+    close();
+}
+
+bool SegmentWriter::write(const cv::Mat& frame) {
+    if (!writer_.isOpened()) {
+        std::vector<char> name(cfg_.segment_pattern.size() + 32);
+        std::snprintf(name.data(), name.size(), cfg_.segment_pattern.c_str(), index_ + 1);
+        final_name_ = name.data();
+        part_name_ = part_name(final_name_);
+        if (!writer_.open(part_name_, fourcc_for(final_name_), fps_, frame.size())) {
+            std::cerr << "Failed to open segment " << part_name_ << std::endl;
+            return false;
+        }
+        index_++;
+        frames_in_segment_ = 0;
+        opened_ = std::chrono::steady_clock::now();
+    }
+    writer_.write(frame);
+    frames_in_segment_++;
+    if (frames_in_segment_ >= fps_ * cfg_.segment_seconds) {
+        close();
+    } else {
+        close_if_due();
+    }
+    return true;
+}
+
+void SegmentWriter::close_if_due() {
+    if (writer_.isOpened() &&
+        std::chrono::steady_clock::now() - opened_ >= std::chrono::duration<double>(cfg_.segment_seconds)) {
+        close();
+    }
+}
+
+void SegmentWriter::close() {
+    if (!writer_.isOpened()) {
+        return;
+    }
+    writer_.release();
+    if (std::rename(part_name_.c_str(), final_name_.c_str()) != 0) {
+        std::cerr << "Failed to rename " << part_name_ << " to " << final_name_ << std::endl;
+        return;
+    }
+    double lag = std::chrono::duration<double>(std::chrono::steady_clock::now() - opened_).count();
+    max_lag_ = std::max(max_lag_, lag);
+    std::cout << "segment " << final_name_ << ": " << frames_in_segment_ << " frames, published " << lag
+              << " s after its first frame" << std::endl;
+}
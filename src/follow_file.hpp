@@ -0,0 +1,127 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "decode_ahead.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Follow mode: process a recording while the recorder is still writing it,
+// like `tail -f`, and publish the masked result as short closed segments.
+struct FollowConfig {
+    // printf-style output name with one integer, e.g. "masked_%05d.mkv".
+    std::string segment_pattern = "masked_%05d.avi";
+    // A segment is closed after this much video, or after this long on the wall
+    // clock since its first frame, whichever comes first. This bounds the lag.
+    double segment_seconds = 10.0;
+    // How often to look at the file when there is nothing new to read.
+    int poll_ms = 500;
+    // The recording counts as finished when the file has not changed for this long.
+    int idle_timeout_ms = 15000;
+};
+
+struct FollowStats {
+    uint64_t frames = 0;
+    // Times the file was reopened after it grew.
+    uint64_t reopens = 0;
+    // Frames seen again after a reopen and skipped.
+    uint64_t skipped = 0;
+};
+
+// Source stage that reads a growing file. At the end of the data written so far
+// it waits for the file to change, reopens it and continues after the last frame
+// it delivered (found by timestamp, so rewritten headers on close are fine).
+// read() returns false once the file stops changing for `idle_timeout_ms`.
+class FollowSource {
+public:
+    FollowSource(std::string path, DecoderOptions decoder, FollowConfig cfg);
+
+    // Wait until the file exists and can be opened. False on timeout.
+    bool open();
+    bool read(cv::Mat& frame);
+
+    cv::Size frame_size() const;
+    double fps() const;
+    // Stays valid after the source is moved into a pipeline.
+    std::shared_ptr<const FollowStats> stats() const { return stats_; }
+
+    // Called while waiting for more data, e.g. to close a segment that is due.
+    void set_idle_callback(std::function<void()> cb) { on_idle_ = std::move(cb); }
+
+private:
+    bool reopen();
+    bool wait_for_change();
+
+    std::string path_;
+    DecoderOptions decoder_;
+    FollowConfig cfg_;
+    // Behind a pointer so the source can be moved into a pipeline.
+    std::unique_ptr<cv::VideoCapture> cap_;
+    std::function<void()> on_idle_;
+    std::shared_ptr<FollowStats> stats_;
+
+    // Timestamp of the last delivered frame (-1 = none yet).
+    double last_ms_ = -1.0;
+    // True right after a reopen, until the first new frame shows up.
+    bool resuming_ = false;
+    // Frame counting is used instead when the backend reports no timestamps.
+    bool has_timestamps_ = true;
+    uint64_t frames_in_file_ = 0;
+    // The "decodes from the start on every reopen" warning was printed.
+    bool warned_rescan_ = false;
+
+    uintmax_t last_size_ = 0;
+    long long last_mtime_ = 0;
+    std::chrono::steady_clock::time_point last_change_;
+};
+
+// Codec for an output name: mp4v for .mp4/.mov, Motion JPEG otherwise.
+int fourcc_for(const std::string& name);
+
+// Writes masked frames into numbered segment files. A segment is written under a
+// ".part" name and renamed when closed, so anything watching the output folder
+// only ever sees complete files.
+class SegmentWriter {
+public:
+    SegmentWriter(FollowConfig cfg, double fps);
+    ~SegmentWriter();
+    SegmentWriter(const SegmentWriter&) = delete;
+    SegmentWriter& operator=(const SegmentWriter&) = delete;
+
+    bool write(const cv::Mat& frame);
+    // Close the open segment if it is older than `segment_seconds` of wall time.
+    void close_if_due();
+    void close();
+
+    int segments() const { return index_; }
+    // Longest time a frame waited in an open segment before it was published.
+    double max_lag_seconds() const { return max_lag_; }
+
+private:
+    FollowConfig cfg_;
+    double fps_;
+    cv::VideoWriter writer_;
+    std::string final_name_;
+    std::string part_name_;
+    int index_ = 0;
+    int frames_in_segment_ = 0;
+    std::chrono::steady_clock::time_point opened_;
+    double max_lag_ = 0.0;
+};
+
+// Sink stage around a shared SegmentWriter.
+class SegmentSink {
+public:
+    explicit SegmentSink(std::shared_ptr<SegmentWriter> writer) : writer_(std::move(writer)) {}
+    bool write(cv::Mat& frame, const std::vector<cv::Rect>&) { return writer_->write(frame); }
+
+private:
+    std::shared_ptr<SegmentWriter> writer_;
+};
@@ -0,0 +1,223 @@
+#include "frame_atlas.hpp"
+
+#include "follow_file.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+
+AtlasLayout::AtlasLayout(int cells, cv::Size cell, int guard)
+    : cells_(std::max(1, cells)), cell_(cell), guard_(std::max(0, guard)) {
+    columns_ = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(cells_))));
+    const int rows = (cells_ + columns_ - 1) / columns_;
+    canvas_ = cv::Size(columns_ * (cell_.width + guard_) - guard_, rows * (cell_.height + guard_) - guard_);
+}
+
+cv::Rect AtlasLayout::cell_rect(int index) const {
+    const int column = index % columns_;
+    const int row = index / columns_;
+    return cv::Rect(column * (cell_.width + guard_), row * (cell_.height + guard_), cell_.width, cell_.height);
+}
+
+int AtlasLayout::owner(const cv::Rect& box) const {
+    int best = -1;
+    int best_area = 0;
+    for (int i = 0; i < cells_; ++i) {
+        const int area = (box & cell_rect(i)).area();
+        if (area > best_area) {
+            best_area = area;
+            best = i;
+        }
+    }
+    return best;
+}
+
+namespace {
+
+// Guard borders and empty cells. Flat gray holds no faces.
+const cv::Scalar kGuardColor = cv::Scalar::all(127);
+
+struct AtlasStream {
+    std::string input;
+    cv::VideoCapture cap;
+    FaceTracker tracker;
+    std::string output;
+    double fps = 25.0;
+    std::unique_ptr<cv::VideoWriter> writer = std::make_unique<cv::VideoWriter>();
+    bool live = false;
+    cv::Mat frame;
+    // Stream pixels per proxy pixel (1 when the frame fits the cell).
+    double scale = 1.0;
+    // Where this stream's cell is: canvas index and the cell inside it.
+    int canvas = 0;
+    cv::Rect cell;
+    // Boxes routed back from this round's detection, in stream coordinates.
+    std::vector<cv::Rect> detected;
+    long frames = 0;
+
+    explicit AtlasStream(int hold_frames) : tracker(hold_frames) {}
+};
+
+// Read the next frame of `s` and put its proxy into the cell.
+void fill_cell(AtlasStream& s, cv::Mat& canvas) {
+    cv::Mat cell = canvas(s.cell);
+    if (s.live && (!s.cap.read(s.frame) || s.frame.empty())) {
+        s.live = false;
+    }
+    if (!s.live) {
+        cell.setTo(kGuardColor);
+        return;
+    }
+    s.scale = std::max({1.0, s.frame.cols / static_cast<double>(s.cell.width),
+                        s.frame.rows / static_cast<double>(s.cell.height)});
+    cv::Size proxy_size(std::min(s.cell.width, static_cast<int>(s.frame.cols / s.scale)),
+                        std::min(s.cell.height, static_cast<int>(s.frame.rows / s.scale)));
+    if (proxy_size != s.cell.size()) {
+        cell.setTo(kGuardColor);
+    }
+    cv::Mat proxy = cell(cv::Rect(cv::Point(0, 0), proxy_size));
+    if (s.scale > 1.0) {
+        cv::resize(s.frame, proxy, proxy_size, 0, 0, cv::INTER_AREA);
+    } else {
+        s.frame.copyTo(proxy);
+    }
+}
+
+}  // namespace
+
+int run_atlas(const AnonymizerConfig& anon, const AtlasConfig& cfg, const std::vector<std::string>& inputs,
+              const AtlasOpen& open_input) {
+    const AtlasLayout layout(std::min<int>(cfg.cells_per_canvas, static_cast<int>(inputs.size())), cfg.cell, cfg.guard);
+    const int canvas_count = (static_cast<int>(inputs.size()) + layout.cells() - 1) / layout.cells();
+
+    std::vector<AtlasStream> streams;
+    streams.reserve(inputs.size());
+    int failed = 0;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        streams.emplace_back(anon.hold_frames);
+        AtlasStream& s = streams.back();
+        s.input = inputs[i];
+        s.canvas = static_cast<int>(i) / layout.cells();
+        s.cell = layout.cell_rect(static_cast<int>(i) % layout.cells());
+        s.live = open_input(s.cap, s.input);
+        if (!s.live) {
+            std::cerr << "atlas: failed to open " << s.input << std::endl;
+            failed++;
+            continue;
+        }
+        double fps = s.cap.get(cv::CAP_PROP_FPS);
+        s.fps = fps > 0.0 ? fps : 25.0;
+        if (!cfg.output_pattern.empty()) {
+            char name[1024];
+            std::snprintf(name, sizeof(name), cfg.output_pattern.c_str(), static_cast<int>(i));
+            s.output = name;
+        }
+    }
+
+    // Every canvas has the same layout, so one detector at one input size serves them all.
+    cv::Ptr<cv::FaceDetectorYN> net = create_yunet(anon, layout.canvas_size());
+    if (net.empty()) {
+        std::cerr << "Failed to create YuNet detector. Check model path: " << anon.model_path << std::endl;
+        return 1;
+    }
+    std::vector<cv::Mat> canvases(canvas_count);
+    for (cv::Mat& canvas : canvases) {
+        canvas.create(layout.canvas_size(), CV_8UC3);
+        canvas.setTo(kGuardColor);
+    }
+    std::cout << "atlas: " << inputs.size() << " streams in " << canvas_count << " canvases of "
+              << layout.canvas_size().width << "x" << layout.canvas_size().height << " (" << layout.cells()
+              << " cells of " << cfg.cell.width << "x" << cfg.cell.height << ", guard " << cfg.guard << " px)"
+              << std::endl;
+
+    auto start = std::chrono::steady_clock::now();
+    double detect_ms = 0.0;
+    long detect_calls = 0;
+    long rounds = 0;
+    cv::Mat faces;
+    while (std::any_of(streams.begin(), streams.end(), [](const AtlasStream& s) { return s.live; })) {
+        // 1) Decode every stream and lay out the proxies. Streams decode independently.
+        cv::parallel_for_(cv::Range(0, static_cast<int>(streams.size())), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; ++i) {
+                fill_cell(streams[i], canvases[streams[i].canvas]);
+                streams[i].detected.clear();
+            }
+        });
+
+        // 2) One detection per canvas; each face goes back to the cell it overlaps most.
+        for (int c = 0; c < canvas_count; ++c) {
+            const bool canvas_live = std::any_of(streams.begin(), streams.end(), [c](const AtlasStream& s) {
+                return s.live && s.canvas == c;
+            });
+            if (!canvas_live) {
+                continue;
+            }
+            auto t0 = std::chrono::steady_clock::now();
+            net->detect(canvases[c], faces);
+            detect_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            detect_calls++;
+            for (int f = 0; f < faces.rows; ++f) {
+                const float* row = faces.ptr<float>(f);
+                cv::Rect box(static_cast<int>(row[0]), static_cast<int>(row[1]), static_cast<int>(row[2]),
+                             static_cast<int>(row[3]));
+                const int cell = layout.owner(box);
+                if (cell < 0) {
+                    continue;
+                }
+                const size_t index = static_cast<size_t>(c) * layout.cells() + cell;
+                if (index >= streams.size() || !streams[index].live) {
+                    continue;
+                }
+                AtlasStream& s = streams[index];
+                // Cell coordinates -> stream coordinates, then the usual padding.
+                cv::Rect in_stream(static_cast<int>((box.x - s.cell.x) * s.scale),
+                                   static_cast<int>((box.y - s.cell.y) * s.scale),
+                                   static_cast<int>(std::ceil(box.width * s.scale)),
+                                   static_cast<int>(std::ceil(box.height * s.scale)));
+                in_stream = expand_rect(in_stream, anon.face_padding, s.frame.cols, s.frame.rows);
+                if (!in_stream.empty()) {
+                    s.detected.push_back(in_stream);
+                }
+            }
+        }
+
+        // 3) Track, mask and write each stream.
+        cv::parallel_for_(cv::Range(0, static_cast<int>(streams.size())), [&](const cv::Range& range) {
+            for (int i = range.start; i < range.end; ++i) {
+                AtlasStream& s = streams[i];
+                if (!s.live) {
+                    continue;
+                }
+                mask_boxes(s.frame, s.tracker.update(s.detected), anon.mask_style, anon.pixel_block);
+                if (!s.output.empty()) {
+                    if (!s.writer->isOpened() &&
+                        !s.writer->open(s.output, fourcc_for(s.output), s.fps, s.frame.size())) {
+                        std::cerr << "atlas: failed to open output " << s.output << std::endl;
+                        s.output.clear();
+                    } else {
+                        s.writer->write(s.frame);
+                    }
+                }
+                s.frames++;
+            }
+        });
+        rounds++;
+    }
+
+    long frames = 0;
+    for (AtlasStream& s : streams) {
+        s.writer->release();
+        frames += s.frames;
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "atlas: " << frames << " stream frames in " << rounds << " rounds, " << seconds << " s ("
+              << (seconds > 0.0 ? frames / seconds : 0.0) << " frames/s); " << detect_calls << " detect calls, avg "
+              << (detect_calls ? detect_ms / detect_calls : 0.0) << " ms per canvas, "
+              << (frames ? detect_ms / frames : 0.0) << " ms per stream frame" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
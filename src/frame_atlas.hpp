@@ -0,0 +1,60 @@
+#pragma once
+
+#include "face_anonymizer.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Atlas mode: many small streams, one detection per group of streams.
+//
+// For a 320x240 stream a YuNet detect() call costs mostly fixed overhead
+// (setting up layers, threads and the output), not arithmetic. Atlas mode
+// copies the frames (proxies) of up to `cells_per_canvas` streams into the
+// cells of one bigger canvas, separated by gray guard borders so a face never
+// continues into the next cell, and runs one detection on the whole canvas.
+// Each box then goes back to the stream whose cell it overlaps most, in that
+// stream's own coordinates, and every stream is tracked, masked and written
+// on its own as usual.
+struct AtlasConfig {
+    // Text file with one input (file, URL or camera index) per line, as for --prefork.
+    std::string inputs_file;
+    // printf-style output name with the stream number (empty = no output).
+    std::string output_pattern = "masked_%03d.avi";
+    // Size of one cell. Larger frames are scaled down to fit (the proxy);
+    // smaller ones sit in the top-left corner.
+    cv::Size cell = cv::Size(320, 240);
+    // Streams per canvas, i.e. per detect() call.
+    int cells_per_canvas = 16;
+    // Gray border between cells, in pixels.
+    int guard = 16;
+};
+
+// Where each cell sits in a canvas: a grid of cells, close to square.
+class AtlasLayout {
+public:
+    AtlasLayout(int cells, cv::Size cell, int guard);
+
+    int cells() const { return cells_; }
+    cv::Size canvas_size() const { return canvas_; }
+    cv::Rect cell_rect(int index) const;
+    // Cell a canvas box overlaps most, or -1 if it lies only on guard borders.
+    int owner(const cv::Rect& box) const;
+
+private:
+    int cells_;
+    int columns_;
+    cv::Size cell_;
+    int guard_;
+    cv::Size canvas_;
+};
+
+// Opens one input of the list. Returns false if it cannot be opened.
+using AtlasOpen = std::function<bool(cv::VideoCapture& cap, const std::string& input)>;
+
+// Run all inputs until every one has ended. Returns 0 if all of them opened.
+int run_atlas(const AnonymizerConfig& anon, const AtlasConfig& cfg, const std::vector<std::string>& inputs,
+              const AtlasOpen& open_input);
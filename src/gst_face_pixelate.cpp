@@ -0,0 +1,331 @@
+// GStreamer video filter that detects, holds and pixelates faces in place.
+//
+// Example:
+//   GST_PLUGIN_PATH=build gst-launch-1.0 videotestsrc ! video/x-raw,format=I420
+//       ! facepixelate model=face_detection_yunet_2023mar.onnx ! autovideosink
+// (one command line)
+
+#include <gst/gst.h>
+#include <gst/video/gstvideofilter.h>
+#include <gst/video/video.h>
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include "face_anonymizer.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+GST_DEBUG_CATEGORY_STATIC(gst_face_pixelate_debug);
+#define GST_CAT_DEFAULT gst_face_pixelate_debug
+
+G_BEGIN_DECLS
+#define GST_TYPE_FACE_PIXELATE (gst_face_pixelate_get_type())
+G_DECLARE_FINAL_TYPE(GstFacePixelate, gst_face_pixelate, GST, FACE_PIXELATE, GstVideoFilter)
+G_END_DECLS
+
+// Per-element processing latency, measured around transform_frame_ip.
+struct LatencyStats {
+    guint64 frames = 0;
+    gint64 total_us = 0;
+    gint64 max_us = 0;
+    gint64 last_us = 0;
+};
+
+struct _GstFacePixelate {
+    GstVideoFilter parent;
+
+    // Settings are plain C++ objects, so they live behind pointers.
+    AnonymizerConfig* cfg;
+    cv::Ptr<FaceAnonymizer>* anonymizer;
+    // BGR frame handed to YuNet for YUV and 4-channel formats.
+    cv::Mat* proxy;
+    LatencyStats stats;
+    std::mutex* lock;
+};
+
+G_DEFINE_TYPE(GstFacePixelate, gst_face_pixelate, GST_TYPE_VIDEO_FILTER)
+
+enum {
+    PROP_0,
+    PROP_MODEL,
+    PROP_SCORE_THRESHOLD,
+    PROP_NMS_THRESHOLD,
+    PROP_TOP_K,
+    PROP_PIXEL_BLOCK,
+    PROP_FACE_PADDING,
+    PROP_HOLD_FRAMES,
+    PROP_STATS,
+};
+
+#define VIDEO_CAPS GST_VIDEO_CAPS_MAKE("{ BGR, BGRx, BGRA, I420, NV12 }")
+
+static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE(
+    "sink", GST_PAD_SINK, GST_PAD_ALWAYS, GST_STATIC_CAPS(VIDEO_CAPS));
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE(
+    "src", GST_PAD_SRC, GST_PAD_ALWAYS, GST_STATIC_CAPS(VIDEO_CAPS));
+
+// Wrap one plane of a mapped frame as a cv::Mat. No pixels are copied.
+static cv::Mat plane_mat(GstVideoFrame* frame, guint plane, int cv_type) {
+    return cv::Mat(
+        GST_VIDEO_FRAME_COMP_HEIGHT(frame, plane),
+        GST_VIDEO_FRAME_COMP_WIDTH(frame, plane),
+        cv_type,
+        GST_VIDEO_FRAME_PLANE_DATA(frame, plane),
+        GST_VIDEO_FRAME_PLANE_STRIDE(frame, plane));
+}
+
+static gboolean gst_face_pixelate_set_info(
+    GstVideoFilter* filter, GstCaps*, GstVideoInfo* in_info, GstCaps*, GstVideoInfo*) {
+    GstFacePixelate* self = GST_FACE_PIXELATE(filter);
+    std::lock_guard<std::mutex> guard(*self->lock);
+
+    cv::Size size(GST_VIDEO_INFO_WIDTH(in_info), GST_VIDEO_INFO_HEIGHT(in_info));
+    *self->anonymizer = FaceAnonymizer::create(*self->cfg, size);
+    if (self->anonymizer->empty()) {
+        GST_ELEMENT_ERROR(self, RESOURCE, NOT_FOUND,
+            ("Failed to create YuNet detector"), ("model: %s", self->cfg->model_path.c_str()));
+        return FALSE;
+    }
+    self->stats = LatencyStats();
+    GST_INFO_OBJECT(self, "configured for %s %dx%d",
+        GST_VIDEO_INFO_NAME(in_info), size.width, size.height);
+    return TRUE;
+}
+
+static GstFlowReturn gst_face_pixelate_transform_frame_ip(GstVideoFilter* filter, GstVideoFrame* frame) {
+    GstFacePixelate* self = GST_FACE_PIXELATE(filter);
+    std::lock_guard<std::mutex> guard(*self->lock);
+    if (self->anonymizer->empty()) {
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+    FaceAnonymizer& anonymizer = **self->anonymizer;
+    const int block = self->cfg->pixel_block;
+    const MaskStyle style = self->cfg->mask_style;
+    gint64 start_us = g_get_monotonic_time();
+
+    switch (GST_VIDEO_FRAME_FORMAT(frame)) {
+    case GST_VIDEO_FORMAT_BGR: {
+        // Packed BGR is what YuNet expects: detect and mask directly on the buffer.
+        cv::Mat bgr = plane_mat(frame, 0, CV_8UC3);
+        mask_boxes(bgr, anonymizer.detect(bgr), style, block);
+        break;
+    }
+    case GST_VIDEO_FORMAT_BGRx:
+    case GST_VIDEO_FORMAT_BGRA: {
+        cv::Mat bgra = plane_mat(frame, 0, CV_8UC4);
+        cv::cvtColor(bgra, *self->proxy, cv::COLOR_BGRA2BGR);
+        mask_boxes(bgra, anonymizer.detect(*self->proxy), style, block);
+        break;
+    }
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_NV12: {
+        // Detect on luma only; skipping chroma keeps the proxy to one cheap pass.
+        cv::Mat y = plane_mat(frame, 0, CV_8UC1);
+        cv::cvtColor(y, *self->proxy, cv::COLOR_GRAY2BGR);
+        std::vector<cv::Rect> boxes = anonymizer.detect(*self->proxy);
+        mask_boxes(y, boxes, style, block);
+
+        // Chroma is 2x2 subsampled, so halve boxes and block size to stay aligned with luma.
+        std::vector<cv::Rect> chroma_boxes = scale_boxes(boxes, 2, 2);
+        if (GST_VIDEO_FRAME_FORMAT(frame) == GST_VIDEO_FORMAT_NV12) {
+            cv::Mat uv = plane_mat(frame, 1, CV_8UC2);
+            mask_boxes(uv, chroma_boxes, style, block / 2);
+        } else {
+            cv::Mat u = plane_mat(frame, 1, CV_8UC1);
+            cv::Mat v = plane_mat(frame, 2, CV_8UC1);
+            mask_boxes(u, chroma_boxes, style, block / 2);
+            mask_boxes(v, chroma_boxes, style, block / 2);
+        }
+        break;
+    }
+    default:
+        return GST_FLOW_NOT_NEGOTIATED;
+    }
+
+    gint64 elapsed_us = g_get_monotonic_time() - start_us;
+    self->stats.frames++;
+    self->stats.total_us += elapsed_us;
+    self->stats.last_us = elapsed_us;
+    self->stats.max_us = std::max(self->stats.max_us, elapsed_us);
+    return GST_FLOW_OK;
+}
+
+static GstStructure* gst_face_pixelate_stats_structure(GstFacePixelate* self) {
+    const LatencyStats& s = self->stats;
+    gint64 avg_us = s.frames ? s.total_us / static_cast<gint64>(s.frames) : 0;
+    return gst_structure_new("facepixelate-stats",
+        "frames", G_TYPE_UINT64, s.frames,
+        "avg-us", G_TYPE_INT64, avg_us,
+        "max-us", G_TYPE_INT64, s.max_us,
+        "last-us", G_TYPE_INT64, s.last_us,
+        nullptr);
+}
+
+static gboolean gst_face_pixelate_stop(GstBaseTransform* trans) {
+    GstFacePixelate* self = GST_FACE_PIXELATE(trans);
+    std::lock_guard<std::mutex> guard(*self->lock);
+    const LatencyStats& s = self->stats;
+    if (s.frames > 0) {
+        GST_INFO_OBJECT(self, "frames=%" G_GUINT64_FORMAT " avg=%" G_GINT64_FORMAT "us max=%" G_GINT64_FORMAT "us",
+            s.frames, s.total_us / static_cast<gint64>(s.frames), s.max_us);
+    }
+    self->anonymizer->reset();
+    return TRUE;
+}
+
+static void gst_face_pixelate_set_property(GObject* object, guint prop_id, const GValue* value, GParamSpec* pspec) {
+    GstFacePixelate* self = GST_FACE_PIXELATE(object);
+    std::lock_guard<std::mutex> guard(*self->lock);
+    AnonymizerConfig& cfg = *self->cfg;
+
+    // Detector settings take effect on the next caps negotiation.
+    switch (prop_id) {
+    case PROP_MODEL:
+        cfg.model_path = g_value_get_string(value) ? g_value_get_string(value) : "";
+        break;
+    case PROP_SCORE_THRESHOLD:
+        cfg.score_threshold = g_value_get_float(value);
+        break;
+    case PROP_NMS_THRESHOLD:
+        cfg.nms_threshold = g_value_get_float(value);
+        break;
+    case PROP_TOP_K:
+        cfg.top_k = g_value_get_int(value);
+        break;
+    case PROP_PIXEL_BLOCK:
+        cfg.pixel_block = g_value_get_int(value);
+        break;
+    case PROP_FACE_PADDING:
+        cfg.face_padding = g_value_get_float(value);
+        break;
+    case PROP_HOLD_FRAMES:
+        cfg.hold_frames = g_value_get_int(value);
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void gst_face_pixelate_get_property(GObject* object, guint prop_id, GValue* value, GParamSpec* pspec) {
+    GstFacePixelate* self = GST_FACE_PIXELATE(object);
+    std::lock_guard<std::mutex> guard(*self->lock);
+    const AnonymizerConfig& cfg = *self->cfg;
+
+    switch (prop_id) {
+    case PROP_MODEL:
+        g_value_set_string(value, cfg.model_path.c_str());
+        break;
+    case PROP_SCORE_THRESHOLD:
+        g_value_set_float(value, cfg.score_threshold);
+        break;
+    case PROP_NMS_THRESHOLD:
+        g_value_set_float(value, cfg.nms_threshold);
+        break;
+    case PROP_TOP_K:
+        g_value_set_int(value, cfg.top_k);
+        break;
+    case PROP_PIXEL_BLOCK:
+        g_value_set_int(value, cfg.pixel_block);
+        break;
+    case PROP_FACE_PADDING:
+        g_value_set_float(value, cfg.face_padding);
+        break;
+    case PROP_HOLD_FRAMES:
+        g_value_set_int(value, cfg.hold_frames);
+        break;
+    case PROP_STATS:
+        g_value_take_boxed(value, gst_face_pixelate_stats_structure(self));
+        break;
+    default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID(object, prop_id, pspec);
+        break;
+    }
+}
+
+static void gst_face_pixelate_finalize(GObject* object) {
+    GstFacePixelate* self = GST_FACE_PIXELATE(object);
+    delete self->cfg;
+    delete self->anonymizer;
+    delete self->proxy;
+    delete self->lock;
+    G_OBJECT_CLASS(gst_face_pixelate_parent_class)->finalize(object);
+}
+
+static void gst_face_pixelate_init(GstFacePixelate* self) {
+    self->cfg = new AnonymizerConfig();
+    self->anonymizer = new cv::Ptr<FaceAnonymizer>();
+    self->proxy = new cv::Mat();
+    self->stats = LatencyStats();
+    self->lock = new std::mutex();
+    // Masking always writes into the incoming buffer.
+    gst_base_transform_set_in_place(GST_BASE_TRANSFORM(self), TRUE);
+}
+
+static void gst_face_pixelate_class_init(GstFacePixelateClass* klass) {
+    GObjectClass* gobject_class = G_OBJECT_CLASS(klass);
+    GstElementClass* element_class = GST_ELEMENT_CLASS(klass);
+    GstBaseTransformClass* transform_class = GST_BASE_TRANSFORM_CLASS(klass);
+    GstVideoFilterClass* filter_class = GST_VIDEO_FILTER_CLASS(klass);
+    const AnonymizerConfig defaults;
+    const GParamFlags rw = static_cast<GParamFlags>(G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
+    gobject_class->set_property = gst_face_pixelate_set_property;
+    gobject_class->get_property = gst_face_pixelate_get_property;
+    gobject_class->finalize = gst_face_pixelate_finalize;
+
+    g_object_class_install_property(gobject_class, PROP_MODEL,
+        g_param_spec_string("model", "Model", "YuNet ONNX model path",
+            defaults.model_path.c_str(), rw));
+    g_object_class_install_property(gobject_class, PROP_SCORE_THRESHOLD,
+        g_param_spec_float("score-threshold", "Score threshold", "Detector score threshold",
+            0.0f, 1.0f, defaults.score_threshold, rw));
+    g_object_class_install_property(gobject_class, PROP_NMS_THRESHOLD,
+        g_param_spec_float("nms-threshold", "NMS threshold", "Overlap filtering threshold",
+            0.0f, 1.0f, defaults.nms_threshold, rw));
+    g_object_class_install_property(gobject_class, PROP_TOP_K,
+        g_param_spec_int("top-k", "Top-K", "Candidate boxes before NMS",
+            1, G_MAXINT, defaults.top_k, rw));
+    g_object_class_install_property(gobject_class, PROP_PIXEL_BLOCK,
+        g_param_spec_int("pixel-block", "Pixel block", "Pixelation strength",
+            2, 1024, defaults.pixel_block, rw));
+    g_object_class_install_property(gobject_class, PROP_FACE_PADDING,
+        g_param_spec_float("face-padding", "Face padding", "Extra mask padding ratio",
+            0.0f, 10.0f, defaults.face_padding, rw));
+    g_object_class_install_property(gobject_class, PROP_HOLD_FRAMES,
+        g_param_spec_int("hold-frames", "Hold frames", "Frames to keep last boxes",
+            0, G_MAXINT, defaults.hold_frames, rw));
+    g_object_class_install_property(gobject_class, PROP_STATS,
+        g_param_spec_boxed("stats", "Stats", "Per-element latency: frames, avg-us, max-us, last-us",
+            GST_TYPE_STRUCTURE, static_cast<GParamFlags>(G_PARAM_READABLE | G_PARAM_STATIC_STRINGS)));
+
+    gst_element_class_set_static_metadata(element_class,
+        "Face pixelate", "Filter/Effect/Video",
+        "Detects faces with YuNet and pixelates them in place",
+        "cpp-native-face-pixelate");
+    gst_element_class_add_static_pad_template(element_class, &sink_template);
+    gst_element_class_add_static_pad_template(element_class, &src_template);
+
+    transform_class->stop = gst_face_pixelate_stop;
+    filter_class->set_info = gst_face_pixelate_set_info;
+    filter_class->transform_frame_ip = gst_face_pixelate_transform_frame_ip;
+}
+
+static gboolean plugin_init(GstPlugin* plugin) {
+    GST_DEBUG_CATEGORY_INIT(gst_face_pixelate_debug, "facepixelate", 0, "Face pixelate filter");
+    return gst_element_register(plugin, "facepixelate", GST_RANK_NONE, GST_TYPE_FACE_PIXELATE);
+}
+
+GST_PLUGIN_DEFINE(
+    GST_VERSION_MAJOR,
+    GST_VERSION_MINOR,
+    facepixelate,
+    "YuNet face pixelation",
+    plugin_init,
+    "0.1",
+    "unknown",
+    "cpp-native-face-pixelate",
+    "https://github.com/arsenicraghav/cpp-native-face-pixelate")
@@ -0,0 +1,143 @@
+#include "high_bit_depth.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+
+namespace {
+
+struct RawFormatInfo {
+    const char* name;
+    RawFormat format;
+    int bit_depth;
+    int chroma_sx;
+    int chroma_sy;
+};
+
+const RawFormatInfo kRawFormats[] = {
+    {"yuv420p10le", RawFormat::Yuv420p10le, 10, 2, 2},
+    {"yuv422p10le", RawFormat::Yuv422p10le, 10, 2, 1},
+    {"yuv444p10le", RawFormat::Yuv444p10le, 10, 1, 1},
+    {"yuv420p16le", RawFormat::Yuv420p16le, 16, 2, 2},
+    {"yuv422p16le", RawFormat::Yuv422p16le, 16, 2, 1},
+    {"yuv444p16le", RawFormat::Yuv444p16le, 16, 1, 1},
+};
+
+const RawFormatInfo& format_info(RawFormat format) {
+    for (const auto& info : kRawFormats) {
+        if (info.format == format) {
+            return info;
+        }
+    }
+    return kRawFormats[0];
+}
+
+bool plane_io_ok(size_t got, const cv::Mat& plane) {
+    return got == plane.total();
+}
+
+}  // namespace
+
+bool parse_raw_format(const std::string& name, RawFormat& format) {
+    for (const auto& info : kRawFormats) {
+        if (name == info.name) {
+            format = info.format;
+            return true;
+        }
+    }
+    return false;
+}
+
+void PlanarFrame16::allocate(cv::Size size, RawFormat format) {
+    const RawFormatInfo& info = format_info(format);
+    bit_depth = info.bit_depth;
+    chroma_sx = info.chroma_sx;
+    chroma_sy = info.chroma_sy;
+    cv::Size chroma((size.width + chroma_sx - 1) / chroma_sx, (size.height + chroma_sy - 1) / chroma_sy);
+    planes[0].create(size, CV_16UC1);
+    planes[1].create(chroma, CV_16UC1);
+    planes[2].create(chroma, CV_16UC1);
+}
+
+size_t PlanarFrame16::byte_size() const {
+    return (planes[0].total() + planes[1].total() + planes[2].total()) * sizeof(uint16_t);
+}
+
+RawPlanarReader::~RawPlanarReader() {
+    if (file_ && file_ != stdin) {
+        std::fclose(file_);
+    }
+}
+
+bool RawPlanarReader::open(const std::string& path, cv::Size size, RawFormat format) {
+    file_ = path == "-" ? stdin : std::fopen(path.c_str(), "rb");
+    size_ = size;
+    format_ = format;
+    return file_ != nullptr;
+}
+
+bool RawPlanarReader::read(PlanarFrame16& frame) {
+    if (!file_) {
+        return false;
+    }
+    if (frame.size() != size_ || frame.planes[1].empty()) {
+        frame.allocate(size_, format_);
+    }
+    // Samples are little-endian on disk, which matches x86 and ARM hosts,
+    // so the planes are filled with no conversion at all.
+    for (cv::Mat& plane : frame.planes) {
+        size_t got = std::fread(plane.ptr<uint16_t>(), sizeof(uint16_t), plane.total(), file_);
+        if (!plane_io_ok(got, plane)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+RawPlanarWriter::~RawPlanarWriter() {
+    if (file_) {
+        std::fflush(file_);
+        if (file_ != stdout) {
+            std::fclose(file_);
+        }
+    }
+}
+
+bool RawPlanarWriter::open(const std::string& path) {
+    file_ = path == "-" ? stdout : std::fopen(path.c_str(), "wb");
+    return file_ != nullptr;
+}
+
+bool RawPlanarWriter::write(const PlanarFrame16& frame) {
+    if (!file_) {
+        return false;
+    }
+    for (const cv::Mat& plane : frame.planes) {
+        size_t put = std::fwrite(plane.ptr<uint16_t>(), sizeof(uint16_t), plane.total(), file_);
+        if (!plane_io_ok(put, plane)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void make_detection_proxy(const PlanarFrame16& frame, cv::Mat& bgr8) {
+    // Map [0, 2^bits - 1] onto [0, 255]. Precision loss only affects the detector input.
+    double scale = 255.0 / ((1 << frame.bit_depth) - 1);
+    cv::Mat luma8;
+    frame.planes[0].convertTo(luma8, CV_8U, scale);
+    cv::cvtColor(luma8, bgr8, cv::COLOR_GRAY2BGR);
+}
+
+void mask_planar(PlanarFrame16& frame, const std::vector<cv::Rect>& boxes, MaskStyle style, int block_size) {
+    mask_boxes(frame.planes[0], boxes, style, block_size);
+
+    // Chroma planes get boxes and cell size divided by the subsampling factor on
+    // each axis, so mosaic cells stay aligned with the luma cells (4:2:2 chroma
+    // cells are half as wide as luma cells but just as tall).
+    block_size = std::max(2, block_size);
+    std::vector<cv::Rect> chroma_boxes = scale_boxes(boxes, frame.chroma_sx, frame.chroma_sy);
+    cv::Size chroma_cell(std::max(1, block_size / frame.chroma_sx), std::max(1, block_size / frame.chroma_sy));
+    mask_boxes(frame.planes[1], chroma_boxes, style, chroma_cell);
+    mask_boxes(frame.planes[2], chroma_boxes, style, chroma_cell);
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include "face_anonymizer.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Raw planar YUV layouts as named by ffmpeg's -pix_fmt.
+// 10-bit formats store each sample in the low 10 bits of a little-endian uint16.
+enum class RawFormat {
+    Yuv420p10le,
+    Yuv422p10le,
+    Yuv444p10le,
+    Yuv420p16le,
+    Yuv422p16le,
+    Yuv444p16le,
+};
+
+// Parse names like "yuv420p10le". Returns false for unsupported formats.
+bool parse_raw_format(const std::string& name, RawFormat& format);
+
+// One planar YUV frame with 16-bit samples. Planes are CV_16UC1.
+struct PlanarFrame16 {
+    cv::Mat planes[3];
+    // 10 or 16. Sample values never exceed (1 << bit_depth) - 1.
+    int bit_depth = 10;
+    // Chroma subsampling factors (2,2 for 4:2:0; 2,1 for 4:2:2; 1,1 for 4:4:4).
+    int chroma_sx = 2;
+    int chroma_sy = 2;
+
+    // Allocate planes for a frame of this size and layout.
+    void allocate(cv::Size size, RawFormat format);
+    cv::Size size() const { return planes[0].size(); }
+    size_t byte_size() const;
+};
+
+// Reads raw planar frames from a file or pipe ("-" = stdin).
+class RawPlanarReader {
+public:
+    RawPlanarReader() = default;
+    ~RawPlanarReader();
+    RawPlanarReader(const RawPlanarReader&) = delete;
+    RawPlanarReader& operator=(const RawPlanarReader&) = delete;
+
+    bool open(const std::string& path, cv::Size size, RawFormat format);
+    // Reads straight into the frame's planes. Returns false at end of input.
+    bool read(PlanarFrame16& frame);
+
+private:
+    FILE* file_ = nullptr;
+    cv::Size size_;
+    RawFormat format_ = RawFormat::Yuv420p10le;
+};
+
+// Writes raw planar frames to a file or pipe ("-" = stdout).
+class RawPlanarWriter {
+public:
+    RawPlanarWriter() = default;
+    ~RawPlanarWriter();
+    RawPlanarWriter(const RawPlanarWriter&) = delete;
+    RawPlanarWriter& operator=(const RawPlanarWriter&) = delete;
+
+    bool open(const std::string& path);
+    bool write(const PlanarFrame16& frame);
+
+private:
+    FILE* file_ = nullptr;
+};
+
+// Build the 8-bit BGR image YuNet needs. Only luma is converted: one cheap
+// pass per frame, and the full-precision planes are never touched.
+void make_detection_proxy(const PlanarFrame16& frame, cv::Mat& bgr8);
+
+// Mask the boxes (in luma coordinates) on every plane, in place, at full precision.
+void mask_planar(PlanarFrame16& frame, const std::vector<cv::Rect>& boxes, MaskStyle style, int block_size);
@@ -0,0 +1,173 @@
+#include "latency_probe.hpp"
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+// 24-bit ID + 40-bit time + 8-bit checksum, in two rows of 36 cells.
+const int kCols = 36;
+const int kRows = 2;
+const int kBits = kCols * kRows;
+const uint64_t kTimeMask = (uint64_t(1) << 40) - 1;
+
+int cell_size(int frame_width) {
+    return std::max(8, frame_width / 80);
+}
+
+uint8_t checksum(uint64_t payload) {
+    uint8_t sum = 0x5a;
+    for (int i = 0; i < 8; ++i) {
+        sum ^= static_cast<uint8_t>(payload >> (8 * i));
+    }
+    return sum;
+}
+
+double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t i = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+}
+
+}  // namespace
+
+int64_t unix_us_now() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+void stamp_frame(cv::Mat& bgr, const FrameStamp& stamp) {
+    int cell = cell_size(bgr.cols);
+    if (bgr.cols < kCols * cell || bgr.rows < kRows * cell) {
+        return;
+    }
+    uint64_t payload = (uint64_t(stamp.id & 0xffffff) << 40) | (uint64_t(stamp.unix_us) & kTimeMask);
+    uint8_t check = checksum(payload);
+    for (int bit = 0; bit < kBits; ++bit) {
+        bool on = bit < 64 ? (payload >> (63 - bit)) & 1 : (check >> (71 - bit)) & 1;
+        cv::Rect r((bit % kCols) * cell, (bit / kCols) * cell, cell, cell);
+        bgr(r).setTo(on ? cv::Scalar(255, 255, 255) : cv::Scalar(0, 0, 0));
+    }
+}
+
+bool read_stamp(const cv::Mat& bgr, FrameStamp& stamp) {
+    int cell = cell_size(bgr.cols);
+    if (bgr.cols < kCols * cell || bgr.rows < kRows * cell) {
+        return false;
+    }
+    uint64_t payload = 0;
+    uint8_t check = 0;
+    for (int bit = 0; bit < kBits; ++bit) {
+        // Sample the middle of the cell: its edges get smeared by the encoder.
+        cv::Rect r((bit % kCols) * cell + cell / 4, (bit / kCols) * cell + cell / 4, cell / 2, cell / 2);
+        cv::Scalar m = cv::mean(bgr(r));
+        bool on = (m[0] + m[1] + m[2]) / 3.0 > 128.0;
+        if (bit < 64) {
+            payload = (payload << 1) | (on ? 1 : 0);
+        } else {
+            check = static_cast<uint8_t>((check << 1) | (on ? 1 : 0));
+        }
+    }
+    if (checksum(payload) != check) {
+        return false;
+    }
+    stamp.id = static_cast<uint32_t>(payload >> 40);
+    stamp.unix_us = static_cast<int64_t>(payload & kTimeMask);
+    return true;
+}
+
+LatencyRecorder::LatencyRecorder(const std::string& csv_path) {
+    if (!csv_path.empty()) {
+        csv_.open(csv_path, std::ios::trunc);
+        csv_ << "id,stamped_us,latency_ms\n";
+    }
+}
+
+void LatencyRecorder::add(const FrameStamp& stamp, int64_t received_us) {
+    // Only the low 40 bits of the time travel in the frame (about 12 days).
+    int64_t diff = static_cast<int64_t>((uint64_t(received_us) - uint64_t(stamp.unix_us)) & kTimeMask);
+    double ms = diff / 1000.0;
+    std::lock_guard<std::mutex> guard(lock_);
+    latencies_ms_.push_back(ms);
+    if (last_id_ != 0 && stamp.id > last_id_ + 1) {
+        gaps_ += stamp.id - last_id_ - 1;
+    }
+    last_id_ = stamp.id;
+    if (csv_.is_open()) {
+        csv_ << stamp.id << ',' << stamp.unix_us << ',' << ms << '\n';
+    }
+}
+
+void LatencyRecorder::add_unreadable() {
+    std::lock_guard<std::mutex> guard(lock_);
+    unreadable_++;
+}
+
+void LatencyRecorder::report(std::ostream& out, const std::string& label) const {
+    std::vector<double> sorted;
+    uint64_t unreadable, gaps;
+    {
+        std::lock_guard<std::mutex> guard(lock_);
+        sorted = latencies_ms_;
+        unreadable = unreadable_;
+        gaps = gaps_;
+    }
+    std::sort(sorted.begin(), sorted.end());
+    out << label << ": " << sorted.size() << " frames";
+    if (!sorted.empty()) {
+        out << ", latency ms min " << sorted.front() << " p50 " << percentile(sorted, 0.5) << " p90 "
+            << percentile(sorted, 0.9) << " p99 " << percentile(sorted, 0.99) << " max " << sorted.back();
+    }
+    out << "; " << unreadable << " unreadable, " << gaps << " missing IDs" << std::endl;
+}
+
+SyntheticSource::SyntheticSource(cv::Size size, double fps)
+    : size_(size),
+      period_(std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<double>(1.0 / std::max(1.0, fps)))),
+      next_(std::chrono::steady_clock::now()) {}
+
+bool SyntheticSource::read(cv::Mat& frame) {
+    // Deliver at the camera's pace, like a real sensor would.
+    std::this_thread::sleep_until(next_);
+    next_ += period_;
+    frame.create(size_, CV_8UC3);
+    frame.setTo(cv::Scalar(96, 96, 96));
+    // A moving bar, so encoders see motion as with real video.
+    int x = static_cast<int>((index_++ * 8) % std::max(1, size_.width));
+    cv::rectangle(frame, cv::Rect(x, 0, 16, size_.height), cv::Scalar(200, 160, 40), cv::FILLED);
+    return true;
+}
+
+int run_latency_probe(const std::string& url, const std::string& csv_path, long max_frames) {
+    cv::VideoCapture cap;
+    if (!cap.open(url) || !cap.isOpened()) {
+        std::cerr << "Failed to open " << url << std::endl;
+        return 1;
+    }
+    // Do not let the client queue frames up: we want the newest one.
+    cap.set(cv::CAP_PROP_BUFFERSIZE, 1);
+
+    LatencyRecorder recorder(csv_path);
+    cv::Mat frame;
+    long frames = 0;
+    while (frames < max_frames && cap.read(frame) && !frame.empty()) {
+        int64_t now = unix_us_now();
+        FrameStamp stamp;
+        if (read_stamp(frame, stamp)) {
+            recorder.add(stamp, now);
+        } else {
+            recorder.add_unreadable();
+        }
+        frames++;
+    }
+    recorder.report(std::cout, "probe " + url);
+    return 0;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include "pipeline.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Glass-to-glass latency harness.
+//
+// The source stamps a frame ID and the wall-clock time into the top-left corner
+// of every frame as a strip of black/white cells. Whoever receives the frames
+// later (our own sink, or a probe reading the RTSP stream after encode and
+// transport) reads the strip back and subtracts the time. The cells are large
+// enough to survive H.264 compression.
+//
+// Times are Unix microseconds, so a probe in another process (or on another
+// machine with a synced clock) can measure too.
+
+struct FrameStamp {
+    uint32_t id = 0;
+    int64_t unix_us = 0;
+};
+
+// Wall-clock time in microseconds since the Unix epoch.
+int64_t unix_us_now();
+
+// Draw the stamp strip into an 8-bit BGR frame. The strip is about 45% of the
+// frame width wide and 1/40 of it high.
+void stamp_frame(cv::Mat& bgr, const FrameStamp& stamp);
+
+// Read the strip back. False if there is none or the checksum does not match.
+bool read_stamp(const cv::Mat& bgr, FrameStamp& stamp);
+
+// Collects per-frame latencies and prints their distribution. Thread-safe.
+class LatencyRecorder {
+public:
+    // Optional CSV with one line per frame: id,stamped_us,latency_ms.
+    explicit LatencyRecorder(const std::string& csv_path = "");
+
+    void add(const FrameStamp& stamp, int64_t received_us);
+    // A frame arrived without a readable stamp.
+    void add_unreadable();
+
+    void report(std::ostream& out, const std::string& label) const;
+
+private:
+    mutable std::mutex lock_;
+    std::vector<double> latencies_ms_;
+    uint64_t unreadable_ = 0;
+    uint32_t last_id_ = 0;
+    uint64_t gaps_ = 0;
+    std::ofstream csv_;
+};
+
+// Source stage that stamps every frame of another source right after capture.
+class StampingSource {
+public:
+    explicit StampingSource(std::unique_ptr<FrameSource> inner) : inner_(std::move(inner)) {}
+    bool read(cv::Mat& frame) {
+        if (!inner_->read(frame)) {
+            return false;
+        }
+        stamp_frame(frame, FrameStamp{next_id_++, unix_us_now()});
+        return true;
+    }
+
+private:
+    std::unique_ptr<FrameSource> inner_;
+    uint32_t next_id_ = 1;
+};
+
+// Camera stand-in: plain frames at a steady rate, for latency tests without hardware.
+class SyntheticSource {
+public:
+    SyntheticSource(cv::Size size, double fps);
+    bool read(cv::Mat& frame);
+
+private:
+    cv::Size size_;
+    std::chrono::steady_clock::duration period_;
+    std::chrono::steady_clock::time_point next_;
+    long index_ = 0;
+};
+
+// Sink stage that reads the stamp of every output frame.
+class LatencySink {
+public:
+    explicit LatencySink(std::shared_ptr<LatencyRecorder> recorder) : recorder_(std::move(recorder)) {}
+    bool write(cv::Mat& frame, const std::vector<cv::Rect>&) {
+        int64_t now = unix_us_now();
+        FrameStamp stamp;
+        if (read_stamp(frame, stamp)) {
+            recorder_->add(stamp, now);
+        } else {
+            recorder_->add_unreadable();
+        }
+        return true;
+    }
+
+private:
+    std::shared_ptr<LatencyRecorder> recorder_;
+};
+
+// Read a stream (e.g. our own RTSP output) and measure latency until `max_frames`
+// frames are seen or the stream ends. Returns a process exit code.
+int run_latency_probe(const std::string& url, const std::string& csv_path, long max_frames);
@@ -1,65 +1,117 @@
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
-#include <opencv2/objdetect.hpp>
 #include <opencv2/videoio.hpp>
 
+#include "adaptive_scale.hpp"
+#include "archive_batch.hpp"
+#include "container_limits.hpp"
+#include "decode_ahead.hpp"
+#include "event_stream.hpp"
+#include "face_anonymizer.hpp"
+#include "follow_file.hpp"
+#include "frame_atlas.hpp"
+#include "high_bit_depth.hpp"
+#include "latency_probe.hpp"
+#include "multi_view.hpp"
+#include "object_store.hpp"
+#include "pipeline.hpp"
+#include "pipeline_stages.hpp"
+#include "prefork.hpp"
+#include "screen_capture.hpp"
+#include "self_audit.hpp"
+#include "stream_hub.hpp"
+#include "tiled_still.hpp"
+#include "track_verifier.hpp"
+#include "tracker_state.hpp"
+#include "yunet_engine.hpp"
+#ifdef WITH_RTSP
+#include "rtsp_output.hpp"
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <functional>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
 // Runtime knobs. All values can be overridden from CLI flags.
-struct AppConfig {
-    // Path to YuNet ONNX model file.
-    std::string model_path = "face_detection_yunet_2023mar.onnx";
+struct AppConfig : AnonymizerConfig {
     // Which webcam to open (0 = default camera).
     int camera_index = 0;
-    // Minimum confidence score for a detected face.
-    float score_threshold = 0.8f;
-    // Non-maximum suppression threshold for overlapping detections.
-    float nms_threshold = 0.3f;
-    // Candidate boxes before NMS. Keep high unless performance issues appear.
-    int top_k = 5000;
-    // Pixelation strength. Higher => larger blocks => stronger anonymization.
-    int pixel_block = 28;
-    // Expand face box on all sides. Helps hide face edges better.
-    float face_padding = 0.5f;
-    // Keep using previous face boxes for a few frames if detection drops briefly.
-    int hold_frames = 20;
+    // Video file or stream URL. When set, it is used instead of the camera.
+    std::string input_path;
+    // Also write the masked video to this file (empty = off).
+    std::string output_path;
+    // s3:// inputs and outputs (needs make S3=1).
+    ObjectStoreConfig s3;
+    // Decoder threads and decode-ahead queue for file/stream inputs.
+    DecoderOptions decoder;
+    // Follow a growing --input file and write masked segments.
+    bool follow = false;
+    FollowConfig follow_cfg;
+    // One worker process per listed input, forked from a warm supervisor.
+    PreforkConfig prefork;
+    // Many small inputs in one process, detected together on shared canvases.
+    AtlasConfig atlas;
+    // Thousands of MJPEG cameras on a few event loop threads (needs make HUB=1).
+    HubConfig hub;
+    // Detection events for analytics (empty path = off).
+    EventConfig events;
+    // Grab the X11 screen instead of a camera (needs make X11=1).
+    bool screen = false;
+    ScreenCaptureConfig screen_cfg;
+    // Latency harness: stamp frames at the source and read them at the sink.
+    bool latency_stamp = false;
+    cv::Size synthetic_size;
+    double synthetic_fps = 30.0;
+    std::string latency_probe_url;
+    std::string latency_log;
+    long probe_frames = 600;
+    // Show the masked frames in a window.
+    bool show_window = true;
+    // Serve masked frames over RTSP on this port (0 = off, needs make RTSP=1).
+    int rtsp_port = 0;
+    std::string rtsp_path = "/masked";
+    int rtsp_bitrate = 4000;
+    // Tracker snapshot for warm restarts (empty = off).
+    std::string state_file;
+    int state_interval_ms = 1000;
+    int state_max_age_ms = 10000;
+    // Sampled self-audit of the masked output (budget 0 = off).
+    AuditConfig audit;
+    // Raw planar 10/16-bit input and output ("-" = stdin/stdout).
+    std::string raw_input;
+    std::string raw_output;
+    cv::Size raw_size;
+    RawFormat raw_format = RawFormat::Yuv420p10le;
+    // Detection scale picked per frame from the tracked faces (min_face 0 = off).
+    AdaptiveScaleConfig adaptive;
+    // Full detection only every N frames; tracks are confirmed on crops in between.
+    VerifierConfig verifier;
+    // Fisheye / 360 input, detected on several flat views (off unless --projection is given).
+    bool multi_view = false;
+    ViewsConfig views;
+    // Huge TIFF stills, processed tile by tile (needs make TIFF=1).
+    TiledStillConfig tiled;
+    // Videos inside a .tar/.zip, masked into a new .tar (needs make ARCHIVE=1).
+    ArchiveConfig archive;
 };
 
-// Ensure rectangle is inside frame boundaries.
-static cv::Rect clamp_rect(const cv::Rect& r, int width, int height) {
-    int x1 = std::max(0, r.x);
-    int y1 = std::max(0, r.y);
-    int x2 = std::min(width, r.x + r.width);
-    int y2 = std::min(height, r.y + r.height);
-    return cv::Rect(x1, y1, std::max(0, x2 - x1), std::max(0, y2 - y1));
-}
-
-// Expand a detected face rectangle for safer privacy masking.
-static cv::Rect expand_rect(const cv::Rect& r, float pad_ratio, int width, int height) {
-    int pad_w = static_cast<int>(r.width * pad_ratio);
-    int pad_h = static_cast<int>(r.height * pad_ratio);
-    cv::Rect expanded(r.x - pad_w, r.y - pad_h, r.width + 2 * pad_w, r.height + 2 * pad_h);
-    return clamp_rect(expanded, width, height);
-}
-
-// Pixelate region by downscaling and scaling back with nearest-neighbor.
-static cv::Mat pixelate_roi(const cv::Mat& roi, int block_size) {
-    if (roi.empty()) {
-        return roi;
+// Parse "1920x1080" style sizes.
+static bool parse_size(const std::string& text, cv::Size& size) {
+    size_t x = text.find('x');
+    if (x == std::string::npos) {
+        return false;
     }
-    block_size = std::max(2, block_size);
-    int small_w = std::max(1, roi.cols / block_size);
-    int small_h = std::max(1, roi.rows / block_size);
-
-    cv::Mat small;
-    cv::resize(roi, small, cv::Size(small_w, small_h), 0, 0, cv::INTER_LINEAR);
-
-    cv::Mat pixelated;
-    cv::resize(small, pixelated, roi.size(), 0, 0, cv::INTER_NEAREST);
-    return pixelated;
+    try {
+        size = cv::Size(std::stoi(text.substr(0, x)), std::stoi(text.substr(x + 1)));
+    } catch (const std::exception&) {
+        return false;
+    }
+    return size.width > 0 && size.height > 0;
 }
 
 // Minimal CLI parser for app options.
@@ -80,6 +132,48 @@ static AppConfig parse_args(int argc, char** argv) {
         } else if (key == "--camera") {
             need_value(key);
             cfg.camera_index = std::stoi(argv[++i]);
+        } else if (key == "--input") {
+            need_value(key);
+            cfg.input_path = argv[++i];
+        } else if (key == "--output") {
+            need_value(key);
+            cfg.output_path = argv[++i];
+        } else if (key == "--s3-endpoint") {
+            need_value(key);
+            cfg.s3.endpoint = argv[++i];
+        } else if (key == "--s3-region") {
+            need_value(key);
+            cfg.s3.region = argv[++i];
+        } else if (key == "--s3-part-mb") {
+            need_value(key);
+            cfg.s3.part_mb = std::stoi(argv[++i]);
+        } else if (key == "--s3-connections") {
+            need_value(key);
+            cfg.s3.connections = std::stoi(argv[++i]);
+        } else if (key == "--decode-threads") {
+            need_value(key);
+            cfg.decoder.threads = std::stoi(argv[++i]);
+        } else if (key == "--decode-thread-type") {
+            need_value(key);
+            cfg.decoder.thread_type = argv[++i];
+            if (cfg.decoder.thread_type != "frame" && cfg.decoder.thread_type != "slice") {
+                std::cerr << "Unknown decode thread type: " << cfg.decoder.thread_type << std::endl;
+                std::exit(1);
+            }
+        } else if (key == "--decode-ahead") {
+            need_value(key);
+            cfg.decoder.decode_ahead = std::stoi(argv[++i]);
+        } else if (key == "--no-display") {
+            cfg.show_window = false;
+        } else if (key == "--rtsp-port") {
+            need_value(key);
+            cfg.rtsp_port = std::stoi(argv[++i]);
+        } else if (key == "--rtsp-path") {
+            need_value(key);
+            cfg.rtsp_path = argv[++i];
+        } else if (key == "--rtsp-bitrate") {
+            need_value(key);
+            cfg.rtsp_bitrate = std::stoi(argv[++i]);
         } else if (key == "--score-threshold") {
             need_value(key);
             cfg.score_threshold = std::stof(argv[++i]);
@@ -89,9 +183,221 @@ static AppConfig parse_args(int argc, char** argv) {
         } else if (key == "--top-k") {
             need_value(key);
             cfg.top_k = std::stoi(argv[++i]);
+        } else if (key == "--engine") {
+            need_value(key);
+            std::string engine = argv[++i];
+            if (engine == "opencv") {
+                cfg.engine = DetectorEngine::OpenCV;
+            } else if (engine == "builtin") {
+                cfg.engine = DetectorEngine::Builtin;
+            } else {
+                std::cerr << "Unknown engine: " << engine << std::endl;
+                std::exit(1);
+            }
         } else if (key == "--pixel-block") {
             need_value(key);
             cfg.pixel_block = std::stoi(argv[++i]);
+        } else if (key == "--mask-style") {
+            need_value(key);
+            std::string style = argv[++i];
+            if (style == "pixelate") {
+                cfg.mask_style = MaskStyle::Pixelate;
+            } else if (style == "blur") {
+                cfg.mask_style = MaskStyle::Blur;
+            } else {
+                std::cerr << "Unknown mask style: " << style << std::endl;
+                std::exit(1);
+            }
+        } else if (key == "--state-file") {
+            need_value(key);
+            cfg.state_file = argv[++i];
+        } else if (key == "--state-interval-ms") {
+            need_value(key);
+            cfg.state_interval_ms = std::stoi(argv[++i]);
+        } else if (key == "--state-max-age-ms") {
+            need_value(key);
+            cfg.state_max_age_ms = std::stoi(argv[++i]);
+        } else if (key == "--audit-budget") {
+            need_value(key);
+            cfg.audit.budget_percent = std::stod(argv[++i]);
+        } else if (key == "--audit-rate") {
+            need_value(key);
+            cfg.audit.sample_rate = std::stod(argv[++i]);
+        } else if (key == "--audit-log") {
+            need_value(key);
+            cfg.audit.log_path = argv[++i];
+        } else if (key == "--raw-input") {
+            need_value(key);
+            cfg.raw_input = argv[++i];
+        } else if (key == "--raw-output") {
+            need_value(key);
+            cfg.raw_output = argv[++i];
+        } else if (key == "--raw-size") {
+            need_value(key);
+            if (!parse_size(argv[++i], cfg.raw_size)) {
+                std::cerr << "Invalid size (expected WxH): " << argv[i] << std::endl;
+                std::exit(1);
+            }
+        } else if (key == "--raw-format") {
+            need_value(key);
+            if (!parse_raw_format(argv[++i], cfg.raw_format)) {
+                std::cerr << "Unsupported raw format: " << argv[i] << std::endl;
+                std::exit(1);
+            }
+        } else if (key == "--prefork") {
+            need_value(key);
+            cfg.prefork.inputs_file = argv[++i];
+        } else if (key == "--prefork-output") {
+            need_value(key);
+            cfg.prefork.output_pattern = argv[++i];
+        } else if (key == "--atlas") {
+            need_value(key);
+            cfg.atlas.inputs_file = argv[++i];
+        } else if (key == "--atlas-output") {
+            need_value(key);
+            cfg.atlas.output_pattern = argv[++i];
+        } else if (key == "--atlas-cell") {
+            need_value(key);
+            if (!parse_size(argv[++i], cfg.atlas.cell)) {
+                std::cerr << "Invalid --atlas-cell, expected WxH: " << argv[i] << std::endl;
+                std::exit(1);
+            }
+        } else if (key == "--atlas-cells") {
+            need_value(key);
+            cfg.atlas.cells_per_canvas = std::stoi(argv[++i]);
+        } else if (key == "--atlas-guard") {
+            need_value(key);
+            cfg.atlas.guard = std::stoi(argv[++i]);
+        } else if (key == "--max-restarts") {
+            need_value(key);
+            cfg.prefork.max_restarts = std::stoi(argv[++i]);
+        } else if (key == "--events") {
+            need_value(key);
+            cfg.events.path = argv[++i];
+        } else if (key == "--events-format") {
+            need_value(key);
+            if (!parse_event_format(argv[++i], cfg.events.format)) {
+                std::cerr << "Unsupported events format: " << argv[i] << std::endl;
+                std::exit(1);
+            }
+        } else if (key == "--events-buffer") {
+            need_value(key);
+            cfg.events.capacity = static_cast<size_t>(std::max(2, std::stoi(argv[++i])));
+        } else if (key == "--screen") {
+            cfg.screen = true;
+        } else if (key == "--screen-display") {
+            need_value(key);
+            cfg.screen_cfg.display = argv[++i];
+        } else if (key == "--screen-region") {
+            need_value(key);
+            if (!parse_geometry(argv[++i], cfg.screen_cfg.region)) {
+                std::cerr << "Invalid region (expected WxH+X+Y): " << argv[i] << std::endl;
+                std::exit(1);
+            }
+        } else if (key == "--screen-fps") {
+            need_value(key);
+            cfg.screen_cfg.fps = std::stod(argv[++i]);
+        } else if (key == "--latency-stamp") {
+            cfg.latency_stamp = true;
+        } else if (key == "--synthetic") {
+            need_value(key);
+            if (!parse_size(argv[++i], cfg.synthetic_size)) {
+                std::cerr << "Invalid size (expected WxH): " << argv[i] << std::endl;
+                std::exit(1);
+            }
+        } else if (key == "--synthetic-fps") {
+            need_value(key);
+            cfg.synthetic_fps = std::stod(argv[++i]);
+        } else if (key == "--latency-probe") {
+            need_value(key);
+            cfg.latency_probe_url = argv[++i];
+        } else if (key == "--latency-log") {
+            need_value(key);
+            cfg.latency_log = argv[++i];
+        } else if (key == "--probe-frames") {
+            need_value(key);
+            cfg.probe_frames = std::stol(argv[++i]);
+        } else if (key == "--follow") {
+            cfg.follow = true;
+        } else if (key == "--segment-output") {
+            need_value(key);
+            cfg.follow_cfg.segment_pattern = argv[++i];
+        } else if (key == "--segment-seconds") {
+            need_value(key);
+            cfg.follow_cfg.segment_seconds = std::stod(argv[++i]);
+        } else if (key == "--follow-idle-ms") {
+            need_value(key);
+            cfg.follow_cfg.idle_timeout_ms = std::stoi(argv[++i]);
+        } else if (key == "--min-face") {
+            need_value(key);
+            cfg.adaptive.min_face = std::stoi(argv[++i]);
+        } else if (key == "--sweep-every") {
+            need_value(key);
+            cfg.adaptive.sweep_every = std::stoi(argv[++i]);
+        } else if (key == "--detect-every") {
+            need_value(key);
+            cfg.verifier.detect_every = std::stoi(argv[++i]);
+        } else if (key == "--projection") {
+            need_value(key);
+            if (!parse_projection(argv[++i], cfg.views.projection)) {
+                std::cerr << "Unsupported projection: " << argv[i] << std::endl;
+                std::exit(1);
+            }
+            cfg.multi_view = true;
+        } else if (key == "--lens-fov") {
+            need_value(key);
+            cfg.views.lens_fov_deg = std::stod(argv[++i]);
+        } else if (key == "--views") {
+            need_value(key);
+            cfg.views.views = std::stoi(argv[++i]);
+        } else if (key == "--view-fov") {
+            need_value(key);
+            cfg.views.view_fov_deg = std::stod(argv[++i]);
+        } else if (key == "--view-tilt") {
+            need_value(key);
+            cfg.views.view_tilt_deg = std::stod(argv[++i]);
+        } else if (key == "--view-size") {
+            need_value(key);
+            cfg.views.view_size = std::stoi(argv[++i]);
+        } else if (key == "--tiled-input") {
+            need_value(key);
+            cfg.tiled.input_path = argv[++i];
+        } else if (key == "--tiled-output") {
+            need_value(key);
+            cfg.tiled.output_path = argv[++i];
+        } else if (key == "--tile-size") {
+            need_value(key);
+            cfg.tiled.detect_tile = std::stoi(argv[++i]);
+        } else if (key == "--tile-overlap") {
+            need_value(key);
+            cfg.tiled.detect_overlap = std::stoi(argv[++i]);
+        } else if (key == "--threads") {
+            need_value(key);
+            cfg.tiled.threads = std::stoi(argv[++i]);
+        } else if (key == "--archive-input") {
+            need_value(key);
+            cfg.archive.input_path = argv[++i];
+        } else if (key == "--archive-output") {
+            need_value(key);
+            cfg.archive.output_path = argv[++i];
+        } else if (key == "--archive-jobs") {
+            need_value(key);
+            cfg.archive.jobs = std::stoi(argv[++i]);
+        } else if (key == "--hub") {
+            need_value(key);
+            cfg.hub.inputs_file = argv[++i];
+        } else if (key == "--hub-port") {
+            need_value(key);
+            cfg.hub.port = std::stoi(argv[++i]);
+        } else if (key == "--hub-io-threads") {
+            need_value(key);
+            cfg.hub.io_threads = std::stoi(argv[++i]);
+        } else if (key == "--hub-workers") {
+            need_value(key);
+            cfg.hub.workers = std::stoi(argv[++i]);
+        } else if (key == "--hub-quality") {
+            need_value(key);
+            cfg.hub.jpeg_quality = std::stoi(argv[++i]);
         } else if (key == "--face-padding") {
             need_value(key);
             cfg.face_padding = std::stof(argv[++i]);
@@ -102,10 +408,83 @@ static AppConfig parse_args(int argc, char** argv) {
             std::cout << "Usage: face_pixelate_cpp [options]\n"
                       << "  --model <path>            YuNet model path\n"
                       << "  --camera <index>          Camera index (default 0)\n"
+                      << "  --input <path|url>        Video file or stream instead of camera\n"
+                      << "  --output <path>           Also write the masked video to this file\n"
+                      << "  --s3-endpoint <url>       S3-compatible endpoint for s3:// paths\n"
+                      << "  --s3-region <name>        S3 region (default us-east-1)\n"
+                      << "  --s3-part-mb <int>        S3 part size for reads and uploads (default 8)\n"
+                      << "  --s3-connections <int>    Parallel S3 connections per stream (default 4)\n"
+                      << "  --decode-threads <int>    Decoder threads for --input (0 = one per available core)\n"
+                      << "  --decode-thread-type <t>  frame or slice decoder threading\n"
+                      << "  --decode-ahead <int>      Frames decoded ahead on a thread (0 = off)\n"
+                      << "  --no-display              Do not open a preview window\n"
+                      << "  --rtsp-port <int>         Serve masked video over RTSP (0 = off)\n"
+                      << "  --rtsp-path <path>        RTSP mount point (default /masked)\n"
+                      << "  --rtsp-bitrate <kbps>     RTSP H.264 bitrate\n"
                       << "  --score-threshold <f>     Detector score threshold\n"
                       << "  --nms-threshold <f>       NMS threshold\n"
                       << "  --top-k <int>             Top-K before NMS\n"
+                      << "  --engine <name>           opencv (default) or builtin YuNet engine\n"
                       << "  --pixel-block <int>       Pixelation strength\n"
+                      << "  --mask-style <name>       pixelate (default) or blur\n"
+                      << "  --state-file <path>       Save/restore tracker state for warm restarts\n"
+                      << "  --state-interval-ms <ms>  How often to save it (default 1000)\n"
+                      << "  --state-max-age-ms <ms>   Ignore snapshots older than this (default 10000)\n"
+                      << "  --audit-budget <pct>      Re-check sampled output frames using up to pct% of a core\n"
+                      << "  --audit-rate <f>          Chance a frame is considered for audit (default 0.1)\n"
+                      << "  --audit-log <path>        Append leak events to this JSONL file\n"
+                      << "  --raw-input <path|->      Raw planar 10/16-bit YUV input\n"
+                      << "  --raw-output <path|->     Raw planar output (same format)\n"
+                      << "  --raw-size <WxH>          Frame size of raw input\n"
+                      << "  --raw-format <name>       yuv420p10le (default), yuv422p10le, yuv444p10le,\n"
+                      << "                            yuv420p16le, yuv422p16le, yuv444p16le\n"
+                      << "  --prefork <list.txt>      One worker process per input listed in the file\n"
+                      << "  --prefork-output <fmt>    Worker output name, e.g. masked_%02d.avi (\"\" = none)\n"
+                      << "  --max-restarts <int>      Crashes in a row before a worker is given up (default 5)\n"
+                      << "  --atlas <list.txt>        Many small inputs, detected together on shared canvases\n"
+                      << "  --atlas-output <fmt>      Atlas output name, e.g. masked_%03d.avi (\"\" = none)\n"
+                      << "  --atlas-cell <WxH>        Cell size; bigger inputs are scaled down (default 320x240)\n"
+                      << "  --atlas-cells <int>       Inputs per canvas, i.e. per detection (default 16)\n"
+                      << "  --atlas-guard <px>        Gray border between cells (default 16)\n"
+                      << "  --events <path|->         Write frame/box/track events (JSONL or binary)\n"
+                      << "  --events-format <name>    jsonl (default) or binary\n"
+                      << "  --events-buffer <int>     Events queued before new ones are dropped (default 8192)\n"
+                      << "  --screen                  Capture the X11 screen (BGRA) instead of a camera\n"
+                      << "  --screen-display <name>   X display, e.g. :99 (default $DISPLAY)\n"
+                      << "  --screen-region <geom>    Part of the screen, WxH+X+Y\n"
+                      << "  --screen-fps <f>          Screen capture rate (default 15)\n"
+                      << "  --latency-stamp           Stamp frame ID/time at the source, measure at the sink\n"
+                      << "  --synthetic <WxH>         Generated frames instead of a camera\n"
+                      << "  --synthetic-fps <f>       Frame rate of --synthetic (default 30)\n"
+                      << "  --latency-probe <url>     Read a stamped stream and report latency\n"
+                      << "  --latency-log <path>      Per-frame latency CSV\n"
+                      << "  --probe-frames <int>      Frames measured by --latency-probe (default 600)\n"
+                      << "  --follow                  Keep reading --input while it grows (like tail -f)\n"
+                      << "  --segment-output <fmt>    Follow output name, e.g. masked_%05d.avi\n"
+                      << "  --segment-seconds <s>     Follow output segment length / max lag (default 10)\n"
+                      << "  --follow-idle-ms <ms>     Recording is done after no change for this long\n"
+                      << "  --min-face <px>           Pick the detection scale per frame; sweeps still find faces this tall\n"
+                      << "  --sweep-every <int>       Frames between detection sweeps for --min-face (default 15)\n"
+                      << "  --detect-every <int>      Full detection every N frames, crop checks between (default 1)\n"
+                      << "  --projection <name>       fisheye or equirect (360): detect on flat views\n"
+                      << "  --lens-fov <deg>          Fisheye lens field of view (default 180)\n"
+                      << "  --views <int>             Number of flat views (default 4)\n"
+                      << "  --view-fov <deg>          Field of view of each view (default 90)\n"
+                      << "  --view-tilt <deg>         Fisheye: view angle from lens axis (default 55)\n"
+                      << "  --view-size <int>         View edge in pixels (default 640)\n"
+                      << "  --tiled-input <path>      Huge TIFF still, masked tile by tile\n"
+                      << "  --tiled-output <path>     Tiled TIFF written for --tiled-input\n"
+                      << "  --tile-size <int>         Detection tile edge (default 1024)\n"
+                      << "  --tile-overlap <int>      Detection tile overlap (default 256)\n"
+                      << "  --threads <int>           Worker threads (0 = one per available core)\n"
+                      << "  --archive-input <path>    .tar or .zip whose videos are masked in place\n"
+                      << "  --archive-output <path>   .tar that receives the masked videos\n"
+                      << "  --archive-jobs <int>      Videos masked at the same time (0 = one per available core)\n"
+                      << "  --hub <list.txt>          Many http:// MJPEG cameras on a few event loop threads\n"
+                      << "  --hub-port <int>          Serve the masked streams as /<n>.mjpg (default 8090, 0 = off)\n"
+                      << "  --hub-io-threads <int>    Event loop threads for all connections (default 1)\n"
+                      << "  --hub-workers <int>       Detection threads (0 = one per available core)\n"
+                      << "  --hub-quality <int>       JPEG quality of the masked streams (default 80)\n"
                       << "  --face-padding <f>        Extra mask padding ratio\n"
                       << "  --hold-frames <int>       Frames to keep last boxes\n";
             std::exit(0);
@@ -119,101 +498,794 @@ static AppConfig parse_args(int argc, char** argv) {
     cfg.pixel_block = std::max(2, cfg.pixel_block);
     cfg.hold_frames = std::max(0, cfg.hold_frames);
     cfg.face_padding = std::max(0.0f, cfg.face_padding);
+    cfg.state_interval_ms = std::max(0, cfg.state_interval_ms);
+    cfg.audit.budget_percent = std::max(0.0, cfg.audit.budget_percent);
+    cfg.audit.sample_rate = std::min(1.0, std::max(0.0, cfg.audit.sample_rate));
+    cfg.decoder.threads = std::max(0, cfg.decoder.threads);
+    cfg.decoder.decode_ahead = std::max(0, cfg.decoder.decode_ahead);
+    cfg.tiled.threads = std::max(0, cfg.tiled.threads);
+    cfg.archive.jobs = std::max(0, cfg.archive.jobs);
+    cfg.atlas.cells_per_canvas = std::max(1, cfg.atlas.cells_per_canvas);
+    cfg.atlas.guard = std::max(0, cfg.atlas.guard);
+    cfg.hub.io_threads = std::max(1, cfg.hub.io_threads);
+    cfg.hub.workers = std::max(0, cfg.hub.workers);
+    cfg.hub.jpeg_quality = std::max(1, std::min(100, cfg.hub.jpeg_quality));
+    cfg.adaptive.min_face = std::max(0, cfg.adaptive.min_face);
+    cfg.adaptive.sweep_every = std::max(1, cfg.adaptive.sweep_every);
+    cfg.verifier.detect_every = std::max(1, cfg.verifier.detect_every);
+    cfg.prefork.max_restarts = std::max(0, cfg.prefork.max_restarts);
+    cfg.follow_cfg.segment_seconds = std::max(0.5, cfg.follow_cfg.segment_seconds);
+    cfg.follow_cfg.idle_timeout_ms = std::max(cfg.follow_cfg.poll_ms, cfg.follow_cfg.idle_timeout_ms);
+    cfg.views.views = std::max(1, std::min(16, cfg.views.views));
+    cfg.views.view_fov_deg = std::max(10.0, std::min(150.0, cfg.views.view_fov_deg));
+    cfg.views.lens_fov_deg = std::max(60.0, std::min(360.0, cfg.views.lens_fov_deg));
+    cfg.views.view_size = std::max(64, cfg.views.view_size);
+    if (cfg.rtsp_path.empty() || cfg.rtsp_path[0] != '/') {
+        cfg.rtsp_path = "/" + cfg.rtsp_path;
+    }
+    if (!cfg.raw_input.empty() && cfg.raw_size.empty()) {
+        std::cerr << "--raw-input needs --raw-size WxH" << std::endl;
+        std::exit(1);
+    }
+    if (cfg.tiled.input_path.empty() != cfg.tiled.output_path.empty()) {
+        std::cerr << "--tiled-input and --tiled-output must be used together" << std::endl;
+        std::exit(1);
+    }
+    if (cfg.archive.input_path.empty() != cfg.archive.output_path.empty()) {
+        std::cerr << "--archive-input and --archive-output must be used together" << std::endl;
+        std::exit(1);
+    }
+    if (!cfg.archive.output_path.empty() &&
+        (cfg.archive.output_path.size() < 4 ||
+         cfg.archive.output_path.compare(cfg.archive.output_path.size() - 4, 4, ".tar") != 0)) {
+        std::cerr << "--archive-output must be a .tar file" << std::endl;
+        std::exit(1);
+    }
+    if (cfg.follow && cfg.input_path.empty()) {
+        std::cerr << "--follow needs --input <file>" << std::endl;
+        std::exit(1);
+    }
+    const bool s3_used = is_s3_url(cfg.input_path) || is_s3_url(cfg.output_path);
+    if (s3_used && (cfg.follow || !cfg.prefork.inputs_file.empty())) {
+        std::cerr << "s3:// paths cannot be combined with --follow or --prefork" << std::endl;
+        std::exit(1);
+    }
+    if (!cfg.atlas.inputs_file.empty() && (cfg.follow || !cfg.prefork.inputs_file.empty())) {
+        std::cerr << "--atlas cannot be combined with --follow or --prefork" << std::endl;
+        std::exit(1);
+    }
+    if (!cfg.hub.inputs_file.empty() &&
+        (cfg.follow || !cfg.prefork.inputs_file.empty() || !cfg.atlas.inputs_file.empty())) {
+        std::cerr << "--hub cannot be combined with --follow, --prefork or --atlas" << std::endl;
+        std::exit(1);
+    }
+    if (is_s3_url(cfg.output_path)) {
+        std::string ext = cfg.output_path.substr(cfg.output_path.find_last_of('.') + 1);
+        if (ext == "mp4" || ext == "mov" || ext == "MP4" || ext == "MOV") {
+            std::cerr << "MP4/MOV needs a seekable file; use .mkv for an s3:// --output" << std::endl;
+            std::exit(1);
+        }
+    }
+    if (cfg.multi_view && cfg.verifier.detect_every > 1) {
+        std::cerr << "--detect-every cannot be combined with --projection" << std::endl;
+        std::exit(1);
+    }
+    if (cfg.multi_view && cfg.adaptive.min_face > 0) {
+        std::cerr << "--min-face cannot be combined with --projection" << std::endl;
+        std::exit(1);
+    }
+    if (cfg.multi_view && !cfg.state_file.empty()) {
+        std::cerr << "--state-file cannot be combined with --projection" << std::endl;
+        std::exit(1);
+    }
+#ifndef WITH_X11
+    if (cfg.screen) {
+        std::cerr << "Screen capture is not compiled in. Rebuild with: make clean && make X11=1" << std::endl;
+        std::exit(1);
+    }
+#endif
+#ifndef WITH_TIFF
+    if (!cfg.tiled.input_path.empty()) {
+        std::cerr << "Tiled TIFF mode is not compiled in. Rebuild with: make clean && make TIFF=1" << std::endl;
+        std::exit(1);
+    }
+#endif
+#ifndef WITH_ARCHIVE
+    if (!cfg.archive.input_path.empty()) {
+        std::cerr << "Archive mode is not compiled in. Rebuild with: make clean && make ARCHIVE=1" << std::endl;
+        std::exit(1);
+    }
+#endif
+#ifndef WITH_HUB
+    if (!cfg.hub.inputs_file.empty()) {
+        std::cerr << "Hub mode is not compiled in. Rebuild with: make clean && make HUB=1" << std::endl;
+        std::exit(1);
+    }
+#endif
+#ifndef WITH_S3
+    if (s3_used) {
+        std::cerr << "S3 support is not compiled in. Rebuild with: make clean && make S3=1" << std::endl;
+        std::exit(1);
+    }
+#endif
+#ifndef WITH_RTSP
+    if (cfg.rtsp_port > 0) {
+        std::cerr << "RTSP output is not compiled in. Rebuild with: make clean && make RTSP=1" << std::endl;
+        std::exit(1);
+    }
+#endif
     return cfg;
 }
 
-int main(int argc, char** argv) {
-    AppConfig cfg = parse_args(argc, argv);
+// Shows frames with debug rectangles; stops on q or ESC.
+struct WindowSink {
+    bool write(cv::Mat& frame, const std::vector<cv::Rect>& boxes) {
+        for (const auto& box : boxes) {
+            cv::rectangle(frame, box, cv::Scalar(0, 255, 0), 2);
+        }
+        cv::imshow("YuNet Face Pixelate (C++)", frame);
+        int key = cv::waitKey(1);
+        return key != 'q' && key != 27;
+    }
+};
+
+#ifdef WITH_RTSP
+// Pushes frames to the RTSP server and prints its stats every 5 seconds.
+class RtspSink {
+public:
+    explicit RtspSink(std::shared_ptr<RtspOutput> rtsp) : rtsp_(std::move(rtsp)) {}
+
+    bool write(cv::Mat& frame, const std::vector<cv::Rect>&) {
+        if (frame.channels() == 4) {
+            // The encoder is fed BGR; screen capture delivers BGRA.
+            cv::cvtColor(frame, bgr_, cv::COLOR_BGRA2BGR);
+            rtsp_->push(bgr_);
+        } else {
+            rtsp_->push(frame);
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now - last_report_ >= std::chrono::seconds(5)) {
+            RtspStats s = rtsp_->stats();
+            std::cout << "rtsp: clients=" << s.clients
+                      << " pushed=" << s.frames_pushed
+                      << " dropped=" << s.frames_dropped
+                      << " queue=" << s.queue_depth
+                      << " peak=" << s.queue_peak << std::endl;
+            last_report_ = now;
+        }
+        return true;
+    }
+
+private:
+    std::shared_ptr<RtspOutput> rtsp_;
+    cv::Mat bgr_;
+    std::chrono::steady_clock::time_point last_report_ = std::chrono::steady_clock::now();
+};
+#endif
+
+// Writes the masked video for --output. The writer is shared with main so it
+// can be closed (and an upload finished) after the pipeline stops.
+class RecordSink {
+public:
+    explicit RecordSink(std::shared_ptr<cv::VideoWriter> writer) : writer_(std::move(writer)) {}
 
-    // 1) Open camera.
-    cv::VideoCapture cap(cfg.camera_index);
-    if (!cap.isOpened()) {
-        std::cerr << "Failed to open camera index " << cfg.camera_index << std::endl;
+    bool write(cv::Mat& frame, const std::vector<cv::Rect>&) {
+        if (frame.channels() == 4) {
+            cv::cvtColor(frame, bgr_, cv::COLOR_BGRA2BGR);
+            writer_->write(bgr_);
+        } else {
+            writer_->write(frame);
+        }
+        return true;
+    }
+
+private:
+    std::shared_ptr<cv::VideoWriter> writer_;
+    cv::Mat bgr_;
+};
+
+// Prefork worker output: writes the masked video and tells the supervisor when
+// the first frame is out. Stops the pipeline on SIGINT/SIGTERM so the file is closed properly.
+class WorkerSink {
+public:
+    WorkerSink(std::string path, double fps, WorkerLink& link)
+        : path_(std::move(path)), fps_(fps), link_(&link), writer_(std::make_unique<cv::VideoWriter>()) {}
+
+    bool write(cv::Mat& frame, const std::vector<cv::Rect>&) {
+        if (!path_.empty()) {
+            if (!writer_->isOpened() && !writer_->open(path_, fourcc_for(path_), fps_, frame.size())) {
+                std::cerr << "Failed to open output " << path_ << std::endl;
+                return false;
+            }
+            writer_->write(frame);
+        }
+        if (!first_sent_) {
+            link_->first_frame();
+            first_sent_ = true;
+        }
+        return !WorkerLink::stop_requested();
+    }
+
+private:
+    std::string path_;
+    double fps_;
+    WorkerLink* link_;
+    // Behind a pointer so the sink can be moved into a pipeline.
+    std::unique_ptr<cv::VideoWriter> writer_;
+    bool first_sent_ = false;
+};
+
+// "0", "1", ... in an input list mean camera indices.
+static bool parse_camera_index(const std::string& text, int& index) {
+    if (text.empty() || text.size() > 3 || text.find_first_not_of("0123456789") != std::string::npos) {
+        return false;
+    }
+    index = std::stoi(text);
+    return true;
+}
+
+// Mask a raw 10/16-bit planar stream at full precision.
+// Detection sees an 8-bit luma proxy; the high-bit-depth planes are masked in place.
+static int run_raw_planar(const AppConfig& cfg) {
+    RawPlanarReader reader;
+    if (!reader.open(cfg.raw_input, cfg.raw_size, cfg.raw_format)) {
+        std::cerr << "Failed to open raw input " << cfg.raw_input << std::endl;
+        return 1;
+    }
+    RawPlanarWriter writer;
+    if (!cfg.raw_output.empty() && !writer.open(cfg.raw_output)) {
+        std::cerr << "Failed to open raw output " << cfg.raw_output << std::endl;
         return 1;
     }
 
-    // Read one frame first to initialize detector with real frame size.
-    cv::Mat frame;
-    if (!cap.read(frame) || frame.empty()) {
-        std::cerr << "Failed to read initial frame from camera." << std::endl;
+    auto anonymizer = FaceAnonymizer::create(cfg, cfg.raw_size);
+    if (anonymizer.empty()) {
+        std::cerr << "Failed to create YuNet detector. Check model path: " << cfg.model_path << std::endl;
         return 1;
     }
 
-    // 2) Create YuNet neural face detector.
-    auto detector = cv::FaceDetectorYN::create(
-        cfg.model_path,
-        "",
-        frame.size(),
-        cfg.score_threshold,
-        cfg.nms_threshold,
-        cfg.top_k);
+    PlanarFrame16 frame;
+    cv::Mat proxy;
+    long frames = 0;
+    while (reader.read(frame)) {
+        make_detection_proxy(frame, proxy);
+        std::vector<cv::Rect> boxes = anonymizer->detect(proxy);
+        mask_planar(frame, boxes, cfg.mask_style, cfg.pixel_block);
+        if (!cfg.raw_output.empty() && !writer.write(frame)) {
+            std::cerr << "Failed to write raw output." << std::endl;
+            return 1;
+        }
+        frames++;
+    }
+    // stdout may carry video, so progress goes to stderr.
+    std::cerr << "Processed " << frames << " raw frames." << std::endl;
+    return 0;
+}
 
-    if (detector.empty()) {
+// Follow a file that is still being recorded and publish masked segments.
+static int run_follow(const AppConfig& cfg) {
+    FollowSource source(cfg.input_path, cfg.decoder, cfg.follow_cfg);
+    std::cout << "Waiting for " << cfg.input_path << " ..." << std::endl;
+    if (!source.open()) {
+        std::cerr << "Input never became readable: " << cfg.input_path << std::endl;
+        return 1;
+    }
+    cv::Ptr<cv::FaceDetectorYN> yunet = create_yunet(cfg, source.frame_size());
+    if (yunet.empty()) {
         std::cerr << "Failed to create YuNet detector. Check model path: " << cfg.model_path << std::endl;
         return 1;
     }
 
-    std::vector<cv::Rect> last_boxes;
-    int missed_frames = 0;
+    auto segments = std::make_shared<SegmentWriter>(cfg.follow_cfg, source.fps());
+    // While the recorder is quiet, still publish a segment once it is old enough.
+    source.set_idle_callback([segments] { segments->close_if_due(); });
+    std::shared_ptr<const FollowStats> stats = source.stats();
 
-    std::cout << "Press q or ESC to quit." << std::endl;
-    // 3) Main processing loop.
-    while (true) {
-        if (!cap.read(frame) || frame.empty()) {
-            break;
-        }
-
-        // Detect faces on current frame.
-        detector->setInputSize(frame.size());
-        cv::Mat faces;
-        detector->detect(frame, faces);
-
-        std::vector<cv::Rect> current_boxes;
-        if (!faces.empty()) {
-            // YuNet returns rows of floats. First 4 values are x, y, w, h.
-            for (int i = 0; i < faces.rows; ++i) {
-                const float* row = faces.ptr<float>(i);
-                cv::Rect box(
-                    static_cast<int>(row[0]),
-                    static_cast<int>(row[1]),
-                    static_cast<int>(row[2]),
-                    static_cast<int>(row[3]));
-                box = expand_rect(box, cfg.face_padding, frame.cols, frame.rows);
-                if (box.width > 0 && box.height > 0) {
-                    current_boxes.push_back(box);
-                }
-            }
-            if (!current_boxes.empty()) {
-                // Fresh detection: remember boxes and reset dropout counter.
-                last_boxes = current_boxes;
-                missed_frames = 0;
+    Pipeline<FollowSource, YuNetDetector, FaceTracker, MosaicMasker, SegmentSink> pipeline(
+        std::move(source),
+        YuNetDetector(yunet, cfg.face_padding),
+        FaceTracker(cfg.hold_frames),
+        MosaicMasker(cfg.mask_style, cfg.pixel_block),
+        SegmentSink(segments));
+    pipeline.run();
+    segments->close();
+
+    std::cout << "Recording finished: " << stats->frames << " frames in " << segments->segments()
+              << " segments, " << stats->reopens << " reopens (" << stats->skipped << " frames re-read), "
+              << "max lag " << segments->max_lag_seconds() << " s" << std::endl;
+    return 0;
+}
+
+// Size thread pools and buffers from the container's CPU and memory limits
+// instead of the host's, and print what was derived.
+static void apply_container_limits(AppConfig& cfg) {
+    const ContainerLimits& limits = container_limits();
+    if (!limits.limited()) {
+        return;
+    }
+    limits.print(std::cout);
+    if (limits.cpus < limits.host_cpus) {
+        // OpenCV (resize, masking, DNN) and FFmpeg start one thread per host core by default.
+        cv::setNumThreads(limits.cpus);
+        if (cfg.decoder.threads == 0) {
+            cfg.decoder.threads = limits.cpus;
+        }
+    }
+    if (limits.memory_limit > 0) {
+        // S3 parts held in memory: at most an eighth of the limit.
+        const int64_t part_bytes = static_cast<int64_t>(cfg.s3.part_mb) * 1024 * 1024 * std::max(1, cfg.s3.connections);
+        const int max_prefetch = static_cast<int>(std::max<int64_t>(1, limits.memory_limit / 8 / part_bytes));
+        if (cfg.s3.prefetch_per_connection > max_prefetch) {
+            cfg.s3.prefetch_per_connection = max_prefetch;
+            std::cout << "container: S3 prefetch lowered to " << max_prefetch << " parts per connection" << std::endl;
+        }
+    }
+}
+
+// The built-in engine stands in for cv::FaceDetectorYN, so it has to find the
+// same faces. Compare both engines on the first frame and fall back to OpenCV's
+// if they disagree.
+static void check_builtin_engine(AppConfig& cfg, const cv::Mat& frame) {
+    cv::Mat bgr = frame;
+    if (frame.channels() == 4) {
+        cv::cvtColor(frame, bgr, cv::COLOR_BGRA2BGR);
+    }
+    AnonymizerConfig reference_cfg = cfg;
+    reference_cfg.engine = DetectorEngine::OpenCV;
+    cv::Ptr<cv::FaceDetectorYN> reference = create_yunet(reference_cfg, bgr.size());
+    cv::Ptr<cv::FaceDetectorYN> builtin = create_yunet(cfg, bgr.size());
+    if (reference.empty() || builtin.empty()) {
+        return;  // reported when the real detector is created
+    }
+    cv::Mat ref_faces, our_faces;
+    reference->detect(bgr, ref_faces);
+    builtin->detect(bgr, our_faces);
+    const YuNetParity parity = compare_yunet_faces(ref_faces, our_faces);
+    if (parity.same()) {
+        std::cout << "engine: builtin matches opencv on the first frame (" << parity.reference_faces
+                  << " faces, max diff " << parity.max_coord << " px, score " << parity.max_score << ")"
+                  << std::endl;
+        return;
+    }
+    std::cerr << "Warning: builtin engine differs from opencv on the first frame (" << parity.reference_faces
+              << " vs " << parity.engine_faces << " faces, " << parity.matched << " matched, max diff "
+              << parity.max_coord << " px, score " << parity.max_score << "); using --engine opencv" << std::endl;
+    cfg.engine = DetectorEngine::OpenCV;
+}
+
+// Load and warm one detector, then fork a worker process per listed input.
+// Workers inherit the warm detector copy-on-write, so they start in milliseconds
+// and a crash on one stream does not touch the others.
+static int run_prefork(const AppConfig& cfg) {
+    std::vector<std::string> inputs;
+    if (!read_input_list(cfg.prefork.inputs_file, inputs)) {
+        std::cerr << "No inputs listed in " << cfg.prefork.inputs_file << std::endl;
+        return 1;
+    }
+    // OpenCV's thread pool does not survive fork(). Each process detects on one
+    // thread; the processes are the parallelism.
+    cv::setNumThreads(1);
+
+    // Warm up at the first input's frame size, the size most workers will use.
+    cv::Size warm_size(640, 480);
+    {
+        cv::VideoCapture probe;
+        cv::Mat frame;
+        int camera = 0;
+        bool is_camera = parse_camera_index(inputs[0], camera);
+        if (open_capture(probe, is_camera ? "" : inputs[0], camera, cfg.decoder) && probe.read(frame) &&
+            !frame.empty()) {
+            warm_size = frame.size();
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    cv::Ptr<cv::FaceDetectorYN> yunet = create_yunet(cfg, warm_size);
+    if (yunet.empty()) {
+        std::cerr << "Failed to create YuNet detector. Check model path: " << cfg.model_path << std::endl;
+        return 1;
+    }
+    // The first inference allocates and initializes every layer. Do it once, here.
+    cv::Mat blank(warm_size, CV_8UC3, cv::Scalar::all(0));
+    cv::Mat faces;
+    yunet->detect(blank, faces);
+    double warm_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Detector loaded and warmed at " << warm_size.width << "x" << warm_size.height << " in "
+              << warm_ms << " ms; starting " << inputs.size() << " workers" << std::endl;
+    if (static_cast<int>(inputs.size()) > available_cpus()) {
+        std::cout << "Note: " << inputs.size() << " workers share " << available_cpus()
+                  << " CPUs; expect them to slow each other down" << std::endl;
+    }
+
+    auto worker = [&](size_t index, const std::string& input, WorkerLink& link) -> int {
+        // Everything from here on uses the inherited detector. An input of another
+        // size only gets a new workspace (private); the weights stay shared.
+        link.ready();
+
+        cv::VideoCapture cap;
+        int camera = 0;
+        bool is_camera = parse_camera_index(input, camera);
+        if (!open_capture(cap, is_camera ? "" : input, camera, cfg.decoder) || !cap.isOpened()) {
+            std::cerr << "worker " << index << ": failed to open " << input << std::endl;
+            return 2;
+        }
+        std::string output;
+        if (!cfg.prefork.output_pattern.empty()) {
+            char name[1024];
+            std::snprintf(name, sizeof(name), cfg.prefork.output_pattern.c_str(), static_cast<int>(index));
+            output = name;
+        }
+        double fps = cap.get(cv::CAP_PROP_FPS);
+
+        CaptureMaskPipeline<WorkerSink> pipeline(
+            CaptureSource(cap),
+            YuNetDetector(yunet, cfg.face_padding),
+            FaceTracker(cfg.hold_frames),
+            MosaicMasker(cfg.mask_style, cfg.pixel_block),
+            WorkerSink(output, fps > 0.0 ? fps : 25.0, link));
+        long frames = pipeline.run();
+        std::cout << "worker " << index << ": " << frames << " frames from " << input << std::endl;
+        return 0;
+    };
+    return run_supervisor(cfg.prefork, inputs, worker);
+}
+
+static int run_atlas_mode(const AppConfig& cfg) {
+    std::vector<std::string> inputs;
+    if (!read_input_list(cfg.atlas.inputs_file, inputs)) {
+        std::cerr << "No inputs listed in " << cfg.atlas.inputs_file << std::endl;
+        return 1;
+    }
+    // Streams are decoded side by side, so one decoder thread each is plenty.
+    DecoderOptions decoder = cfg.decoder;
+    if (decoder.threads == 0) {
+        decoder.threads = 1;
+    }
+    return run_atlas(cfg, cfg.atlas, inputs, [&](cv::VideoCapture& cap, const std::string& input) {
+        int camera = 0;
+        bool is_camera = parse_camera_index(input, camera);
+        return open_capture(cap, is_camera ? "" : input, camera, decoder) && cap.isOpened();
+    });
+}
+
+int main(int argc, char** argv) {
+    AppConfig cfg = parse_args(argc, argv);
+    apply_container_limits(cfg);
+    // Printed on the way out of whichever mode runs.
+    struct ThrottlingReport {
+        CpuThrottling start = read_cpu_throttling();
+        ~ThrottlingReport() { print_throttling(std::cout, start, read_cpu_throttling()); }
+    } throttling_report;
+
+    if (!cfg.raw_input.empty()) {
+        return run_raw_planar(cfg);
+    }
+    if (cfg.follow) {
+        return run_follow(cfg);
+    }
+    if (!cfg.prefork.inputs_file.empty()) {
+        return run_prefork(cfg);
+    }
+    if (!cfg.atlas.inputs_file.empty()) {
+        return run_atlas_mode(cfg);
+    }
+    if (!cfg.latency_probe_url.empty()) {
+        return run_latency_probe(cfg.latency_probe_url, cfg.latency_log, cfg.probe_frames);
+    }
+#ifdef WITH_TIFF
+    if (!cfg.tiled.input_path.empty()) {
+        return run_tiled_still(cfg, cfg.tiled);
+    }
+#endif
+#ifdef WITH_ARCHIVE
+    if (!cfg.archive.input_path.empty()) {
+        return run_archive_batch(cfg, cfg.archive);
+    }
+#endif
+#ifdef WITH_HUB
+    if (!cfg.hub.inputs_file.empty()) {
+        return run_stream_hub(cfg, cfg.hub);
+    }
+#endif
+
+#ifdef WITH_S3
+    // s3:// paths become local pipes that are streamed while the video is processed.
+    load_object_store_env(cfg.s3);
+    S3InputStream s3_input;
+    if (is_s3_url(cfg.input_path)) {
+        if (!s3_input.open(cfg.input_path, cfg.s3)) {
+            return 1;
+        }
+        cfg.input_path = s3_input.path();
+    }
+    S3OutputStream s3_output;
+    if (is_s3_url(cfg.output_path)) {
+        if (!s3_output.open(cfg.output_path, cfg.s3)) {
+            return 1;
+        }
+    }
+#endif
+
+    // 1) Open camera (or the input file/stream). Synthetic and screen sources need neither.
+    cv::VideoCapture cap;
+    cv::Mat frame;
+    const bool synthetic = !cfg.synthetic_size.empty();
+#ifdef WITH_X11
+    ScreenCaptureSource screen;
+    if (cfg.screen) {
+        if (!screen.open(cfg.screen_cfg)) {
+            return 1;
+        }
+        frame = cv::Mat(screen.size(), CV_8UC4);
+    } else
+#endif
+    if (synthetic) {
+        frame = cv::Mat(cfg.synthetic_size, CV_8UC3);
+    } else {
+        if (!open_capture(cap, cfg.input_path, cfg.camera_index, cfg.decoder) || !cap.isOpened()) {
+            if (cfg.input_path.empty()) {
+                std::cerr << "Failed to open camera index " << cfg.camera_index << std::endl;
+            } else {
+                std::cerr << "Failed to open input " << cfg.input_path << std::endl;
             }
-        } else if (!last_boxes.empty() && missed_frames < cfg.hold_frames) {
-            // Detection dropped this frame: keep previous boxes temporarily.
-            current_boxes = last_boxes;
-            missed_frames++;
+            return 1;
+        }
+
+        // Read one frame first to initialize detector with real frame size.
+        if (!cap.read(frame) || frame.empty()) {
+            std::cerr << "Failed to read initial frame from input." << std::endl;
+            return 1;
+        }
+    }
+
+    // 2) Create YuNet neural face detector. Multi-view mode makes its own, one per view.
+    if (cfg.engine == DetectorEngine::Builtin && cap.isOpened()) {
+        // Screen and synthetic frames are not captured yet, so there is nothing to compare.
+        check_builtin_engine(cfg, frame);
+    }
+    cv::Ptr<cv::FaceDetectorYN> yunet;
+    if (!cfg.multi_view) {
+        yunet = create_yunet(cfg, frame.size());
+        if (yunet.empty()) {
+            std::cerr << "Failed to create YuNet detector. Check model path: " << cfg.model_path << std::endl;
+            return 1;
+        }
+    }
+
+    // 3) Pick output sinks from flags. Audit, RTSP and the recording go first so they never see debug boxes.
+    const double source_fps =
+        cfg.screen ? cfg.screen_cfg.fps : synthetic ? cfg.synthetic_fps : cap.get(cv::CAP_PROP_FPS);
+    auto sinks = std::make_unique<MultiSink>();
+    std::shared_ptr<SelfAudit> audit;
+    if (cfg.audit.budget_percent > 0.0) {
+        // A second YuNet instance, used only by the audit thread. No padding: we want the raw face.
+        cv::Ptr<cv::FaceDetectorYN> audit_net = create_yunet(cfg, frame.size());
+        if (audit_net.empty()) {
+            std::cerr << "Failed to create audit detector." << std::endl;
+            return 1;
+        }
+        audit = std::make_shared<SelfAudit>(YuNetDetector(audit_net, 0.0f), cfg.audit);
+        sinks->add(make_sink(AuditSink(audit)));
+    }
+#ifdef WITH_RTSP
+    if (cfg.rtsp_port > 0) {
+        RtspConfig rtsp_cfg;
+        rtsp_cfg.port = cfg.rtsp_port;
+        rtsp_cfg.path = cfg.rtsp_path;
+        rtsp_cfg.bitrate_kbps = cfg.rtsp_bitrate;
+        std::shared_ptr<RtspOutput> rtsp = RtspOutput::create(rtsp_cfg, frame.size(), source_fps);
+        if (!rtsp) {
+            std::cerr << "Failed to start RTSP server on port " << cfg.rtsp_port << std::endl;
+            return 1;
+        }
+        std::cout << "Serving masked video at " << rtsp->url() << std::endl;
+        sinks->add(make_sink(RtspSink(rtsp)));
+    }
+#endif
+    std::shared_ptr<cv::VideoWriter> recording;
+    if (!cfg.output_path.empty()) {
+        recording = std::make_shared<cv::VideoWriter>();
+        bool opened = false;
+#ifdef WITH_S3
+        if (is_s3_url(cfg.output_path)) {
+            // FFmpeg writes into the pipe; the container comes from the key's extension.
+            opened = recording->open(s3_output.path(), cv::CAP_FFMPEG, fourcc_for(cfg.output_path),
+                                     source_fps > 0.0 ? source_fps : 25.0, frame.size());
+        } else
+#endif
+        {
+            opened = recording->open(cfg.output_path, fourcc_for(cfg.output_path), source_fps > 0.0 ? source_fps : 25.0,
+                                     frame.size());
+        }
+        if (!opened) {
+            std::cerr << "Failed to open output " << cfg.output_path << std::endl;
+            return 1;
+        }
+        sinks->add(make_sink(RecordSink(recording)));
+    }
+    std::shared_ptr<EventStream> events;
+    if (!cfg.events.path.empty()) {
+        events = EventStream::create(cfg.events);
+        if (!events) {
+            std::cerr << "Failed to open events output " << cfg.events.path << std::endl;
+            return 1;
+        }
+        sinks->add(make_sink(EventSink(events)));
+    }
+    // Measured after RTSP hand-off, before the window draws over the frame.
+    std::shared_ptr<LatencyRecorder> latency;
+    if (cfg.latency_stamp) {
+        latency = std::make_shared<LatencyRecorder>(cfg.latency_log);
+        sinks->add(make_sink(LatencySink(latency)));
+    }
+    if (cfg.show_window) {
+        sinks->add(make_sink(WindowSink()));
+        std::cout << "Press q or ESC to quit." << std::endl;
+    }
+
+    // Warm restart: start from the boxes a previous run saw, if recent enough.
+    FaceTracker tracker(cfg.hold_frames);
+    std::unique_ptr<BoxTracker> tracker_stage;
+    if (!cfg.state_file.empty()) {
+        if (load_tracker_state(cfg.state_file, tracker, frame.size(), std::chrono::milliseconds(cfg.state_max_age_ms))) {
+            std::cout << "Restored " << tracker.last_boxes().size() << " face boxes from " << cfg.state_file << std::endl;
+        }
+        tracker_stage = make_tracker(PersistentTracker(
+            tracker, cfg.state_file, frame.size(), std::chrono::milliseconds(cfg.state_interval_ms)));
+    } else {
+        tracker_stage = make_tracker(tracker);
+    }
+
+    std::unique_ptr<FaceDetector> detector_stage;
+    std::unique_ptr<FrameMasker> masker_stage;
+    std::shared_ptr<const AdaptiveScaleStats> scale_stats;
+    std::shared_ptr<const VerifierStats> verifier_stats;
+    if (!cfg.multi_view) {
+        std::function<bool()> sweep_check;
+        if (cfg.adaptive.min_face > 0) {
+            // Detect at the smallest scale the tracked faces allow, with regular sweeps.
+            AdaptiveScaleDetector adaptive(yunet, cfg.face_padding, cfg.adaptive);
+            scale_stats = adaptive.stats();
+            sweep_check = adaptive.skip_check();
+            detector_stage = make_detector(std::move(adaptive));
         } else {
-            // Too many misses: stop using stale boxes.
-            last_boxes.clear();
+            detector_stage = make_detector(YuNetDetector(yunet, cfg.face_padding));
+        }
+        if (cfg.verifier.detect_every > 1) {
+            // Its own instance: the verifier input stays at the crop size.
+            cv::Ptr<cv::FaceDetectorYN> verifier_net =
+                create_yunet(cfg, cv::Size(cfg.verifier.crop_size, cfg.verifier.crop_size));
+            if (verifier_net.empty()) {
+                std::cerr << "Failed to create verifier detector." << std::endl;
+                return 1;
+            }
+            TrackVerifier verifier(std::move(detector_stage), verifier_net, cfg.face_padding, cfg.verifier);
+            // Sweeps count frames, not full detections, and run even between them.
+            verifier.set_skip_check(std::move(sweep_check));
+            verifier_stats = verifier.stats();
+            detector_stage = make_detector(std::move(verifier));
+        }
+        masker_stage = make_masker(MosaicMasker(cfg.mask_style, cfg.pixel_block));
+    } else {
+        // Fisheye / 360: detect on flat views, hold per view, mask polygons.
+        std::shared_ptr<MultiViewDetector> views = MultiViewDetector::create(cfg, cfg.views, frame.size());
+        if (!views) {
+            std::cerr << "Failed to create view detectors. Check model path: " << cfg.model_path << std::endl;
+            return 1;
         }
+        std::cout << "Built " << views->views().count() << " view remap tables in " << views->views().build_ms()
+                  << " ms" << std::endl;
+        detector_stage = make_detector(MultiViewDetectorStage(views));
+        tracker_stage = make_tracker(PassThroughTracker());
+        masker_stage = make_masker(PolygonMasker(views, cfg.mask_style, cfg.pixel_block));
+        if (audit) {
+            // Only the inside of each polygon is masked, not its bounding box.
+            audit->use_polygons([views] { return views->polygons(); });
+        }
+    }
 
-        // 4) Pixelate detected regions + draw debug rectangle.
-        for (const auto& box : current_boxes) {
-            cv::Mat roi = frame(box);
-            cv::Mat pix = pixelate_roi(roi, cfg.pixel_block);
-            pix.copyTo(frame(box));
-            cv::rectangle(frame, box, cv::Scalar(0, 255, 0), 2);
+    // Every detector above comes from the same cached model; show what each one costs.
+    cv::Size detector_input = cfg.multi_view ? cv::Size(cfg.views.view_size, cfg.views.view_size) : frame.size();
+    ModelFootprint footprint = model_footprint(cfg, detector_input);
+    std::cout << "detectors: " << footprint.instances << " YuNet instances from one "
+              << footprint.model_bytes / 1024 << " KB model load; ";
+    if (footprint.shared_weights) {
+        std::cout << footprint.weights_bytes / 1024 << " KB weights shared; per instance ";
+    } else {
+        std::cout << "per instance " << footprint.weights_bytes / 1024 << " KB weights + ";
+    }
+    std::cout << footprint.workspace_bytes / (1024.0 * 1024.0) << " MB workspace at "
+              << detector_input.width << "x" << detector_input.height << std::endl;
+
+    std::unique_ptr<FrameSource> source_stage;
+    std::shared_ptr<const DecodeStats> decode_stats;
+#ifdef WITH_X11
+    if (cfg.screen) {
+        source_stage = make_source(std::move(screen));
+    } else
+#endif
+    if (synthetic) {
+        source_stage = make_source(SyntheticSource(cfg.synthetic_size, cfg.synthetic_fps));
+    } else {
+        const ContainerLimits& limits = container_limits();
+        const int64_t frame_bytes = static_cast<int64_t>(frame.total() * frame.elemSize());
+        if (limits.memory_limit > 0 && frame_bytes > 0 &&
+            cfg.decoder.decode_ahead * frame_bytes > limits.memory_limit / 8) {
+            // Decoded frames waiting in the queue: at most an eighth of the memory limit.
+            cfg.decoder.decode_ahead = static_cast<int>(std::max<int64_t>(1, limits.memory_limit / 8 / frame_bytes));
+            std::cout << "container: decode-ahead lowered to " << cfg.decoder.decode_ahead << " frames" << std::endl;
+        }
+        // Stamp on the decode thread, so time spent waiting in the decode-ahead
+        // queue counts as latency too.
+        std::function<void(cv::Mat&)> stamp;
+        if (cfg.latency_stamp) {
+            stamp = [id = uint32_t{1}](cv::Mat& decoded) mutable {
+                stamp_frame(decoded, FrameStamp{id++, unix_us_now()});
+            };
         }
+        DecodeAheadSource source(cap, cfg.decoder.decode_ahead, std::move(stamp));
+        decode_stats = source.stats();
+        source_stage = make_source(std::move(source));
+    }
+    if (cfg.latency_stamp && !decode_stats) {
+        source_stage = make_source(StampingSource(std::move(source_stage)));
+    }
 
-        // 5) Show output and handle quit key.
-        cv::imshow("YuNet Face Pixelate (C++)", frame);
-        int key = cv::waitKey(1);
-        if (key == 'q' || key == 27) {
-            break;
+    // 4) Main processing loop: read -> detect -> hold -> mask -> sinks.
+    RuntimePipeline pipeline(
+        std::move(source_stage),
+        std::move(detector_stage),
+        std::move(tracker_stage),
+        std::move(masker_stage),
+        std::move(sinks));
+    pipeline.run();
+    int status = 0;
+    if (recording) {
+        recording->release();
+    }
+#ifdef WITH_S3
+    if (is_s3_url(cfg.output_path)) {
+        if (s3_output.close()) {
+            std::cout << "Uploaded " << cfg.output_path << std::endl;
+        } else {
+            status = 1;
         }
+        s3_output.stats()->print(std::cout, "s3 output");
+    }
+#endif
+    if (decode_stats) {
+        decode_stats->print(std::cout, cfg.decoder.decode_ahead);
+    }
+    if (scale_stats) {
+        scale_stats->print(std::cout);
+    }
+    if (verifier_stats) {
+        verifier_stats->print(std::cout);
+    }
+    if (events) {
+        events->close();
+        EventStats e = events->stats();
+        std::cout << "events: " << e.written << "/" << e.emitted << " written in " << e.batches << " batches ("
+                  << e.bytes << " bytes), " << e.dropped << " dropped on overflow" << std::endl;
+    }
+    if (latency) {
+        latency->report(std::cout, "latency source->sink");
+    }
+    if (audit) {
+        AuditReport r = audit->report();
+        std::cout << "audit: " << r.frames_audited << "/" << r.frames_seen << " frames checked, "
+                  << r.leaks << " leak events, "
+                  << (r.wall_seconds > 0.0 ? 100.0 * r.audit_seconds / r.wall_seconds : 0.0)
+                  << "% of a core" << std::endl;
     }
 
     cap.release();
+#ifdef WITH_S3
+    if (!s3_input.path().empty()) {
+        s3_input.close();
+        s3_input.stats()->print(std::cout, "s3 input");
+    }
+#endif
     cv::destroyAllWindows();
-    return 0;
+    return status;
 }
@@ -0,0 +1,241 @@
+#include "multi_view.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+double deg2rad(double deg) { return deg * kPi / 180.0; }
+
+void normalize(double v[3]) {
+    double n = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+    v[0] /= n;
+    v[1] /= n;
+    v[2] /= n;
+}
+
+// out = a x b
+void cross(const double a[3], const double b[3], double out[3]) {
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+}  // namespace
+
+bool parse_projection(const std::string& name, Projection& projection) {
+    if (name == "fisheye") {
+        projection = Projection::Fisheye;
+    } else if (name == "equirect" || name == "360") {
+        projection = Projection::Equirect;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+RemapViews::RemapViews(const ViewsConfig& cfg, cv::Size source_size) : cfg_(cfg), source_size_(source_size) {
+    auto t0 = std::chrono::steady_clock::now();
+    const int n = std::max(1, cfg_.views);
+    const int s = std::max(16, cfg_.view_size);
+    cfg_.view_size = s;
+    focal_ = (s / 2.0) / std::tan(deg2rad(cfg_.view_fov_deg) / 2.0);
+
+    // Camera space: x right, y down, z along the lens axis (fisheye) or straight ahead (360).
+    for (int k = 0; k < n; ++k) {
+        View view;
+        double yaw = 2.0 * kPi * k / n;
+        if (cfg_.projection == Projection::Fisheye) {
+            double tilt = deg2rad(cfg_.view_tilt_deg);
+            view.f[0] = std::sin(tilt) * std::cos(yaw);
+            view.f[1] = std::sin(tilt) * std::sin(yaw);
+            view.f[2] = std::cos(tilt);
+            // "Down" in the view points back toward the lens axis: for a ceiling
+            // camera that is where people's feet are, so faces come out upright.
+            if (std::abs(std::sin(tilt)) < 1e-6) {
+                view.d[0] = 0.0, view.d[1] = 1.0, view.d[2] = 0.0;
+            } else {
+                view.d[0] = -view.f[2] * view.f[0];
+                view.d[1] = -view.f[2] * view.f[1];
+                view.d[2] = 1.0 - view.f[2] * view.f[2];
+                normalize(view.d);
+            }
+        } else {
+            view.f[0] = std::sin(yaw), view.f[1] = 0.0, view.f[2] = std::cos(yaw);
+            view.d[0] = 0.0, view.d[1] = 1.0, view.d[2] = 0.0;
+        }
+        cross(view.d, view.f, view.r);
+
+        cv::Mat map_x(s, s, CV_32FC1), map_y(s, s, CV_32FC1);
+        for (int v = 0; v < s; ++v) {
+            float* mx = map_x.ptr<float>(v);
+            float* my = map_y.ptr<float>(v);
+            for (int u = 0; u < s; ++u) {
+                double dir[3];
+                direction(view, u, v, dir);
+                cv::Point2f p;
+                if (!project(dir, p)) {
+                    p = cv::Point2f(-1.0f, -1.0f);  // outside the lens: black
+                }
+                mx[u] = p.x;
+                my[u] = p.y;
+            }
+        }
+        // Fixed-point tables make every later remap noticeably faster than float ones.
+        cv::convertMaps(map_x, map_y, view.map1, view.map2, CV_16SC2);
+        views_.push_back(std::move(view));
+    }
+    build_ms_ = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+}
+
+void RemapViews::direction(const View& view, double u, double v, double dir[3]) const {
+    double a = (u - (cfg_.view_size - 1) / 2.0) / focal_;
+    double b = (v - (cfg_.view_size - 1) / 2.0) / focal_;
+    for (int i = 0; i < 3; ++i) {
+        dir[i] = view.f[i] + a * view.r[i] + b * view.d[i];
+    }
+    normalize(dir);
+}
+
+bool RemapViews::project(const double dir[3], cv::Point2f& pixel) const {
+    const double w = source_size_.width;
+    const double h = source_size_.height;
+    if (cfg_.projection == Projection::Fisheye) {
+        // Equidistant fisheye: distance from the image center grows linearly with the angle.
+        double theta = std::acos(std::max(-1.0, std::min(1.0, dir[2])));
+        double half_fov = deg2rad(cfg_.lens_fov_deg) / 2.0;
+        double radius = std::min(w, h) / 2.0;
+        double r = theta / half_fov * radius;
+        double phi = std::atan2(dir[1], dir[0]);
+        pixel = cv::Point2f(static_cast<float>(w / 2.0 + r * std::cos(phi)),
+                            static_cast<float>(h / 2.0 + r * std::sin(phi)));
+        return theta <= half_fov;
+    }
+    double lon = std::atan2(dir[0], dir[2]);
+    double lat = std::asin(std::max(-1.0, std::min(1.0, dir[1])));
+    pixel = cv::Point2f(static_cast<float>((lon / (2.0 * kPi) + 0.5) * w),
+                        static_cast<float>((lat / kPi + 0.5) * h));
+    return true;
+}
+
+void RemapViews::render(const cv::Mat& source, size_t index, cv::Mat& out) const {
+    const View& view = views_[index];
+    // 360 frames wrap around left/right; outside a fisheye circle there is nothing.
+    int border = cfg_.projection == Projection::Equirect ? cv::BORDER_WRAP : cv::BORDER_CONSTANT;
+    cv::remap(source, out, view.map1, view.map2, cv::INTER_LINEAR, border);
+}
+
+std::vector<std::vector<cv::Point>> RemapViews::to_source(size_t index, const cv::Rect& box) const {
+    // Straight box edges become curves in the source, so sample each edge.
+    const int steps = 8;
+    const View& view = views_[index];
+    std::vector<cv::Point2d> outline;
+    auto add = [&](double u, double v) {
+        double dir[3];
+        direction(view, u, v, dir);
+        cv::Point2f p;
+        project(dir, p);
+        outline.emplace_back(p.x, p.y);
+    };
+    double x0 = box.x, y0 = box.y, x1 = box.x + box.width, y1 = box.y + box.height;
+    for (int i = 0; i < steps; ++i) add(x0 + (x1 - x0) * i / steps, y0);
+    for (int i = 0; i < steps; ++i) add(x1, y0 + (y1 - y0) * i / steps);
+    for (int i = 0; i < steps; ++i) add(x1 - (x1 - x0) * i / steps, y1);
+    for (int i = 0; i < steps; ++i) add(x0, y1 - (y1 - y0) * i / steps);
+
+    const double w = source_size_.width;
+    if (cfg_.projection == Projection::Equirect) {
+        // Keep the outline continuous across the seam instead of jumping by a full width.
+        for (size_t i = 1; i < outline.size(); ++i) {
+            while (outline[i].x - outline[i - 1].x > w / 2) outline[i].x -= w;
+            while (outline[i - 1].x - outline[i].x > w / 2) outline[i].x += w;
+        }
+    }
+
+    std::vector<cv::Point> polygon;
+    double min_x = w, max_x = 0.0;
+    for (const auto& p : outline) {
+        polygon.emplace_back(cvRound(p.x), cvRound(p.y));
+        min_x = std::min(min_x, p.x);
+        max_x = std::max(max_x, p.x);
+    }
+    std::vector<std::vector<cv::Point>> result{polygon};
+    if (cfg_.projection == Projection::Equirect && (min_x < 0.0 || max_x >= w)) {
+        // The part past the seam shows up on the other side of the frame.
+        int shift = min_x < 0.0 ? source_size_.width : -source_size_.width;
+        for (auto& p : polygon) {
+            p.x += shift;
+        }
+        result.push_back(polygon);
+    }
+    return result;
+}
+
+MultiViewDetector::MultiViewDetector(RemapViews views, std::vector<YuNetDetector> detectors, int hold_frames)
+    : views_(std::move(views)),
+      detectors_(std::move(detectors)),
+      trackers_(views_.count(), FaceTracker(hold_frames)),
+      view_frames_(views_.count()),
+      view_boxes_(views_.count()) {}
+
+std::shared_ptr<MultiViewDetector> MultiViewDetector::create(const AnonymizerConfig& cfg, const ViewsConfig& views,
+                                                             cv::Size source_size) {
+    RemapViews tables(views, source_size);
+    // YuNet keeps per-call state, so each view gets its own network.
+    std::vector<YuNetDetector> detectors;
+    for (size_t i = 0; i < tables.count(); ++i) {
+        cv::Ptr<cv::FaceDetectorYN> net = create_yunet(cfg, tables.view_size());
+        if (net.empty()) {
+            return {};
+        }
+        detectors.emplace_back(net, cfg.face_padding);
+    }
+    return std::make_shared<MultiViewDetector>(std::move(tables), std::move(detectors), cfg.hold_frames);
+}
+
+std::vector<cv::Rect> MultiViewDetector::detect(const cv::Mat& frame) {
+    // Views are independent: render, detect and hold each one on its own thread.
+    cv::parallel_for_(cv::Range(0, static_cast<int>(views_.count())), [&](const cv::Range& range) {
+        for (int i = range.start; i < range.end; ++i) {
+            views_.render(frame, i, view_frames_[i]);
+            view_boxes_[i] = trackers_[i].update(detectors_[i].detect(view_frames_[i]));
+        }
+    });
+
+    polygons_.clear();
+    std::vector<cv::Rect> bounds;
+    for (size_t i = 0; i < view_boxes_.size(); ++i) {
+        for (const auto& box : view_boxes_[i]) {
+            for (auto& polygon : views_.to_source(i, box)) {
+                cv::Rect b = clamp_rect(cv::boundingRect(polygon), frame.cols, frame.rows);
+                if (b.area() > 0) {
+                    bounds.push_back(b);
+                    polygons_.push_back(std::move(polygon));
+                }
+            }
+        }
+    }
+    return bounds;
+}
+
+void mask_polygons(cv::Mat& frame, const std::vector<std::vector<cv::Point>>& polygons, MaskStyle style,
+                   int block_size) {
+    for (const auto& polygon : polygons) {
+        cv::Rect box = clamp_rect(cv::boundingRect(polygon), frame.cols, frame.rows);
+        if (box.area() <= 0) {
+            continue;
+        }
+        cv::Mat roi = frame(box);
+        cv::Mat masked = style == MaskStyle::Blur ? blur_roi(roi, block_size) : pixelate_roi(roi, block_size);
+        // Only the inside of the polygon changes; the rest of the bounding box stays sharp.
+        cv::Mat inside = cv::Mat::zeros(box.size(), CV_8UC1);
+        cv::fillPoly(inside, std::vector<std::vector<cv::Point>>{polygon}, cv::Scalar(255), cv::LINE_8, 0,
+                     -box.tl());
+        masked.copyTo(roi, inside);
+    }
+}
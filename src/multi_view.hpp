@@ -0,0 +1,132 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include "face_anonymizer.hpp"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Support for fisheye and 360 (equirectangular) cameras.
+//
+// YuNet is trained on normal (pinhole) images, so it misses the stretched
+// faces near the edge of a fisheye or 360 frame. Instead, the frame is cut
+// into a few normal-looking views, faces are detected in each view, and the
+// boxes are mapped back onto the original frame as polygons.
+//
+// The remap tables that produce the views only depend on the camera setup, so
+// they are built once at startup and every frame is just a cv::remap per view.
+
+enum class Projection { Fisheye, Equirect };
+
+// Accepts "fisheye" or "equirect" (also "360").
+bool parse_projection(const std::string& name, Projection& projection);
+
+struct ViewsConfig {
+    Projection projection = Projection::Fisheye;
+    // Field of view of the fisheye lens (equidistant model), in degrees.
+    double lens_fov_deg = 180.0;
+    // Number of views, spread evenly around the lens axis (or the horizon for 360).
+    int views = 4;
+    // Field of view of each view, in degrees.
+    double view_fov_deg = 90.0;
+    // Fisheye only: angle between each view and the lens axis. 55 suits ceiling mounts.
+    double view_tilt_deg = 55.0;
+    // Edge of each (square) view in pixels; this is also the detector input size.
+    int view_size = 640;
+};
+
+// Precomputed remap tables, one per view.
+class RemapViews {
+public:
+    RemapViews(const ViewsConfig& cfg, cv::Size source_size);
+
+    size_t count() const { return views_.size(); }
+    cv::Size view_size() const { return cv::Size(cfg_.view_size, cfg_.view_size); }
+    // Time spent building the tables.
+    double build_ms() const { return build_ms_; }
+
+    // Render view `index` of `source` into `out`.
+    void render(const cv::Mat& source, size_t index, cv::Mat& out) const;
+
+    // Outline of a view box in source pixels. For 360 frames a box on the left/right
+    // seam comes back as two polygons, one on each side.
+    std::vector<std::vector<cv::Point>> to_source(size_t index, const cv::Rect& box) const;
+
+private:
+    struct View {
+        // View axes in camera space: forward, right and down (unit vectors).
+        double f[3], r[3], d[3];
+        // Fixed-point tables for cv::remap (CV_16SC2 + CV_16UC1).
+        cv::Mat map1, map2;
+    };
+
+    // Source pixel seen along camera-space direction `dir` (unit vector).
+    // Returns false when the direction is outside the fisheye lens.
+    bool project(const double dir[3], cv::Point2f& pixel) const;
+    void direction(const View& view, double u, double v, double dir[3]) const;
+
+    ViewsConfig cfg_;
+    cv::Size source_size_;
+    double focal_ = 1.0;
+    double build_ms_ = 0.0;
+    std::vector<View> views_;
+};
+
+// Detects faces in all views in parallel, holds them per view, and keeps the
+// source-space polygons of the last frame.
+class MultiViewDetector {
+public:
+    // Returns an empty pointer if the model cannot be loaded.
+    static std::shared_ptr<MultiViewDetector> create(const AnonymizerConfig& cfg, const ViewsConfig& views,
+                                                     cv::Size source_size);
+
+    // Returns the bounding boxes of the polygons, for sinks that want rectangles.
+    std::vector<cv::Rect> detect(const cv::Mat& frame);
+
+    const std::vector<std::vector<cv::Point>>& polygons() const { return polygons_; }
+    const RemapViews& views() const { return views_; }
+
+    MultiViewDetector(RemapViews views, std::vector<YuNetDetector> detectors, int hold_frames);
+
+private:
+    RemapViews views_;
+    std::vector<YuNetDetector> detectors_;
+    std::vector<FaceTracker> trackers_;
+    std::vector<cv::Mat> view_frames_;
+    std::vector<std::vector<cv::Rect>> view_boxes_;
+    std::vector<std::vector<cv::Point>> polygons_;
+};
+
+// Mask the inside of each polygon in place.
+void mask_polygons(cv::Mat& frame, const std::vector<std::vector<cv::Point>>& polygons, MaskStyle style,
+                   int block_size);
+
+// Pipeline stages (see pipeline.hpp) around a shared MultiViewDetector.
+// Holding happens per view inside the detector, so the tracker stage passes boxes through.
+class MultiViewDetectorStage {
+public:
+    explicit MultiViewDetectorStage(std::shared_ptr<MultiViewDetector> d) : d_(std::move(d)) {}
+    std::vector<cv::Rect> detect(const cv::Mat& frame) { return d_->detect(frame); }
+
+private:
+    std::shared_ptr<MultiViewDetector> d_;
+};
+
+struct PassThroughTracker {
+    std::vector<cv::Rect> update(const std::vector<cv::Rect>& detected) { return detected; }
+};
+
+class PolygonMasker {
+public:
+    PolygonMasker(std::shared_ptr<MultiViewDetector> d, MaskStyle style, int block)
+        : d_(std::move(d)), style_(style), block_(block) {}
+    void mask(cv::Mat& frame, const std::vector<cv::Rect>&) { mask_polygons(frame, d_->polygons(), style_, block_); }
+
+private:
+    std::shared_ptr<MultiViewDetector> d_;
+    MaskStyle style_;
+    int block_;
+};
@@ -0,0 +1,797 @@
+#include "object_store.hpp"
+
+#include <curl/curl.h>
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+const int kMaxAttempts = 4;
+
+int64_t us_since(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t).count();
+}
+
+// ---------------------------------------------------------------------------
+// Signature V4
+// ---------------------------------------------------------------------------
+
+std::string hex(const unsigned char* data, size_t n) {
+    static const char* digits = "0123456789abcdef";
+    std::string out;
+    for (size_t i = 0; i < n; ++i) {
+        out += digits[data[i] >> 4];
+        out += digits[data[i] & 15];
+    }
+    return out;
+}
+
+std::string sha256_hex(const std::string& text) {
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(text.data()), text.size(), digest);
+    return hex(digest, sizeof(digest));
+}
+
+std::string hmac(const std::string& key, const std::string& text) {
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    HMAC(EVP_sha256(), key.data(), static_cast<int>(key.size()), reinterpret_cast<const unsigned char*>(text.data()),
+         text.size(), digest, &len);
+    return std::string(reinterpret_cast<char*>(digest), len);
+}
+
+// Percent-encode everything except unreserved characters (and '/' in paths).
+std::string uri_encode(const std::string& text, bool keep_slash) {
+    static const char* digits = "0123456789ABCDEF";
+    std::string out;
+    for (unsigned char c : text) {
+        if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || (keep_slash && c == '/')) {
+            out += static_cast<char>(c);
+        } else {
+            out += '%';
+            out += digits[c >> 4];
+            out += digits[c & 15];
+        }
+    }
+    return out;
+}
+
+// Text between <tag> and </tag>, or empty.
+std::string xml_value(const std::string& xml, const std::string& tag) {
+    size_t start = xml.find("<" + tag + ">");
+    if (start == std::string::npos) {
+        return "";
+    }
+    start += tag.size() + 2;
+    size_t end = xml.find("</" + tag + ">", start);
+    return end == std::string::npos ? "" : xml.substr(start, end - start);
+}
+
+// ---------------------------------------------------------------------------
+// HTTP
+// ---------------------------------------------------------------------------
+
+struct Request {
+    std::string method = "GET";
+    // Sorted by std::map, as the canonical request wants it.
+    std::map<std::string, std::string> query;
+    std::string range;
+    const char* body = nullptr;
+    size_t body_size = 0;
+};
+
+struct Response {
+    long status = 0;
+    std::string body;
+    std::string etag;
+    int64_t length = -1;
+    std::string error;
+
+    bool ok() const { return error.empty() && status >= 200 && status < 300; }
+    // Worth another try: network trouble, throttling or a server error.
+    bool retryable() const { return !error.empty() || status == 429 || status >= 500; }
+    std::string describe() const { return error.empty() ? "HTTP " + std::to_string(status) : error; }
+};
+
+size_t on_body(char* data, size_t size, size_t count, void* user) {
+    static_cast<Response*>(user)->body.append(data, size * count);
+    return size * count;
+}
+
+size_t on_header(char* data, size_t size, size_t count, void* user) {
+    std::string line(data, size * count);
+    if (line.size() > 5 && strncasecmp(line.c_str(), "etag:", 5) == 0) {
+        std::string value = line.substr(5);
+        value.erase(0, value.find_first_not_of(" \t"));
+        value.erase(value.find_last_not_of(" \t\r\n") + 1);
+        static_cast<Response*>(user)->etag = value;
+    }
+    return size * count;
+}
+
+// One easy handle per thread, so each thread keeps its own connection alive.
+class CurlHandle {
+public:
+    CurlHandle() {
+        static std::once_flag once;
+        std::call_once(once, [] { curl_global_init(CURL_GLOBAL_DEFAULT); });
+        curl_ = curl_easy_init();
+    }
+    ~CurlHandle() {
+        if (curl_) {
+            curl_easy_cleanup(curl_);
+        }
+    }
+    CurlHandle(const CurlHandle&) = delete;
+    CurlHandle& operator=(const CurlHandle&) = delete;
+
+    CURL* get() const { return curl_; }
+
+private:
+    CURL* curl_;
+};
+
+// One object on one endpoint, with signed requests.
+class S3Object {
+public:
+    bool init(const std::string& url, const ObjectStoreConfig& cfg) {
+        cfg_ = cfg;
+        if (!parse_s3_url(url, bucket_, key_)) {
+            std::cerr << "Not an s3://bucket/key URL: " << url << std::endl;
+            return false;
+        }
+        if (cfg_.access_key.empty() || cfg_.secret_key.empty()) {
+            std::cerr << "No S3 credentials: set AWS_ACCESS_KEY_ID and AWS_SECRET_ACCESS_KEY" << std::endl;
+            return false;
+        }
+        std::string endpoint = cfg_.endpoint.empty() ? "https://s3." + cfg_.region + ".amazonaws.com" : cfg_.endpoint;
+        while (!endpoint.empty() && endpoint.back() == '/') {
+            endpoint.pop_back();
+        }
+        size_t scheme = endpoint.find("://");
+        host_ = scheme == std::string::npos ? endpoint : endpoint.substr(scheme + 3);
+        base_ = scheme == std::string::npos ? "https://" + endpoint : endpoint;
+        path_ = "/" + uri_encode(bucket_, false) + "/" + uri_encode(key_, true);
+        return true;
+    }
+
+    const std::string& key() const { return key_; }
+
+    Response send(CURL* curl, const Request& req) const {
+        Response resp;
+        if (!curl) {
+            resp.error = "curl_easy_init failed";
+            return resp;
+        }
+
+        std::string query;
+        for (const auto& kv : req.query) {
+            query += (query.empty() ? "" : "&") + uri_encode(kv.first, false) + "=" + uri_encode(kv.second, false);
+        }
+
+        // Signature V4 with an unsigned payload: the body is not hashed, so
+        // large parts are not read twice. Transport integrity is left to TCP/TLS.
+        char amz_date[17];
+        char day[9];
+        std::time_t now = std::time(nullptr);
+        std::tm utc{};
+        gmtime_r(&now, &utc);
+        std::strftime(amz_date, sizeof(amz_date), "%Y%m%dT%H%M%SZ", &utc);
+        std::strftime(day, sizeof(day), "%Y%m%d", &utc);
+        const std::string payload = "UNSIGNED-PAYLOAD";
+
+        std::string headers = "host:" + host_ + "\nx-amz-content-sha256:" + payload + "\nx-amz-date:" + amz_date + "\n";
+        std::string signed_headers = "host;x-amz-content-sha256;x-amz-date";
+        if (!cfg_.session_token.empty()) {
+            headers += "x-amz-security-token:" + cfg_.session_token + "\n";
+            signed_headers += ";x-amz-security-token";
+        }
+        std::string canonical =
+            req.method + "\n" + path_ + "\n" + query + "\n" + headers + "\n" + signed_headers + "\n" + payload;
+        std::string scope = std::string(day) + "/" + cfg_.region + "/s3/aws4_request";
+        std::string to_sign = "AWS4-HMAC-SHA256\n" + std::string(amz_date) + "\n" + scope + "\n" + sha256_hex(canonical);
+        std::string key = hmac(hmac(hmac(hmac("AWS4" + cfg_.secret_key, day), cfg_.region), "s3"), "aws4_request");
+        std::string signature = hmac(key, to_sign);
+
+        curl_slist* list = nullptr;
+        list = curl_slist_append(list, ("Host: " + host_).c_str());
+        list = curl_slist_append(list, ("x-amz-content-sha256: " + payload).c_str());
+        list = curl_slist_append(list, ("x-amz-date: " + std::string(amz_date)).c_str());
+        if (!cfg_.session_token.empty()) {
+            list = curl_slist_append(list, ("x-amz-security-token: " + cfg_.session_token).c_str());
+        }
+        list = curl_slist_append(list, ("Authorization: AWS4-HMAC-SHA256 Credential=" + cfg_.access_key + "/" + scope +
+                                        ", SignedHeaders=" + signed_headers + ", Signature=" +
+                                        hex(reinterpret_cast<const unsigned char*>(signature.data()), signature.size()))
+                                           .c_str());
+        if (!req.range.empty()) {
+            list = curl_slist_append(list, ("Range: " + req.range).c_str());
+        }
+        // Send bodies right away instead of waiting for "100 Continue".
+        list = curl_slist_append(list, "Expect:");
+
+        std::string url = base_ + path_ + (query.empty() ? "" : "?" + query);
+        curl_easy_reset(curl);
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, list);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, on_body);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &resp);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, on_header);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &resp);
+        curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+        // Give up on a connection that stalls below 1 KB/s for 30 s; the caller retries.
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1024L);
+        curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 30L);
+        if (req.method == "HEAD") {
+            curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+        } else if (req.method != "GET") {
+            curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, req.method.c_str());
+        }
+        if (req.body || req.method == "POST" || req.method == "PUT") {
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDS, req.body ? req.body : "");
+            curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(req.body_size));
+        }
+
+        CURLcode rc = curl_easy_perform(curl);
+        if (rc != CURLE_OK) {
+            resp.error = curl_easy_strerror(rc);
+        } else {
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &resp.status);
+            curl_off_t length = -1;
+            curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+            resp.length = length;
+        }
+        curl_slist_free_all(list);
+        return resp;
+    }
+
+    // Retries with a growing pause; counts the retries in `stats`.
+    Response send_retrying(CURL* curl, const Request& req, ObjectStoreStats& stats) const {
+        Response resp;
+        for (int attempt = 0; attempt < kMaxAttempts; ++attempt) {
+            if (attempt > 0) {
+                stats.retries++;
+                std::this_thread::sleep_for(std::chrono::milliseconds(200 << attempt));
+            }
+            resp = send(curl, req);
+            if (resp.ok() || !resp.retryable()) {
+                break;
+            }
+        }
+        return resp;
+    }
+
+private:
+    ObjectStoreConfig cfg_;
+    std::string bucket_;
+    std::string key_;
+    std::string host_;
+    std::string base_;
+    std::string path_;
+};
+
+// A private directory holding one named pipe.
+bool make_pipe(const std::string& name, std::string& dir, std::string& fifo) {
+    const char* tmp = std::getenv("TMPDIR");
+    std::string pattern = std::string(tmp && *tmp ? tmp : "/tmp") + "/face_pixelate_s3_XXXXXX";
+    std::vector<char> buf(pattern.begin(), pattern.end());
+    buf.push_back('\0');
+    if (!mkdtemp(buf.data())) {
+        std::cerr << "Cannot create a temporary directory: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    dir = buf.data();
+    fifo = dir + "/" + name;
+    if (mkfifo(fifo.c_str(), 0600) != 0) {
+        std::cerr << "Cannot create pipe " << fifo << ": " << std::strerror(errno) << std::endl;
+        rmdir(dir.c_str());
+        dir.clear();
+        return false;
+    }
+    return true;
+}
+
+void remove_pipe(std::string& dir, const std::string& fifo) {
+    if (!dir.empty()) {
+        unlink(fifo.c_str());
+        rmdir(dir.c_str());
+        dir.clear();
+    }
+}
+
+// Last path component of the key, so the pipe keeps the file extension.
+std::string pipe_name(const std::string& key, const char* fallback) {
+    std::string name = key.substr(key.find_last_of('/') + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? fallback : std::string(fallback) + name.substr(dot);
+}
+
+}  // namespace
+
+void load_object_store_env(ObjectStoreConfig& cfg) {
+    auto fill = [](std::string& field, const char* name) {
+        const char* value = std::getenv(name);
+        if (field.empty() && value) {
+            field = value;
+        }
+    };
+    fill(cfg.endpoint, "AWS_ENDPOINT_URL");
+    fill(cfg.access_key, "AWS_ACCESS_KEY_ID");
+    fill(cfg.secret_key, "AWS_SECRET_ACCESS_KEY");
+    fill(cfg.session_token, "AWS_SESSION_TOKEN");
+    const char* region = std::getenv("AWS_REGION");
+    if (region && *region) {
+        cfg.region = region;
+    }
+}
+
+bool parse_s3_url(const std::string& url, std::string& bucket, std::string& key) {
+    if (!is_s3_url(url)) {
+        return false;
+    }
+    size_t slash = url.find('/', 5);
+    if (slash == std::string::npos || slash == 5 || slash + 1 >= url.size()) {
+        return false;
+    }
+    bucket = url.substr(5, slash - 5);
+    key = url.substr(slash + 1);
+    return true;
+}
+
+void ObjectStoreStats::print(std::ostream& out, const char* name) const {
+    double mb = bytes / (1024.0 * 1024.0);
+    double seconds = wall_us / 1e6;
+    out << name << ": " << mb << " MB in " << parts << " parts";
+    if (seconds > 0.0) {
+        out << ", " << mb / seconds << " MB/s";
+    }
+    out << ", " << retries << " retries";
+    if (upload) {
+        out << ", encoder waited " << stall_us / 1000.0 << " ms for upload slots" << std::endl;
+    } else {
+        out << ", first part after " << first_part_us / 1000.0 << " ms, decoder waited " << stall_us / 1000.0
+            << " ms after that" << std::endl;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Input: parallel ranged GETs -> pipe
+// ---------------------------------------------------------------------------
+
+struct S3InputStream::Impl {
+    ObjectStoreConfig cfg;
+    S3Object object;
+    std::string dir;
+    std::string fifo;
+    int64_t size = 0;
+    int64_t part_size = 0;
+    int parts = 0;
+    int window = 0;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    // Fetched parts not yet written to the pipe.
+    std::map<int, std::string> ready;
+    int next_fetch = 0;
+    int written = 0;
+    bool stop = false;
+    bool failed = false;
+
+    std::vector<std::thread> fetchers;
+    std::thread feeder;
+    std::shared_ptr<ObjectStoreStats> stats = std::make_shared<ObjectStoreStats>();
+    std::chrono::steady_clock::time_point started;
+
+    void fetch_loop() {
+        CurlHandle curl;
+        for (;;) {
+            int index;
+            {
+                // Stay at most `window` parts ahead of the pipe.
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&] { return stop || failed || next_fetch >= parts || next_fetch < written + window; });
+                if (stop || failed || next_fetch >= parts) {
+                    return;
+                }
+                index = next_fetch++;
+            }
+            int64_t first = index * part_size;
+            int64_t last = std::min(size, first + part_size) - 1;
+            Request req;
+            req.range = "bytes=" + std::to_string(first) + "-" + std::to_string(last);
+            Response resp = object.send_retrying(curl.get(), req, *stats);
+            bool ok = resp.ok() && static_cast<int64_t>(resp.body.size()) == last - first + 1;
+            if (!ok) {
+                std::cerr << "S3 read of " << object.key() << " part " << index << " failed: " << resp.describe()
+                          << std::endl;
+            }
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                if (ok) {
+                    ready[index] = std::move(resp.body);
+                } else {
+                    failed = true;
+                }
+            }
+            changed.notify_all();
+        }
+    }
+
+    void feed_loop() {
+        // A reader that quits early must not kill the process with SIGPIPE; the
+        // write below fails with EPIPE instead.
+        sigset_t pipe_signal;
+        sigemptyset(&pipe_signal);
+        sigaddset(&pipe_signal, SIGPIPE);
+        pthread_sigmask(SIG_BLOCK, &pipe_signal, nullptr);
+
+        // Opening a pipe for writing without a reader fails right away with
+        // O_NONBLOCK, so this loop can still notice close().
+        int fd = -1;
+        while (fd < 0) {
+            fd = ::open(fifo.c_str(), O_WRONLY | O_NONBLOCK);
+            if (fd < 0) {
+                std::lock_guard<std::mutex> guard(lock);
+                if (stop) {
+                    return;
+                }
+            }
+            if (fd < 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+        for (int index = 0; index < parts; ++index) {
+            std::string data;
+            {
+                auto wait_start = std::chrono::steady_clock::now();
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&] { return stop || failed || ready.count(index) > 0; });
+                if (!ready.count(index)) {
+                    break;
+                }
+                data = std::move(ready[index]);
+                ready.erase(index);
+                if (index == 0) {
+                    stats->first_part_us = us_since(started);
+                } else {
+                    stats->stall_us += us_since(wait_start);
+                }
+            }
+            size_t done = 0;
+            while (done < data.size()) {
+                ssize_t n = ::write(fd, data.data() + done, data.size() - done);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    break;
+                }
+                done += static_cast<size_t>(n);
+            }
+            stats->bytes += done;
+            stats->parts++;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                written++;
+                // The reader went away: nothing more to fetch.
+                stop = stop || done < data.size();
+            }
+            changed.notify_all();
+            if (done < data.size()) {
+                break;
+            }
+        }
+        ::close(fd);
+        stats->wall_us = us_since(started);
+    }
+};
+
+S3InputStream::S3InputStream() : impl_(std::make_unique<Impl>()) {}
+
+S3InputStream::~S3InputStream() {
+    close();
+}
+
+bool S3InputStream::open(const std::string& url, const ObjectStoreConfig& cfg) {
+    Impl& s = *impl_;
+    s.cfg = cfg;
+    if (!s.object.init(url, cfg)) {
+        return false;
+    }
+    s.started = std::chrono::steady_clock::now();
+    CurlHandle curl;
+    Request head;
+    head.method = "HEAD";
+    Response resp = s.object.send_retrying(curl.get(), head, *s.stats);
+    if (!resp.ok() || resp.length < 0) {
+        std::cerr << "Cannot open " << url << ": " << resp.describe() << std::endl;
+        return false;
+    }
+    s.size = resp.length;
+    s.part_size = static_cast<int64_t>(std::max(1, cfg.part_mb)) * 1024 * 1024;
+    s.parts = static_cast<int>((s.size + s.part_size - 1) / s.part_size);
+    const int connections = std::max(1, std::min(cfg.connections, std::max(1, s.parts)));
+    s.window = std::max(connections, connections * cfg.prefetch_per_connection);
+    if (!make_pipe(pipe_name(s.object.key(), "input"), s.dir, s.fifo)) {
+        return false;
+    }
+    for (int i = 0; i < connections; ++i) {
+        s.fetchers.emplace_back([&s] { s.fetch_loop(); });
+    }
+    s.feeder = std::thread([&s] { s.feed_loop(); });
+    return true;
+}
+
+const std::string& S3InputStream::path() const {
+    return impl_->fifo;
+}
+
+void S3InputStream::close() {
+    Impl& s = *impl_;
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        s.stop = true;
+    }
+    s.changed.notify_all();
+    if (s.feeder.joinable()) {
+        s.feeder.join();
+    }
+    for (std::thread& t : s.fetchers) {
+        t.join();
+    }
+    s.fetchers.clear();
+    remove_pipe(s.dir, s.fifo);
+}
+
+std::shared_ptr<const ObjectStoreStats> S3InputStream::stats() const {
+    return impl_->stats;
+}
+
+// ---------------------------------------------------------------------------
+// Output: pipe -> multipart upload
+// ---------------------------------------------------------------------------
+
+struct S3OutputStream::Impl {
+    ObjectStoreConfig cfg;
+    S3Object object;
+    std::string dir;
+    std::string fifo;
+    size_t part_size = 0;
+    int connections = 1;
+    std::string upload_id;
+
+    std::mutex lock;
+    std::condition_variable changed;
+    // Full parts waiting for an uploader: (part number, bytes).
+    std::deque<std::pair<int, std::string>> queue;
+    std::vector<std::string> etags;
+    bool eof = false;
+    bool failed = false;
+    std::atomic<bool> reader_done{false};
+
+    std::thread reader;
+    std::vector<std::thread> uploaders;
+    std::shared_ptr<ObjectStoreStats> stats = std::make_shared<ObjectStoreStats>();
+    std::chrono::steady_clock::time_point started;
+
+    // Hand a part to the uploaders; waits while all of them are busy so memory
+    // stays bounded. The upload itself is only started with the first part.
+    void enqueue(std::string data, CurlHandle& curl) {
+        auto wait_start = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> guard(lock);
+        if (failed) {
+            return;
+        }
+        if (upload_id.empty()) {
+            guard.unlock();
+            Request req;
+            req.method = "POST";
+            req.query["uploads"] = "";
+            Response resp = object.send_retrying(curl.get(), req, *stats);
+            guard.lock();
+            upload_id = xml_value(resp.body, "UploadId");
+            if (!resp.ok() || upload_id.empty()) {
+                std::cerr << "S3 upload of " << object.key() << " could not start: " << resp.describe() << std::endl;
+                failed = true;
+                changed.notify_all();
+                return;
+            }
+            wait_start = std::chrono::steady_clock::now();
+        }
+        changed.wait(guard, [&] { return failed || queue.size() < static_cast<size_t>(connections); });
+        stats->stall_us += us_since(wait_start);
+        etags.emplace_back();
+        queue.emplace_back(static_cast<int>(etags.size()), std::move(data));
+        changed.notify_all();
+    }
+
+    void read_loop() {
+        CurlHandle curl;
+        // Blocks until the encoder opens the pipe (or close() does).
+        int fd = ::open(fifo.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            std::string part;
+            part.reserve(part_size);
+            std::vector<char> buf(1 << 16);
+            for (;;) {
+                ssize_t n = ::read(fd, buf.data(), buf.size());
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n <= 0) {
+                    break;
+                }
+                part.append(buf.data(), static_cast<size_t>(n));
+                if (part.size() >= part_size) {
+                    enqueue(std::move(part), curl);
+                    part = std::string();
+                    part.reserve(part_size);
+                }
+            }
+            // The last part may be smaller than the minimum.
+            if (!part.empty()) {
+                enqueue(std::move(part), curl);
+            }
+            ::close(fd);
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        eof = true;
+        reader_done = true;
+        changed.notify_all();
+    }
+
+    void upload_loop() {
+        CurlHandle curl;
+        for (;;) {
+            std::pair<int, std::string> part;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                changed.wait(guard, [&] { return !queue.empty() || eof || failed; });
+                if (queue.empty() || failed) {
+                    return;
+                }
+                part = std::move(queue.front());
+                queue.pop_front();
+                // Wake the reader: there is room for another part.
+                changed.notify_all();
+            }
+            Request req;
+            req.method = "PUT";
+            req.query["partNumber"] = std::to_string(part.first);
+            req.query["uploadId"] = upload_id;
+            req.body = part.second.data();
+            req.body_size = part.second.size();
+            Response resp = object.send_retrying(curl.get(), req, *stats);
+            std::lock_guard<std::mutex> guard(lock);
+            if (resp.ok() && !resp.etag.empty()) {
+                etags[part.first - 1] = resp.etag;
+                stats->bytes += part.second.size();
+                stats->parts++;
+            } else {
+                std::cerr << "S3 upload of " << object.key() << " part " << part.first
+                          << " failed: " << resp.describe() << std::endl;
+                failed = true;
+            }
+            changed.notify_all();
+        }
+    }
+};
+
+S3OutputStream::S3OutputStream() : impl_(std::make_unique<Impl>()) {}
+
+S3OutputStream::~S3OutputStream() {
+    close();
+}
+
+bool S3OutputStream::open(const std::string& url, const ObjectStoreConfig& cfg) {
+    Impl& s = *impl_;
+    s.cfg = cfg;
+    if (!s.object.init(url, cfg)) {
+        return false;
+    }
+    s.stats->upload = true;
+    s.part_size = static_cast<size_t>(std::max(5, cfg.part_mb)) * 1024 * 1024;
+    s.connections = std::max(1, cfg.connections);
+    if (!make_pipe(pipe_name(s.object.key(), "output"), s.dir, s.fifo)) {
+        return false;
+    }
+    s.started = std::chrono::steady_clock::now();
+    s.reader = std::thread([&s] { s.read_loop(); });
+    for (int i = 0; i < s.connections; ++i) {
+        s.uploaders.emplace_back([&s] { s.upload_loop(); });
+    }
+    return true;
+}
+
+const std::string& S3OutputStream::path() const {
+    return impl_->fifo;
+}
+
+bool S3OutputStream::close() {
+    Impl& s = *impl_;
+    if (!s.reader.joinable()) {
+        return false;
+    }
+    // If the encoder never opened the pipe, the reader is still blocked in
+    // open(): opening the write end once lets it see end of file. That fails
+    // until the reader has actually got to open(), hence the loop.
+    while (!s.reader_done) {
+        int fd = ::open(s.fifo.c_str(), O_WRONLY | O_NONBLOCK);
+        if (fd >= 0) {
+            ::close(fd);
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    s.reader.join();
+    for (std::thread& t : s.uploaders) {
+        t.join();
+    }
+    s.uploaders.clear();
+    remove_pipe(s.dir, s.fifo);
+
+    CurlHandle curl;
+    bool ok = false;
+    if (s.upload_id.empty()) {
+        if (!s.failed) {
+            std::cerr << "S3 upload of " << s.object.key() << ": nothing was written" << std::endl;
+        }
+    } else if (!s.failed) {
+        std::string body = "<CompleteMultipartUpload>";
+        for (size_t i = 0; i < s.etags.size(); ++i) {
+            body += "<Part><PartNumber>" + std::to_string(i + 1) + "</PartNumber><ETag>" + s.etags[i] + "</ETag></Part>";
+        }
+        body += "</CompleteMultipartUpload>";
+        Request req;
+        req.method = "POST";
+        req.query["uploadId"] = s.upload_id;
+        req.body = body.data();
+        req.body_size = body.size();
+        Response resp = s.object.send_retrying(curl.get(), req, *s.stats);
+        // S3 can answer 200 and still report an error in the body.
+        ok = resp.ok() && resp.body.find("<Error>") == std::string::npos;
+        if (!ok) {
+            std::cerr << "S3 upload of " << s.object.key() << " could not be completed: " << resp.describe()
+                      << std::endl;
+        }
+    }
+    if (!ok && !s.upload_id.empty()) {
+        // Drop the stored parts so they are not billed.
+        Request req;
+        req.method = "DELETE";
+        req.query["uploadId"] = s.upload_id;
+        s.object.send(curl.get(), req);
+    }
+    s.upload_id.clear();
+    s.stats->wall_us = us_since(s.started);
+    return ok;
+}
+
+std::shared_ptr<const ObjectStoreStats> S3OutputStream::stats() const {
+    return impl_->stats;
+}
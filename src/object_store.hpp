@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+// Streaming input and output for S3-compatible object storage (needs make S3=1).
+//
+// OpenCV only opens local paths and URLs it knows, so each stream hands it a
+// named pipe (FIFO) instead of a downloaded file:
+//   - input: the object is fetched in fixed-size parts with ranged GETs over
+//     several connections, a few parts ahead of the decoder, and fed into the
+//     pipe in order. Decoding starts as soon as the first part is in.
+//   - output: the encoder writes into the pipe, and every full part is sent as
+//     one part of a multipart upload while the next one is being encoded.
+// Requests are signed with AWS Signature V4, so AWS S3, MinIO, Ceph RGW and
+// similar servers all work. Buckets are addressed path-style (endpoint/bucket/key).
+struct ObjectStoreConfig {
+    // e.g. "http://127.0.0.1:9000" (empty = https://s3.<region>.amazonaws.com).
+    std::string endpoint;
+    std::string region = "us-east-1";
+    std::string access_key;
+    std::string secret_key;
+    // Only for temporary credentials.
+    std::string session_token;
+    // Part size for ranged reads and multipart uploads (S3 needs at least 5 MB).
+    int part_mb = 8;
+    // Parallel connections per stream.
+    int connections = 4;
+    // Parts kept downloaded ahead of the decoder, per connection.
+    int prefetch_per_connection = 2;
+};
+
+// Fill empty fields from AWS_ENDPOINT_URL, AWS_REGION, AWS_ACCESS_KEY_ID,
+// AWS_SECRET_ACCESS_KEY and AWS_SESSION_TOKEN.
+void load_object_store_env(ObjectStoreConfig& cfg);
+
+// "s3://bucket/some/key.mkv". Inline so builds without S3=1 can still recognize them.
+inline bool is_s3_url(const std::string& text) {
+    return text.compare(0, 5, "s3://") == 0;
+}
+bool parse_s3_url(const std::string& url, std::string& bucket, std::string& key);
+
+struct ObjectStoreStats {
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> parts{0};
+    std::atomic<uint64_t> retries{0};
+    // Input: time until the first part arrived.
+    std::atomic<int64_t> first_part_us{0};
+    // Input: time the decoder side waited for a part after that.
+    // Output: time the encoder side waited for a free upload slot.
+    std::atomic<int64_t> stall_us{0};
+    std::atomic<int64_t> wall_us{0};
+    bool upload = false;
+
+    void print(std::ostream& out, const char* name) const;
+};
+
+// An object read as a local pipe. One reader, start to end: the container must
+// be readable without seeking (MKV, WebM, MPEG-TS, AVI, or MP4 with the index
+// at the front, i.e. "faststart").
+class S3InputStream {
+public:
+    S3InputStream();
+    ~S3InputStream();
+
+    // Look the object up, create the pipe and start fetching. Prints why on failure.
+    bool open(const std::string& url, const ObjectStoreConfig& cfg);
+
+    // Path to give to cv::VideoCapture.
+    const std::string& path() const;
+
+    // Stop fetching and remove the pipe. Call after the capture is released.
+    void close();
+
+    std::shared_ptr<const ObjectStoreStats> stats() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+// An object written through a local pipe. The pipe keeps the key's extension so
+// the encoder picks the container from it; use one that can be written without
+// seeking back (.mkv, .webm, .ts).
+class S3OutputStream {
+public:
+    S3OutputStream();
+    ~S3OutputStream();
+
+    // Create the pipe and start the uploader. Prints why on failure.
+    bool open(const std::string& url, const ObjectStoreConfig& cfg);
+
+    // Path to give to cv::VideoWriter (with cv::CAP_FFMPEG).
+    const std::string& path() const;
+
+    // Call after the writer is released: uploads the last part and completes the
+    // upload. On any failure the upload is aborted and false is returned.
+    bool close();
+
+    std::shared_ptr<const ObjectStoreStats> stats() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
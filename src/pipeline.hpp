@@ -0,0 +1,163 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Frame pipeline assembled from five stage policies:
+//
+//   Source:   bool read(cv::Mat& frame)                                  false = end of input
+//   Detector: std::vector<cv::Rect> detect(const cv::Mat& frame)         padded face boxes
+//   Tracker:  std::vector<cv::Rect> update(const std::vector<cv::Rect>&) boxes to mask
+//   Masker:   void mask(cv::Mat& frame, const std::vector<cv::Rect>&)
+//   Sink:     bool write(cv::Mat& frame, const std::vector<cv::Rect>&)   false = stop
+//
+// With concrete policy types every stage call is a direct call that the compiler
+// can inline. With std::unique_ptr<Interface> stages (RuntimePipeline below) the
+// same loop goes through virtual calls, so stages can be picked from CLI flags.
+
+namespace pipeline_detail {
+template <class T>
+T& stage(T& s) { return s; }
+template <class T>
+T& stage(std::unique_ptr<T>& s) { return *s; }
+}  // namespace pipeline_detail
+
+template <class Source, class Detector, class Tracker, class Masker, class Sink>
+class Pipeline {
+public:
+    Pipeline(Source source, Detector detector, Tracker tracker, Masker masker, Sink sink)
+        : source_(std::move(source)),
+          detector_(std::move(detector)),
+          tracker_(std::move(tracker)),
+          masker_(std::move(masker)),
+          sink_(std::move(sink)) {}
+
+    // Process one frame. Returns false when the source is done or the sink wants to stop.
+    bool step() {
+        using pipeline_detail::stage;
+        if (!stage(source_).read(frame_) || frame_.empty()) {
+            return false;
+        }
+        boxes_ = stage(tracker_).update(stage(detector_).detect(frame_));
+        stage(masker_).mask(frame_, boxes_);
+        frames_++;
+        return stage(sink_).write(frame_, boxes_);
+    }
+
+    // Run until the input ends, the sink stops, or `max_frames` (if >= 0) is reached.
+    long run(long max_frames = -1) {
+        while ((max_frames < 0 || frames_ < max_frames) && step()) {
+        }
+        return frames_;
+    }
+
+    long frames() const { return frames_; }
+
+private:
+    Source source_;
+    Detector detector_;
+    Tracker tracker_;
+    Masker masker_;
+    Sink sink_;
+    cv::Mat frame_;
+    std::vector<cv::Rect> boxes_;
+    long frames_ = 0;
+};
+
+// Runtime-selectable stage interfaces.
+struct FrameSource {
+    virtual ~FrameSource() = default;
+    virtual bool read(cv::Mat& frame) = 0;
+};
+
+struct FaceDetector {
+    virtual ~FaceDetector() = default;
+    virtual std::vector<cv::Rect> detect(const cv::Mat& frame) = 0;
+};
+
+struct BoxTracker {
+    virtual ~BoxTracker() = default;
+    virtual std::vector<cv::Rect> update(const std::vector<cv::Rect>& detected) = 0;
+};
+
+struct FrameMasker {
+    virtual ~FrameMasker() = default;
+    virtual void mask(cv::Mat& frame, const std::vector<cv::Rect>& boxes) = 0;
+};
+
+struct FrameSink {
+    virtual ~FrameSink() = default;
+    virtual bool write(cv::Mat& frame, const std::vector<cv::Rect>& boxes) = 0;
+};
+
+using RuntimePipeline = Pipeline<
+    std::unique_ptr<FrameSource>,
+    std::unique_ptr<FaceDetector>,
+    std::unique_ptr<BoxTracker>,
+    std::unique_ptr<FrameMasker>,
+    std::unique_ptr<FrameSink>>;
+
+// Adapters that put a concrete policy behind one of the interfaces above.
+template <class Policy>
+class VirtualSource final : public FrameSource {
+public:
+    explicit VirtualSource(Policy p) : p_(std::move(p)) {}
+    bool read(cv::Mat& frame) override { return p_.read(frame); }
+
+private:
+    Policy p_;
+};
+
+template <class Policy>
+class VirtualDetector final : public FaceDetector {
+public:
+    explicit VirtualDetector(Policy p) : p_(std::move(p)) {}
+    std::vector<cv::Rect> detect(const cv::Mat& frame) override { return p_.detect(frame); }
+
+private:
+    Policy p_;
+};
+
+template <class Policy>
+class VirtualTracker final : public BoxTracker {
+public:
+    explicit VirtualTracker(Policy p) : p_(std::move(p)) {}
+    std::vector<cv::Rect> update(const std::vector<cv::Rect>& detected) override { return p_.update(detected); }
+
+private:
+    Policy p_;
+};
+
+template <class Policy>
+class VirtualMasker final : public FrameMasker {
+public:
+    explicit VirtualMasker(Policy p) : p_(std::move(p)) {}
+    void mask(cv::Mat& frame, const std::vector<cv::Rect>& boxes) override { p_.mask(frame, boxes); }
+
+private:
+    Policy p_;
+};
+
+template <class Policy>
+class VirtualSink final : public FrameSink {
+public:
+    explicit VirtualSink(Policy p) : p_(std::move(p)) {}
+    bool write(cv::Mat& frame, const std::vector<cv::Rect>& boxes) override { return p_.write(frame, boxes); }
+
+private:
+    Policy p_;
+};
+
+template <class P>
+std::unique_ptr<FrameSource> make_source(P p) { return std::make_unique<VirtualSource<P>>(std::move(p)); }
+template <class P>
+std::unique_ptr<FaceDetector> make_detector(P p) { return std::make_unique<VirtualDetector<P>>(std::move(p)); }
+template <class P>
+std::unique_ptr<BoxTracker> make_tracker(P p) { return std::make_unique<VirtualTracker<P>>(std::move(p)); }
+template <class P>
+std::unique_ptr<FrameMasker> make_masker(P p) { return std::make_unique<VirtualMasker<P>>(std::move(p)); }
+template <class P>
+std::unique_ptr<FrameSink> make_sink(P p) { return std::make_unique<VirtualSink<P>>(std::move(p)); }
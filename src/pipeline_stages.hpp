@@ -0,0 +1,79 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "face_anonymizer.hpp"
+#include "pipeline.hpp"
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Concrete stage policies. Each one can be used directly as a Pipeline
+// template argument or wrapped with make_source()/make_sink()/... for RuntimePipeline.
+
+// Reads frames from an already opened capture (owned by the caller).
+class CaptureSource {
+public:
+    explicit CaptureSource(cv::VideoCapture& cap) : cap_(&cap) {}
+    bool read(cv::Mat& frame) { return cap_->read(frame); }
+
+private:
+    cv::VideoCapture* cap_;
+};
+
+// Replays one frame a fixed number of times. Handy for benchmarks.
+class RepeatSource {
+public:
+    RepeatSource(cv::Mat frame, long count) : frame_(std::move(frame)), remaining_(count) {}
+    bool read(cv::Mat& frame) {
+        if (remaining_-- <= 0) {
+            return false;
+        }
+        // Masking is in place, so hand out a fresh copy every time.
+        frame_.copyTo(frame);
+        return true;
+    }
+
+private:
+    cv::Mat frame_;
+    long remaining_;
+};
+
+// Pixelates or blurs every box.
+class MosaicMasker {
+public:
+    MosaicMasker(MaskStyle style, int block_size) : style_(style), block_size_(block_size) {}
+    void mask(cv::Mat& frame, const std::vector<cv::Rect>& boxes) { mask_boxes(frame, boxes, style_, block_size_); }
+
+private:
+    MaskStyle style_;
+    int block_size_;
+};
+
+// Discards frames.
+struct NullSink {
+    bool write(cv::Mat&, const std::vector<cv::Rect>&) { return true; }
+};
+
+// Forwards each frame to several sinks in order. Stops when any sink stops.
+class MultiSink final : public FrameSink {
+public:
+    void add(std::unique_ptr<FrameSink> sink) { sinks_.push_back(std::move(sink)); }
+    bool write(cv::Mat& frame, const std::vector<cv::Rect>& boxes) override {
+        bool keep_going = true;
+        for (auto& sink : sinks_) {
+            keep_going = sink->write(frame, boxes) && keep_going;
+        }
+        return keep_going;
+    }
+
+private:
+    std::vector<std::unique_ptr<FrameSink>> sinks_;
+};
+
+// Fixed configuration for headless capture: every stage call is resolved at compile time.
+// Only the sink varies (prefork workers, archive workers).
+template <class Sink>
+using CaptureMaskPipeline = Pipeline<CaptureSource, YuNetDetector, FaceTracker, MosaicMasker, Sink>;
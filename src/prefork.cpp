@@ -0,0 +1,393 @@
+#include "prefork.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Set by SIGINT/SIGTERM. The handler is inherited by workers, so both sides use it.
+volatile std::sig_atomic_t g_stop = 0;
+
+void on_stop_signal(int) {
+    g_stop = 1;
+}
+
+void install_stop_handler() {
+    struct sigaction sa {};
+    sa.sa_handler = on_stop_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+}
+
+double ms_since(Clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - t).count();
+}
+
+double mb(long kb) {
+    return kb / 1024.0;
+}
+
+struct Worker {
+    size_t index = 0;
+    std::string input;
+    pid_t pid = -1;
+    // Read end of the status pipe (-1 = closed).
+    int fd = -1;
+    Clock::time_point forked;
+
+    int starts = 0;
+    int crashes = 0;
+    int crashes_in_row = 0;
+    bool restart_pending = false;
+    Clock::time_point restart_at;
+    bool done = false;
+    bool failed = false;
+
+    // Times of the last start, -1 until reported.
+    double spawn_ms = -1.0;
+    double first_frame_ms = -1.0;
+    // Last sample while it was running.
+    ProcessMemory mem;
+    bool has_mem = false;
+};
+
+bool start_worker(Worker& w, const std::vector<Worker>& all, const WorkerBody& body) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        std::perror("pipe");
+        return false;
+    }
+    // Anything still buffered would be written twice, once by each process.
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+
+    Clock::time_point forked = Clock::now();
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        // Worker: keep only our own end of our own pipe.
+        close(fds[0]);
+        for (const Worker& other : all) {
+            if (other.fd >= 0) {
+                close(other.fd);
+            }
+        }
+        int code = 1;
+        try {
+            WorkerLink link(fds[1]);
+            code = body(w.index, w.input, link);
+        } catch (const std::exception& e) {
+            std::cerr << "worker " << w.index << ": " << e.what() << std::endl;
+        }
+        std::cout.flush();
+        std::cerr.flush();
+        std::fflush(nullptr);
+        // Skip the supervisor's static destructors and atexit handlers.
+        _exit(code);
+    }
+
+    close(fds[1]);
+    // The supervisor polls many pipes and must never block on one.
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    w.pid = pid;
+    w.fd = fds[0];
+    w.forked = forked;
+    w.starts++;
+    w.restart_pending = false;
+    w.spawn_ms = -1.0;
+    w.first_frame_ms = -1.0;
+    return true;
+}
+
+// Read status bytes the worker sent. Closes the pipe at end of file.
+void read_status(Worker& w) {
+    char buf[16];
+    ssize_t n;
+    while ((n = read(w.fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; ++i) {
+            if (buf[i] == 'r' && w.spawn_ms < 0.0) {
+                w.spawn_ms = ms_since(w.forked);
+                std::cout << "worker " << w.index << " (pid " << w.pid << ") up in " << w.spawn_ms << " ms"
+                          << std::endl;
+            } else if (buf[i] == 'f' && w.first_frame_ms < 0.0) {
+                w.first_frame_ms = ms_since(w.forked);
+                std::cout << "worker " << w.index << " first frame after " << w.first_frame_ms << " ms" << std::endl;
+            }
+        }
+    }
+    if (n == 0 || (n < 0 && errno != EINTR && errno != EAGAIN)) {
+        close(w.fd);
+        w.fd = -1;
+    }
+}
+
+void handle_exit(Worker& w, int status, const PreforkConfig& cfg) {
+    if (w.fd >= 0) {
+        read_status(w);
+        if (w.fd >= 0) {
+            close(w.fd);
+            w.fd = -1;
+        }
+    }
+    w.pid = -1;
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        w.done = true;
+        std::cout << "worker " << w.index << " finished " << w.input << std::endl;
+        return;
+    }
+
+    std::ostringstream why;
+    if (WIFSIGNALED(status)) {
+        why << "killed by signal " << WTERMSIG(status) << " (" << strsignal(WTERMSIG(status)) << ")";
+    } else {
+        why << "exited with code " << WEXITSTATUS(status);
+    }
+    if (g_stop) {
+        // Shutting down: whatever happened now is not a crash to recover from.
+        w.done = true;
+        w.failed = !WIFEXITED(status);
+        std::cout << "worker " << w.index << " stopped, " << why.str() << std::endl;
+        return;
+    }
+
+    w.crashes++;
+    if (ms_since(w.forked) >= cfg.healthy_after_ms) {
+        w.crashes_in_row = 0;
+    }
+    w.crashes_in_row++;
+    if (w.crashes_in_row > cfg.max_restarts) {
+        w.done = true;
+        w.failed = true;
+        std::cerr << "worker " << w.index << " " << why.str() << "; giving up on " << w.input << " after "
+                  << w.crashes_in_row << " crashes in a row" << std::endl;
+        return;
+    }
+    // First restart is immediate; a worker that keeps crashing backs off up to 2 s.
+    int delay_ms = w.crashes_in_row == 1 ? 0 : std::min(2000, 100 << std::min(w.crashes_in_row - 2, 5));
+    w.restart_pending = true;
+    w.restart_at = Clock::now() + std::chrono::milliseconds(delay_ms);
+    std::cerr << "worker " << w.index << " " << why.str() << "; restarting in " << delay_ms << " ms" << std::endl;
+}
+
+void print_memory(const std::vector<Worker>& workers) {
+    long shared = 0, priv = 0, pss = 0;
+    int n = 0;
+    for (const Worker& w : workers) {
+        if (w.pid > 0 && w.has_mem) {
+            shared += w.mem.shared_kb;
+            priv += w.mem.private_kb;
+            pss += w.mem.pss_kb;
+            n++;
+        }
+    }
+    ProcessMemory self;
+    bool has_self = read_process_memory(getpid(), self);
+    std::cout << "workers: " << n << " running";
+    if (n > 0) {
+        std::cout << "; per worker " << mb(shared / n) << " MB shared, " << mb(priv / n) << " MB private (PSS "
+                  << mb(pss / n) << " MB)";
+    }
+    if (has_self) {
+        std::cout << "; supervisor RSS " << mb(self.rss_kb) << " MB";
+    }
+    std::cout << std::endl;
+}
+
+}  // namespace
+
+bool read_input_list(const std::string& path, std::vector<std::string>& inputs) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        size_t begin = line.find_first_not_of(" \t\r");
+        if (begin == std::string::npos || line[begin] == '#') {
+            continue;
+        }
+        size_t end = line.find_last_not_of(" \t\r");
+        inputs.push_back(line.substr(begin, end - begin + 1));
+    }
+    return !inputs.empty();
+}
+
+bool read_process_memory(pid_t pid, ProcessMemory& mem) {
+    std::ifstream in("/proc/" + std::to_string(pid) + "/smaps_rollup");
+    if (!in) {
+        return false;
+    }
+    mem = ProcessMemory();
+    std::string key;
+    long kb = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream fields(line);
+        if (!(fields >> key >> kb)) {
+            continue;
+        }
+        if (key == "Rss:") {
+            mem.rss_kb = kb;
+        } else if (key == "Pss:") {
+            mem.pss_kb = kb;
+        } else if (key == "Shared_Clean:" || key == "Shared_Dirty:") {
+            mem.shared_kb += kb;
+        } else if (key == "Private_Clean:" || key == "Private_Dirty:") {
+            mem.private_kb += kb;
+        }
+    }
+    return mem.rss_kb > 0;
+}
+
+bool WorkerLink::stop_requested() {
+    return g_stop != 0;
+}
+
+void WorkerLink::send(char c) {
+    if (fd_ >= 0 && write(fd_, &c, 1) != 1) {
+        // Supervisor is gone; keep working, there is nobody to tell.
+        fd_ = -1;
+    }
+}
+
+int run_supervisor(const PreforkConfig& cfg, const std::vector<std::string>& inputs, const WorkerBody& body) {
+    install_stop_handler();
+    // A worker writing to a closed status pipe must not die from it.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    std::vector<Worker> workers(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        workers[i].index = i;
+        workers[i].input = inputs[i];
+        if (!start_worker(workers[i], workers, body)) {
+            workers[i].done = true;
+            workers[i].failed = true;
+        }
+    }
+
+    Clock::time_point last_sample = Clock::now();
+    Clock::time_point last_status = Clock::now();
+    Clock::time_point stop_sent;
+    bool stopping = false;
+    while (true) {
+        bool running = false;
+        bool pending = false;
+        for (const Worker& w : workers) {
+            running = running || w.pid > 0;
+            pending = pending || w.restart_pending;
+        }
+        if (!running && (!pending || g_stop)) {
+            break;
+        }
+
+        // Pass a shutdown on to the workers (they may not share our terminal),
+        // and stop waiting for ones that do not react.
+        if (g_stop && !stopping) {
+            stopping = true;
+            stop_sent = Clock::now();
+            for (Worker& w : workers) {
+                w.restart_pending = false;
+                if (w.pid > 0) {
+                    kill(w.pid, SIGTERM);
+                }
+            }
+        } else if (stopping && ms_since(stop_sent) > 5000.0) {
+            for (Worker& w : workers) {
+                if (w.pid > 0) {
+                    kill(w.pid, SIGKILL);
+                }
+            }
+        }
+
+        for (Worker& w : workers) {
+            if (w.restart_pending && !g_stop && Clock::now() >= w.restart_at && !start_worker(w, workers, body)) {
+                w.restart_pending = false;
+                w.done = true;
+                w.failed = true;
+            }
+        }
+
+        // Wait for status bytes (or just 100 ms) so the loop does not spin.
+        std::vector<pollfd> fds;
+        std::vector<Worker*> owners;
+        for (Worker& w : workers) {
+            if (w.fd >= 0) {
+                fds.push_back(pollfd{w.fd, POLLIN, 0});
+                owners.push_back(&w);
+            }
+        }
+        if (poll(fds.data(), fds.size(), 100) > 0) {
+            for (size_t i = 0; i < fds.size(); ++i) {
+                if (fds[i].revents != 0) {
+                    read_status(*owners[i]);
+                }
+            }
+        }
+
+        // Memory is sampled while workers run; it is gone once they exit.
+        if (ms_since(last_sample) >= 1000.0) {
+            for (Worker& w : workers) {
+                if (w.pid > 0) {
+                    w.has_mem = read_process_memory(w.pid, w.mem) || w.has_mem;
+                }
+            }
+            last_sample = Clock::now();
+        }
+        if (cfg.status_interval_ms > 0 && ms_since(last_status) >= cfg.status_interval_ms) {
+            print_memory(workers);
+            last_status = Clock::now();
+        }
+
+        int status = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (Worker& w : workers) {
+                if (w.pid == pid) {
+                    handle_exit(w, status, cfg);
+                    break;
+                }
+            }
+        }
+    }
+
+    int failed = 0;
+    for (const Worker& w : workers) {
+        failed += w.failed ? 1 : 0;
+        std::cout << "worker " << w.index << " (" << w.input << "): " << w.starts << " starts, " << w.crashes
+                  << " crashes";
+        if (w.spawn_ms >= 0.0) {
+            std::cout << ", spin-up " << w.spawn_ms << " ms";
+        }
+        if (w.first_frame_ms >= 0.0) {
+            std::cout << ", first frame " << w.first_frame_ms << " ms";
+        }
+        if (w.has_mem) {
+            std::cout << ", " << mb(w.mem.shared_kb) << " MB shared / " << mb(w.mem.private_kb) << " MB private";
+        }
+        std::cout << (w.failed ? " [failed]" : "") << std::endl;
+    }
+    return failed == 0 ? 0 : 1;
+}
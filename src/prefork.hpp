@@ -0,0 +1,64 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Prefork workers: one process per stream.
+//
+// The supervisor loads and warms the detector once, then fork()s a worker per
+// input. Workers inherit the ready detector copy-on-write, so starting (or
+// restarting) one takes milliseconds and the model pages stay shared. A crash
+// only takes down the stream it happened on; the supervisor starts it again.
+struct PreforkConfig {
+    // Text file with one input (file, URL or camera index) per line. # starts a comment.
+    std::string inputs_file;
+    // printf-style output name with the worker number, e.g. "masked_%02d.avi" (empty = no output).
+    std::string output_pattern = "masked_%02d.avi";
+    // Give up on a worker after this many crashes in a row.
+    int max_restarts = 5;
+    // A worker that ran this long before crashing counts as healthy again.
+    int healthy_after_ms = 10000;
+    // How often the supervisor prints worker memory (0 = only at the end).
+    int status_interval_ms = 5000;
+};
+
+// Read the input list. False if the file cannot be opened or lists nothing.
+bool read_input_list(const std::string& path, std::vector<std::string>& inputs);
+
+// Memory of one process in kB, from /proc/<pid>/smaps_rollup (Linux 4.14+).
+// "Shared" pages are also mapped by another process, e.g. the inherited model.
+struct ProcessMemory {
+    long rss_kb = 0;
+    long pss_kb = 0;
+    long shared_kb = 0;
+    long private_kb = 0;
+};
+bool read_process_memory(pid_t pid, ProcessMemory& mem);
+
+// The worker side of the supervisor connection.
+class WorkerLink {
+public:
+    explicit WorkerLink(int fd) : fd_(fd) {}
+
+    // Worker runs with the inherited detector (marks the end of spin-up).
+    void ready() { send('r'); }
+    // First masked frame is out (spin-up + opening the input).
+    void first_frame() { send('f'); }
+    // True after SIGINT/SIGTERM: finish the current frame, close the output, return.
+    static bool stop_requested();
+
+private:
+    void send(char c);
+    int fd_;
+};
+
+// Runs in the child. Returns the worker's exit code (0 = input finished normally).
+using WorkerBody = std::function<int(size_t index, const std::string& input, WorkerLink& link)>;
+
+// Fork one worker per input, restart the ones that crash or fail, print spin-up
+// times and memory, and return when every worker is done (or on SIGINT/SIGTERM).
+// Returns 0 if all workers finished cleanly.
+int run_supervisor(const PreforkConfig& cfg, const std::vector<std::string>& inputs, const WorkerBody& body);
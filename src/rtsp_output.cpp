@@ -0,0 +1,235 @@
+#include "rtsp_output.hpp"
+
+#include <gst/app/gstappsrc.h>
+#include <gst/gst.h>
+#include <gst/rtsp-server/rtsp-server.h>
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct RtspOutput::Impl {
+    RtspConfig cfg;
+    cv::Size size;
+    double fps = 30.0;
+    size_t frame_bytes = 0;
+    // Frames are converted to the encoder's I420 while being copied into the
+    // buffer. Needs a width divisible by 8 and an even height, so the planes
+    // have GStreamer's default strides; other sizes go through videoconvert.
+    bool i420 = false;
+
+    // The server runs on its own GLib main loop thread.
+    GMainContext* context = nullptr;
+    GMainLoop* loop = nullptr;
+    GstRTSPServer* server = nullptr;
+    guint server_source = 0;
+    std::thread thread;
+
+    // appsrc of the shared media; only set while at least one client is watching.
+    std::mutex lock;
+    GstElement* appsrc = nullptr;
+
+    std::atomic<int> clients{0};
+    std::atomic<uint64_t> pushed{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<int> queue_depth{0};
+    std::atomic<int> queue_peak{0};
+
+    ~Impl() {
+        if (loop) {
+            g_main_context_invoke(context, [](gpointer data) -> gboolean {
+                g_main_loop_quit(static_cast<GMainLoop*>(data));
+                return G_SOURCE_REMOVE;
+            }, loop);
+        }
+        if (thread.joinable()) {
+            thread.join();
+        }
+        if (server_source) {
+            GSource* source = g_main_context_find_source_by_id(context, server_source);
+            if (source) {
+                g_source_destroy(source);
+            }
+        }
+        if (appsrc) {
+            gst_object_unref(appsrc);
+        }
+        if (server) {
+            g_object_unref(server);
+        }
+        if (loop) {
+            g_main_loop_unref(loop);
+        }
+        if (context) {
+            g_main_context_unref(context);
+        }
+    }
+};
+
+static void on_media_unprepared(GstRTSPMedia*, gpointer user_data) {
+    auto* impl = static_cast<RtspOutput::Impl*>(user_data);
+    std::lock_guard<std::mutex> guard(impl->lock);
+    if (impl->appsrc) {
+        gst_object_unref(impl->appsrc);
+        impl->appsrc = nullptr;
+    }
+    impl->queue_depth = 0;
+}
+
+// Called once per shared media, i.e. when the first client starts playing.
+static void on_media_configure(GstRTSPMediaFactory*, GstRTSPMedia* media, gpointer user_data) {
+    auto* impl = static_cast<RtspOutput::Impl*>(user_data);
+    GstElement* element = gst_rtsp_media_get_element(media);
+    GstElement* appsrc = gst_bin_get_by_name_recurse_up(GST_BIN(element), "src");
+    gst_object_unref(element);
+    if (!appsrc) {
+        return;
+    }
+
+    int fps_num = static_cast<int>(std::lround(impl->fps * 1000.0));
+    GstCaps* caps = gst_caps_new_simple("video/x-raw",
+        "format", G_TYPE_STRING, impl->i420 ? "I420" : "BGR",
+        "width", G_TYPE_INT, impl->size.width,
+        "height", G_TYPE_INT, impl->size.height,
+        "framerate", GST_TYPE_FRACTION, fps_num, 1000,
+        nullptr);
+    if (impl->i420) {
+        // cv::COLOR_BGR2YUV_I420 uses BT.601 coefficients. Without this, GStreamer
+        // assumes BT.709 for 720p and up and the encoder signals the wrong matrix.
+        gst_caps_set_simple(caps, "colorimetry", G_TYPE_STRING, "bt601", nullptr);
+    }
+    gst_app_src_set_caps(GST_APP_SRC(appsrc), caps);
+    gst_caps_unref(caps);
+
+    g_signal_connect(media, "unprepared", G_CALLBACK(on_media_unprepared), impl);
+
+    std::lock_guard<std::mutex> guard(impl->lock);
+    if (impl->appsrc) {
+        gst_object_unref(impl->appsrc);
+    }
+    impl->appsrc = appsrc;
+}
+
+static void on_client_closed(GstRTSPClient*, gpointer user_data) {
+    static_cast<RtspOutput::Impl*>(user_data)->clients--;
+}
+
+static void on_client_connected(GstRTSPServer*, GstRTSPClient* client, gpointer user_data) {
+    auto* impl = static_cast<RtspOutput::Impl*>(user_data);
+    impl->clients++;
+    g_signal_connect(client, "closed", G_CALLBACK(on_client_closed), impl);
+}
+
+RtspOutput::RtspOutput(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+
+RtspOutput::~RtspOutput() = default;
+
+std::unique_ptr<RtspOutput> RtspOutput::create(const RtspConfig& cfg, cv::Size frame_size, double fps) {
+    gst_init(nullptr, nullptr);
+
+    auto impl = std::make_unique<Impl>();
+    impl->cfg = cfg;
+    impl->size = frame_size;
+    impl->fps = fps > 0.0 ? fps : 30.0;
+    impl->i420 = frame_size.width % 8 == 0 && frame_size.height % 2 == 0;
+    impl->frame_bytes = static_cast<size_t>(frame_size.width) * frame_size.height * (impl->i420 ? 3 : 6) / 2;
+    impl->context = g_main_context_new();
+    impl->loop = g_main_loop_new(impl->context, FALSE);
+    impl->server = gst_rtsp_server_new();
+    gst_rtsp_server_set_service(impl->server, std::to_string(cfg.port).c_str());
+
+    // One encoder per shared media: every client receives the same RTP packets.
+    int key_int = std::max(1, static_cast<int>(std::lround(impl->fps)));
+    std::string launch =
+        "( appsrc name=src is-live=true format=time do-timestamp=true"
+        + std::string(impl->i420 ? "" : " ! videoconvert ! video/x-raw,format=I420") +
+        " ! x264enc tune=zerolatency speed-preset=ultrafast bitrate=" + std::to_string(cfg.bitrate_kbps) +
+        " key-int-max=" + std::to_string(key_int) +
+        " ! rtph264pay name=pay0 pt=96 config-interval=1 )";
+
+    GstRTSPMediaFactory* factory = gst_rtsp_media_factory_new();
+    gst_rtsp_media_factory_set_launch(factory, launch.c_str());
+    gst_rtsp_media_factory_set_shared(factory, TRUE);
+    g_signal_connect(factory, "media-configure", G_CALLBACK(on_media_configure), impl.get());
+
+    GstRTSPMountPoints* mounts = gst_rtsp_server_get_mount_points(impl->server);
+    gst_rtsp_mount_points_add_factory(mounts, cfg.path.c_str(), factory);
+    g_object_unref(mounts);
+
+    g_signal_connect(impl->server, "client-connected", G_CALLBACK(on_client_connected), impl.get());
+
+    impl->server_source = gst_rtsp_server_attach(impl->server, impl->context);
+    if (impl->server_source == 0) {
+        return nullptr;
+    }
+
+    Impl* raw = impl.get();
+    impl->thread = std::thread([raw] {
+        g_main_context_push_thread_default(raw->context);
+        g_main_loop_run(raw->loop);
+        g_main_context_pop_thread_default(raw->context);
+    });
+    return std::unique_ptr<RtspOutput>(new RtspOutput(std::move(impl)));
+}
+
+void RtspOutput::push(const cv::Mat& bgr) {
+    std::lock_guard<std::mutex> guard(impl_->lock);
+    if (!impl_->appsrc) {
+        // Nobody is watching: skip the encode entirely.
+        return;
+    }
+    if (bgr.size() != impl_->size || bgr.type() != CV_8UC3) {
+        impl_->dropped++;
+        return;
+    }
+
+    GstAppSrc* appsrc = GST_APP_SRC(impl_->appsrc);
+    int depth = static_cast<int>(gst_app_src_get_current_level_bytes(appsrc) / impl_->frame_bytes);
+    impl_->queue_depth = depth;
+    impl_->queue_peak = std::max(impl_->queue_peak.load(), depth);
+    if (depth >= impl_->cfg.max_queue) {
+        // Encoder is behind: drop instead of stalling the processing loop.
+        impl_->dropped++;
+        return;
+    }
+
+    GstBuffer* buffer = gst_buffer_new_allocate(nullptr, impl_->frame_bytes, nullptr);
+    GstMapInfo map;
+    gst_buffer_map(buffer, &map, GST_MAP_WRITE);
+    if (impl_->i420) {
+        // Y, U and V planes written straight into the buffer in one pass.
+        cv::Mat yuv(bgr.rows * 3 / 2, bgr.cols, CV_8UC1, map.data);
+        cv::cvtColor(bgr, yuv, cv::COLOR_BGR2YUV_I420);
+    } else {
+        const size_t row_bytes = static_cast<size_t>(bgr.cols) * 3;
+        for (int y = 0; y < bgr.rows; ++y) {
+            std::copy_n(bgr.ptr<uchar>(y), row_bytes, map.data + y * row_bytes);
+        }
+    }
+    gst_buffer_unmap(buffer, &map);
+
+    if (gst_app_src_push_buffer(appsrc, buffer) == GST_FLOW_OK) {
+        impl_->pushed++;
+    } else {
+        impl_->dropped++;
+    }
+}
+
+RtspStats RtspOutput::stats() const {
+    RtspStats s;
+    s.clients = impl_->clients;
+    s.frames_pushed = impl_->pushed;
+    s.frames_dropped = impl_->dropped;
+    s.queue_depth = impl_->queue_depth;
+    s.queue_peak = impl_->queue_peak;
+    return s;
+}
+
+std::string RtspOutput::url() const {
+    return "rtsp://127.0.0.1:" + std::to_string(impl_->cfg.port) + impl_->cfg.path;
+}
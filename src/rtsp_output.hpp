@@ -0,0 +1,49 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Serves masked frames over RTSP/RTP (H.264) from inside the process.
+//
+// All clients share one encoder: frames are encoded once and the RTP packets
+// are fanned out, so adding viewers does not add encode cost. While nobody is
+// connected, frames are dropped before encoding.
+struct RtspConfig {
+    int port = 8554;
+    std::string path = "/masked";
+    // Target H.264 bitrate in kbit/s.
+    int bitrate_kbps = 4000;
+    // Frames allowed to wait for the encoder before new ones are dropped.
+    int max_queue = 4;
+};
+
+struct RtspStats {
+    int clients = 0;
+    uint64_t frames_pushed = 0;
+    uint64_t frames_dropped = 0;
+    // Frames currently waiting in front of the encoder, and the worst seen.
+    int queue_depth = 0;
+    int queue_peak = 0;
+};
+
+class RtspOutput {
+public:
+    // Starts the server. Returns an empty pointer if it could not bind.
+    static std::unique_ptr<RtspOutput> create(const RtspConfig& cfg, cv::Size frame_size, double fps);
+    ~RtspOutput();
+
+    // Queue one BGR frame for all connected clients. Never blocks.
+    void push(const cv::Mat& bgr);
+
+    RtspStats stats() const;
+    std::string url() const;
+
+    struct Impl;
+
+private:
+    explicit RtspOutput(std::unique_ptr<Impl> impl);
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,158 @@
+#include "screen_capture.hpp"
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <thread>
+
+namespace {
+
+// XShmAttach reports failure (e.g. on a remote display) as an async X error.
+bool g_x_error = false;
+
+int record_x_error(Display*, XErrorEvent*) {
+    g_x_error = true;
+    return 0;
+}
+
+}  // namespace
+
+bool parse_geometry(const std::string& text, cv::Rect& region) {
+    int w = 0, h = 0, x = 0, y = 0;
+    if (std::sscanf(text.c_str(), "%dx%d+%d+%d", &w, &h, &x, &y) != 4 || w <= 0 || h <= 0) {
+        return false;
+    }
+    region = cv::Rect(x, y, w, h);
+    return true;
+}
+
+struct ScreenCaptureSource::Impl {
+    Display* display = nullptr;
+    Window root = 0;
+    XImage* image = nullptr;
+    XShmSegmentInfo shm{};
+    bool attached = false;
+    cv::Rect region;
+
+    std::chrono::steady_clock::duration period{};
+    std::chrono::steady_clock::time_point next;
+
+    ~Impl() {
+        if (attached) {
+            XShmDetach(display, &shm);
+        }
+        if (image) {
+            // The pixels live in the shared segment, not on the heap.
+            image->data = nullptr;
+            XDestroyImage(image);
+        }
+        if (shm.shmaddr) {
+            shmdt(shm.shmaddr);
+        }
+        if (display) {
+            XCloseDisplay(display);
+        }
+    }
+};
+
+ScreenCaptureSource::ScreenCaptureSource() : impl_(std::make_unique<Impl>()) {}
+ScreenCaptureSource::~ScreenCaptureSource() = default;
+ScreenCaptureSource::ScreenCaptureSource(ScreenCaptureSource&&) noexcept = default;
+ScreenCaptureSource& ScreenCaptureSource::operator=(ScreenCaptureSource&&) noexcept = default;
+
+bool ScreenCaptureSource::open(const ScreenCaptureConfig& cfg) {
+    Impl& s = *impl_;
+    s.display = XOpenDisplay(cfg.display.empty() ? nullptr : cfg.display.c_str());
+    if (!s.display) {
+        std::cerr << "Cannot open X display " << (cfg.display.empty() ? "$DISPLAY" : cfg.display) << std::endl;
+        return false;
+    }
+    if (!XShmQueryExtension(s.display)) {
+        std::cerr << "X server has no MIT-SHM extension." << std::endl;
+        return false;
+    }
+
+    int screen = DefaultScreen(s.display);
+    s.root = RootWindow(s.display, screen);
+    XWindowAttributes attrs;
+    XGetWindowAttributes(s.display, s.root, &attrs);
+    cv::Rect full(0, 0, attrs.width, attrs.height);
+    s.region = cfg.region.area() > 0 ? (cfg.region & full) : full;
+    if (s.region.area() <= 0) {
+        std::cerr << "Screen region is outside the " << attrs.width << "x" << attrs.height << " screen." << std::endl;
+        return false;
+    }
+
+    // 24/32-bit TrueColor with the usual masks is laid out as B,G,R,X in memory.
+    Visual* visual = DefaultVisual(s.display, screen);
+    s.image = XShmCreateImage(s.display, visual, DefaultDepth(s.display, screen), ZPixmap, nullptr, &s.shm,
+                              s.region.width, s.region.height);
+    if (!s.image || s.image->bits_per_pixel != 32 || visual->red_mask != 0xff0000 || visual->blue_mask != 0xff) {
+        std::cerr << "Only 24/32-bit BGRX screens are supported." << std::endl;
+        return false;
+    }
+
+    s.shm.shmid = shmget(IPC_PRIVATE, static_cast<size_t>(s.image->bytes_per_line) * s.image->height, IPC_CREAT | 0600);
+    if (s.shm.shmid < 0) {
+        std::cerr << "shmget failed." << std::endl;
+        return false;
+    }
+    void* addr = shmat(s.shm.shmid, nullptr, 0);
+    // Marked for removal now; the kernel frees it once we and the X server detach.
+    shmctl(s.shm.shmid, IPC_RMID, nullptr);
+    if (addr == reinterpret_cast<void*>(-1)) {
+        std::cerr << "shmat failed." << std::endl;
+        return false;
+    }
+    s.shm.shmaddr = s.image->data = static_cast<char*>(addr);
+    s.shm.readOnly = False;
+
+    g_x_error = false;
+    XErrorHandler previous = XSetErrorHandler(record_x_error);
+    XShmAttach(s.display, &s.shm);
+    XSync(s.display, False);
+    XSetErrorHandler(previous);
+    if (g_x_error) {
+        std::cerr << "XShmAttach failed (is the X server on another machine?)." << std::endl;
+        return false;
+    }
+    s.attached = true;
+
+    s.period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / std::max(1.0, cfg.fps)));
+    s.next = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool ScreenCaptureSource::read(cv::Mat& frame) {
+    Impl& s = *impl_;
+    if (!s.attached) {
+        return false;
+    }
+    std::this_thread::sleep_until(s.next);
+    s.next += s.period;
+    // Fell behind (slow detection): do not try to catch up with a burst of grabs.
+    auto now = std::chrono::steady_clock::now();
+    if (s.next < now) {
+        s.next = now;
+    }
+
+    if (!XShmGetImage(s.display, s.root, s.image, s.region.x, s.region.y, AllPlanes)) {
+        return false;
+    }
+    // No copy: the Mat header points into the shared segment.
+    frame = cv::Mat(s.region.height, s.region.width, CV_8UC4, s.image->data,
+                    static_cast<size_t>(s.image->bytes_per_line));
+    return true;
+}
+
+cv::Size ScreenCaptureSource::size() const {
+    return impl_->region.size();
+}
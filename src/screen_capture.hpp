@@ -0,0 +1,43 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <memory>
+#include <string>
+
+// X11 screen capture through the MIT-SHM extension (needs make X11=1).
+//
+// The X server copies the screen straight into a shared memory segment and the
+// frame handed to the pipeline points into that segment, so there is no extra
+// copy per frame. Frames are 8-bit BGRA.
+struct ScreenCaptureConfig {
+    // X display, e.g. ":0" or ":99" for Xvfb (empty = $DISPLAY).
+    std::string display;
+    // Part of the screen to grab (empty = whole screen).
+    cv::Rect region;
+    // Target frame rate; read() waits so frames come at this pace.
+    double fps = 15.0;
+};
+
+// Parse "WxH+X+Y" (X11 geometry style).
+bool parse_geometry(const std::string& text, cv::Rect& region);
+
+class ScreenCaptureSource {
+public:
+    ScreenCaptureSource();
+    ~ScreenCaptureSource();
+    ScreenCaptureSource(ScreenCaptureSource&&) noexcept;
+    ScreenCaptureSource& operator=(ScreenCaptureSource&&) noexcept;
+
+    // Connect to the display and set up the shared segment. Prints why on failure.
+    bool open(const ScreenCaptureConfig& cfg);
+
+    // The frame stays valid until the next read().
+    bool read(cv::Mat& frame);
+
+    cv::Size size() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
@@ -0,0 +1,183 @@
+#include "self_audit.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace {
+
+// CPU time used so far by the calling thread, in seconds.
+double thread_cpu_seconds() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + ts.tv_nsec * 1e-9;
+}
+
+}  // namespace
+
+double mask_coverage(const cv::Rect& face, const std::vector<cv::Rect>& masks) {
+    if (face.area() <= 0) {
+        return 1.0;
+    }
+    // Paint the masks into a face-sized bitmap so overlapping masks are not counted twice.
+    cv::Mat covered = cv::Mat::zeros(face.size(), CV_8UC1);
+    for (const auto& m : masks) {
+        cv::Rect overlap = m & face;
+        if (overlap.area() > 0) {
+            covered(overlap - face.tl()).setTo(cv::Scalar(1));
+        }
+    }
+    return static_cast<double>(cv::countNonZero(covered)) / face.area();
+}
+
+double mask_coverage(const cv::Rect& face, const std::vector<std::vector<cv::Point>>& polygons) {
+    if (face.area() <= 0) {
+        return 1.0;
+    }
+    // One polygon at a time, so overlapping polygons add up instead of cancelling.
+    cv::Mat covered = cv::Mat::zeros(face.size(), CV_8UC1);
+    for (const auto& polygon : polygons) {
+        cv::fillPoly(covered, std::vector<std::vector<cv::Point>>{polygon}, cv::Scalar(1), cv::LINE_8, 0, -face.tl());
+    }
+    return static_cast<double>(cv::countNonZero(covered)) / face.area();
+}
+
+struct SelfAudit::Impl {
+    YuNetDetector detector;
+    AuditConfig cfg;
+    std::ofstream log;
+    std::mt19937 rng{std::random_device{}()};
+    std::uniform_real_distribution<double> coin{0.0, 1.0};
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // One-slot mailbox between the pipeline and the audit thread.
+    mutable std::mutex lock;
+    std::condition_variable wake;
+    bool busy = false;
+    bool stop = false;
+    cv::Mat frame;
+    std::vector<cv::Rect> masks;
+    std::function<std::vector<std::vector<cv::Point>>()> polygon_source;
+    std::vector<std::vector<cv::Point>> polygons;
+    uint64_t frame_index = 0;
+    AuditReport stats;
+    std::thread thread;
+
+    Impl(YuNetDetector d, AuditConfig c) : detector(std::move(d)), cfg(std::move(c)) {
+        if (!cfg.log_path.empty()) {
+            log.open(cfg.log_path, std::ios::app);
+        }
+    }
+
+    double wall_seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&] { return stop || busy; });
+            if (stop) {
+                return;
+            }
+            guard.unlock();
+
+            auto t0 = std::chrono::steady_clock::now();
+            const double cpu0 = thread_cpu_seconds();
+            std::vector<cv::Rect> faces = detector.detect(frame);
+            std::vector<cv::Rect> leaks;
+            std::vector<double> coverage;
+            for (const auto& f : faces) {
+                double c = polygon_source ? mask_coverage(f, polygons) : mask_coverage(f, masks);
+                if (c < cfg.min_coverage) {
+                    leaks.push_back(f);
+                    coverage.push_back(c);
+                }
+            }
+            // With one OpenCV thread the detector runs only here, so this thread's CPU
+            // time is what the audit cost. Otherwise its layers may also run on every
+            // OpenCV pool thread, which we cannot measure, so charge wall time per thread.
+            double spent = thread_cpu_seconds() - cpu0;
+            const int cv_threads = cv::getNumThreads();
+            if (cv_threads > 1) {
+                spent = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() * cv_threads;
+            }
+
+            for (size_t i = 0; i < leaks.size(); ++i) {
+                const cv::Rect& b = leaks[i];
+                std::cerr << "audit: LEAK frame=" << frame_index << " box=" << b.x << "," << b.y << ","
+                          << b.width << "," << b.height << " coverage=" << coverage[i] << std::endl;
+                if (log.is_open()) {
+                    log << "{\"event\":\"leak\",\"frame\":" << frame_index
+                        << ",\"box\":[" << b.x << "," << b.y << "," << b.width << "," << b.height << "]"
+                        << ",\"coverage\":" << coverage[i] << "}\n";
+                }
+            }
+            if (!leaks.empty() && log.is_open()) {
+                log.flush();
+            }
+
+            guard.lock();
+            stats.frames_audited++;
+            stats.leaks += leaks.size();
+            stats.audit_seconds += spent;
+            busy = false;
+        }
+    }
+};
+
+SelfAudit::SelfAudit(YuNetDetector detector, AuditConfig cfg)
+    : impl_(std::make_unique<Impl>(std::move(detector), std::move(cfg))) {
+    Impl* raw = impl_.get();
+    impl_->thread = std::thread([raw] { raw->run(); });
+}
+
+SelfAudit::~SelfAudit() {
+    {
+        std::lock_guard<std::mutex> guard(impl_->lock);
+        impl_->stop = true;
+    }
+    impl_->wake.notify_all();
+    impl_->thread.join();
+}
+
+void SelfAudit::offer(const cv::Mat& frame, const std::vector<cv::Rect>& masks, uint64_t frame_index) {
+    Impl& s = *impl_;
+    std::unique_lock<std::mutex> guard(s.lock);
+    s.stats.frames_seen++;
+    if (s.busy || s.coin(s.rng) >= s.cfg.sample_rate) {
+        return;
+    }
+    // Stay inside the CPU budget: audit CPU time may not exceed budget% of elapsed time.
+    if (s.stats.audit_seconds > s.wall_seconds() * s.cfg.budget_percent / 100.0) {
+        return;
+    }
+    frame.copyTo(s.frame);
+    s.masks = masks;
+    if (s.polygon_source) {
+        s.polygons = s.polygon_source();
+    }
+    s.frame_index = frame_index;
+    s.busy = true;
+    guard.unlock();
+    s.wake.notify_one();
+}
+
+void SelfAudit::use_polygons(std::function<std::vector<std::vector<cv::Point>>()> source) {
+    std::lock_guard<std::mutex> guard(impl_->lock);
+    impl_->polygon_source = std::move(source);
+}
+
+AuditReport SelfAudit::report() const {
+    std::lock_guard<std::mutex> guard(impl_->lock);
+    AuditReport r = impl_->stats;
+    r.wall_seconds = impl_->wall_seconds();
+    return r;
+}
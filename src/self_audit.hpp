@@ -0,0 +1,75 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include "face_anonymizer.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Continuous QA for the masked output: a second detector looks at a small
+// random sample of output frames and flags any face that is not under a mask.
+struct AuditConfig {
+    // Share of one core the audit may use, in percent (0 = audit off).
+    double budget_percent = 0.0;
+    // Chance that a frame is even considered for audit; the budget caps it further.
+    double sample_rate = 0.1;
+    // A face counts as leaked when less than this share of it lies under masks.
+    double min_coverage = 0.5;
+    // Optional JSONL file with one line per leak event.
+    std::string log_path;
+};
+
+struct AuditReport {
+    uint64_t frames_seen = 0;
+    uint64_t frames_audited = 0;
+    uint64_t leaks = 0;
+    double audit_seconds = 0.0;
+    double wall_seconds = 0.0;
+};
+
+class SelfAudit {
+public:
+    // `detector` should be its own YuNet instance: audits run on a background thread.
+    SelfAudit(YuNetDetector detector, AuditConfig cfg);
+    ~SelfAudit();
+    SelfAudit(const SelfAudit&) = delete;
+    SelfAudit& operator=(const SelfAudit&) = delete;
+
+    // Called for every output frame. Copies the frame only when it is sampled,
+    // and never waits: if the previous audit is still running the frame is skipped.
+    void offer(const cv::Mat& frame, const std::vector<cv::Rect>& masks, uint64_t frame_index);
+
+    // When the masks are polygons rather than boxes (--projection), audit
+    // against them: `source` returns the polygons masked in the current frame.
+    void use_polygons(std::function<std::vector<std::vector<cv::Point>>()> source);
+
+    AuditReport report() const;
+
+    struct Impl;
+
+private:
+    std::unique_ptr<Impl> impl_;
+};
+
+// Share of `face` that is covered by the union of `masks` (0..1).
+double mask_coverage(const cv::Rect& face, const std::vector<cv::Rect>& masks);
+double mask_coverage(const cv::Rect& face, const std::vector<std::vector<cv::Point>>& polygons);
+
+// Sink stage that feeds every output frame to a SelfAudit.
+class AuditSink {
+public:
+    explicit AuditSink(std::shared_ptr<SelfAudit> audit) : audit_(std::move(audit)) {}
+    bool write(cv::Mat& frame, const std::vector<cv::Rect>& boxes) {
+        audit_->offer(frame, boxes, frame_index_++);
+        return true;
+    }
+
+private:
+    std::shared_ptr<SelfAudit> audit_;
+    uint64_t frame_index_ = 0;
+};
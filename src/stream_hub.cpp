@@ -0,0 +1,1128 @@
+#include "stream_hub.hpp"
+
+#include "container_limits.hpp"
+#include "prefork.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+using Jpeg = std::vector<uchar>;
+
+// ---- Coroutine plumbing ----
+
+// A coroutine that starts right away and frees itself when it returns.
+// Camera and viewer connections are these; nobody waits for them. The ones
+// still suspended when the hub stops are freed by destroy_all().
+struct Task {
+    struct promise_type {
+        promise_type() {
+            std::lock_guard<std::mutex> lock(live_mutex());
+            live().insert(handle().address());
+        }
+        ~promise_type() {
+            std::lock_guard<std::mutex> lock(live_mutex());
+            live().erase(handle().address());
+        }
+        std::coroutine_handle<> handle() { return std::coroutine_handle<promise_type>::from_promise(*this); }
+
+        Task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    // Destroy every Task that has not finished, with the Ops it waits on and
+    // their sockets. Only when no loop runs any more.
+    static void destroy_all() {
+        std::vector<std::coroutine_handle<>> tasks;
+        {
+            std::lock_guard<std::mutex> lock(live_mutex());
+            for (void* address : live()) {
+                tasks.push_back(std::coroutine_handle<>::from_address(address));
+            }
+        }
+        for (std::coroutine_handle<> h : tasks) {
+            h.destroy();
+        }
+    }
+
+private:
+    static std::set<void*>& live() {
+        static std::set<void*> tasks;
+        return tasks;
+    }
+    static std::mutex& live_mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+};
+
+// A coroutine that its caller co_awaits for a result, e.g.
+// `bool ok = co_await send_all(sock, data);`. Runs when awaited. If it
+// finishes without waiting, the caller just continues; otherwise whoever
+// resumes it later (its event loop) resumes the caller when it returns.
+// An Op stays on the caller's loop thread: moving to another loop is done
+// with schedule() in the Task itself.
+template <class T>
+class Op {
+public:
+    struct promise_type;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    struct promise_type {
+        T value{};
+        std::coroutine_handle<> caller;
+        // Set by whichever of "Op finished" and "caller suspended" comes
+        // first; the second one knows the other is done.
+        bool arrived = false;
+
+        Op get_return_object() { return Op(Handle::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept {
+            struct BackToCaller {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(Handle h) noexcept {
+                    if (std::exchange(h.promise().arrived, true)) {
+                        return h.promise().caller;
+                    }
+                    return std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+            return BackToCaller{};
+        }
+        void return_value(T v) { value = std::move(v); }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    explicit Op(Handle h) : h_(h) {}
+    Op(Op&& other) noexcept : h_(std::exchange(other.h_, {})) {}
+    Op(const Op&) = delete;
+    ~Op() {
+        if (h_) {
+            h_.destroy();
+        }
+    }
+
+    bool await_ready() { return false; }
+    bool await_suspend(std::coroutine_handle<> caller) {
+        h_.promise().caller = caller;
+        h_.resume();
+        // Finished already: don't suspend, so a loop of quick Ops never
+        // stacks up frames.
+        return !std::exchange(h_.promise().arrived, true);
+    }
+    T await_resume() { return std::move(h_.promise().value); }
+
+private:
+    Handle h_;
+};
+
+// ---- Event loop ----
+
+class EventLoop;
+
+// A nonblocking socket registered with one event loop (edge-triggered), plus
+// the coroutine waiting to read or write it.
+struct Socket {
+    int fd = -1;
+    EventLoop* loop = nullptr;
+    std::coroutine_handle<> reader;
+    std::coroutine_handle<> writer;
+    // An edge arrived while nobody waited; the next wait returns at once.
+    bool can_read = false;
+    bool can_write = false;
+
+    Socket(EventLoop& loop, int fd);
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+    ~Socket();
+
+    void watch(EventLoop& target);
+    void unwatch();
+};
+
+// One thread running epoll. Coroutines on it are resumed from run(); other
+// threads hand work to it with post().
+class EventLoop {
+public:
+    EventLoop() {
+        epoll_ = epoll_create1(EPOLL_CLOEXEC);
+        wake_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = nullptr;  // the wake-up eventfd
+        epoll_ctl(epoll_, EPOLL_CTL_ADD, wake_, &ev);
+    }
+    EventLoop(const EventLoop&) = delete;
+    ~EventLoop() {
+        close(wake_);
+        close(epoll_);
+    }
+
+    bool ok() const { return epoll_ >= 0 && wake_ >= 0; }
+    int epoll_fd() const { return epoll_; }
+
+    // Run `fn` on this loop's thread. Safe from any thread.
+    void post(std::function<void()> fn) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            posted_.push_back(std::move(fn));
+        }
+        const uint64_t one = 1;
+        (void)!write(wake_, &one, sizeof(one));
+    }
+
+    // `co_await loop.schedule()` continues the coroutine on this loop's thread.
+    auto schedule() {
+        struct Awaiter {
+            EventLoop* loop;
+            bool await_ready() { return false; }
+            void await_suspend(std::coroutine_handle<> h) {
+                loop->post([h] { h.resume(); });
+            }
+            void await_resume() {}
+        };
+        return Awaiter{this};
+    }
+
+    // `co_await loop.sleep_for(d)`. Only from this loop's thread.
+    auto sleep_for(std::chrono::milliseconds d) {
+        struct Awaiter {
+            EventLoop* loop;
+            Clock::time_point when;
+            bool await_ready() { return false; }
+            void await_suspend(std::coroutine_handle<> h) { loop->timers_.push({when, h}); }
+            void await_resume() {}
+        };
+        return Awaiter{this, Clock::now() + d};
+    }
+
+    void run(const std::atomic<bool>& stop) {
+        std::vector<epoll_event> events(256);
+        std::vector<std::coroutine_handle<>> ready;
+        std::deque<std::function<void()>> posted;
+        while (!stop) {
+            // Wake at least every 200 ms to notice `stop`.
+            int timeout_ms = 200;
+            if (!timers_.empty()) {
+                auto wait = std::chrono::ceil<std::chrono::milliseconds>(timers_.top().when - Clock::now());
+                timeout_ms = static_cast<int>(std::clamp<int64_t>(wait.count(), 0, timeout_ms));
+            }
+            const int n = epoll_wait(epoll_, events.data(), static_cast<int>(events.size()), timeout_ms);
+            // Collect the waiters first and resume them afterwards: a resumed
+            // coroutine may close its socket, and later events of this batch
+            // must not point into it.
+            for (int i = 0; i < n; ++i) {
+                auto* sock = static_cast<Socket*>(events[i].data.ptr);
+                if (sock == nullptr) {
+                    uint64_t count = 0;
+                    (void)!read(wake_, &count, sizeof(count));
+                    continue;
+                }
+                const uint32_t e = events[i].events;
+                if (e & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                    if (sock->reader) {
+                        ready.push_back(std::exchange(sock->reader, {}));
+                    } else {
+                        sock->can_read = true;
+                    }
+                }
+                if (e & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+                    if (sock->writer) {
+                        ready.push_back(std::exchange(sock->writer, {}));
+                    } else {
+                        sock->can_write = true;
+                    }
+                }
+            }
+            for (std::coroutine_handle<> h : ready) {
+                h.resume();
+            }
+            ready.clear();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                posted.swap(posted_);
+            }
+            for (auto& fn : posted) {
+                fn();
+            }
+            posted.clear();
+
+            const auto now = Clock::now();
+            while (!timers_.empty() && timers_.top().when <= now) {
+                std::coroutine_handle<> h = timers_.top().handle;
+                timers_.pop();
+                h.resume();
+            }
+        }
+    }
+
+private:
+    struct Timer {
+        Clock::time_point when;
+        std::coroutine_handle<> handle;
+        bool operator>(const Timer& other) const { return when > other.when; }
+    };
+
+    int epoll_ = -1;
+    int wake_ = -1;
+    std::mutex mutex_;
+    std::deque<std::function<void()>> posted_;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers_;
+};
+
+Socket::Socket(EventLoop& loop, int fd) : fd(fd) {
+    watch(loop);
+}
+
+Socket::~Socket() {
+    unwatch();
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+void Socket::watch(EventLoop& target) {
+    loop = &target;
+    // Edges may have been missed while unwatched; the first wait just tries.
+    can_read = can_write = true;
+    epoll_event ev{};
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = this;
+    epoll_ctl(loop->epoll_fd(), EPOLL_CTL_ADD, fd, &ev);
+}
+
+void Socket::unwatch() {
+    if (loop != nullptr && fd >= 0) {
+        epoll_ctl(loop->epoll_fd(), EPOLL_CTL_DEL, fd, nullptr);
+    }
+    loop = nullptr;
+}
+
+// `co_await readable(sock)`: wait until a read may make progress.
+auto readable(Socket& sock) {
+    struct Awaiter {
+        Socket& sock;
+        bool await_ready() { return std::exchange(sock.can_read, false); }
+        void await_suspend(std::coroutine_handle<> h) { sock.reader = h; }
+        void await_resume() {}
+    };
+    return Awaiter{sock};
+}
+
+auto writable(Socket& sock) {
+    struct Awaiter {
+        Socket& sock;
+        bool await_ready() { return std::exchange(sock.can_write, false); }
+        void await_suspend(std::coroutine_handle<> h) { sock.writer = h; }
+        void await_resume() {}
+    };
+    return Awaiter{sock};
+}
+
+Op<bool> send_all(Socket& sock, const char* data, size_t size) {
+    size_t sent = 0;
+    while (sent < size) {
+        const ssize_t n = send(sock.fd, data + sent, size - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += static_cast<size_t>(n);
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            co_await writable(sock);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else {
+            co_return false;
+        }
+    }
+    co_return true;
+}
+
+// Append what is there to `buf`. Waits if nothing is. False on EOF or error.
+Op<bool> read_some(Socket& sock, std::string& buf) {
+    // Per thread, not per coroutine: a local would stay in the frame of
+    // every connection waiting below.
+    static thread_local char chunk[16384];
+    const size_t before = buf.size();
+    while (true) {
+        const ssize_t n = recv(sock.fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+            buf.append(chunk, static_cast<size_t>(n));
+            continue;  // drain the socket: edge-triggered epoll won't tell again
+        }
+        if (n == 0) {
+            co_return false;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            co_return false;
+        }
+        if (buf.size() > before) {
+            co_return true;
+        }
+        co_await readable(sock);
+    }
+}
+
+// True if the peer closed the connection (or it failed). Drains and
+// ignores anything it sent; call after a read edge.
+bool peer_closed(Socket& sock) {
+    static thread_local char chunk[4096];
+    while (true) {
+        const ssize_t n = recv(sock.fd, chunk, sizeof(chunk), 0);
+        if (n > 0) {
+            continue;
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        return n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+    }
+}
+
+// ---- Worker pool ----
+
+// Threads for the CPU work. Jobs get the worker's index, so each worker can
+// keep its own detector.
+class WorkerPool {
+public:
+    explicit WorkerPool(int threads) {
+        for (int i = 0; i < threads; ++i) {
+            threads_.emplace_back([this, i] { work(i); });
+        }
+    }
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (std::thread& t : threads_) {
+            t.join();
+        }
+    }
+
+    void submit(std::function<void(int worker)> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        wake_.notify_one();
+    }
+
+private:
+    void work(int index) {
+        while (true) {
+            std::function<void(int)> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+                if (stop_) {
+                    return;
+                }
+                job = std::move(jobs_.front());
+                jobs_.pop_front();
+            }
+            job(index);
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::deque<std::function<void(int)>> jobs_;
+    bool stop_ = false;
+};
+
+// ---- MJPEG over HTTP ----
+
+struct Url {
+    std::string host;
+    std::string port = "80";
+    std::string path = "/";
+};
+
+bool parse_url(const std::string& text, Url& url) {
+    const std::string scheme = "http://";
+    if (text.compare(0, scheme.size(), scheme) != 0) {
+        return false;
+    }
+    std::string rest = text.substr(scheme.size());
+    const size_t slash = rest.find('/');
+    if (slash != std::string::npos) {
+        url.path = rest.substr(slash);
+        rest = rest.substr(0, slash);
+    }
+    const size_t colon = rest.rfind(':');
+    if (colon != std::string::npos && rest.find(']') == std::string::npos) {
+        url.port = rest.substr(colon + 1);
+        rest = rest.substr(0, colon);
+    }
+    url.host = rest;
+    return !url.host.empty();
+}
+
+std::string lower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return std::tolower(c); });
+    return text;
+}
+
+// Value of a header in a block of HTTP/MIME headers ("" if missing).
+std::string header_value(const std::string& headers, const std::string& name) {
+    const std::string lowered = lower(headers);
+    const size_t at = lowered.find("\n" + lower(name) + ":");
+    if (at == std::string::npos) {
+        return "";
+    }
+    size_t begin = at + name.size() + 2;
+    const size_t end = headers.find('\r', begin);
+    while (begin < end && headers[begin] == ' ') {
+        begin++;
+    }
+    return headers.substr(begin, end - begin);
+}
+
+// Splits a multipart/x-mixed-replace body into JPEGs as bytes arrive.
+class MjpegParser {
+public:
+    // Cameras disagree on whether the declared boundary already has the
+    // delimiter's leading "--"; with it added once, both kinds match.
+    explicit MjpegParser(const std::string& boundary)
+        : boundary_(boundary.compare(0, 2, "--") == 0 ? boundary : "--" + boundary) {}
+
+    // Take every complete part out of `buf`. Returns the number of parts;
+    // `latest` holds the last one.
+    int parse(std::string& buf, Jpeg& latest) {
+        int parts = 0;
+        size_t pos = 0;
+        while (true) {
+            const size_t mark = buf.find(boundary_, pos);
+            if (mark == std::string::npos) {
+                break;
+            }
+            const size_t headers_end = buf.find("\r\n\r\n", mark);
+            if (headers_end == std::string::npos) {
+                break;
+            }
+            const size_t data = headers_end + 4;
+            const std::string length = header_value(buf.substr(mark, data - mark), "Content-Length");
+            size_t end = 0;
+            if (!length.empty()) {
+                end = data + std::strtoul(length.c_str(), nullptr, 10);
+                if (end > buf.size()) {
+                    break;
+                }
+            } else {
+                // No length: the part ends where the next one starts.
+                end = buf.find(boundary_, data);
+                if (end == std::string::npos) {
+                    break;
+                }
+                while (end > data && (buf[end - 1] == '-' || buf[end - 1] == '\r' || buf[end - 1] == '\n')) {
+                    end--;
+                }
+            }
+            latest.assign(buf.begin() + static_cast<std::ptrdiff_t>(data), buf.begin() + static_cast<std::ptrdiff_t>(end));
+            parts++;
+            pos = end;
+        }
+        // Drop what was used; keep a partial boundary at the end.
+        if (pos > 0) {
+            buf.erase(0, pos);
+        } else if (buf.size() > boundary_.size() && buf.find(boundary_) == std::string::npos) {
+            buf.erase(0, buf.size() - boundary_.size());
+        }
+        return parts;
+    }
+
+private:
+    std::string boundary_;
+};
+
+// ---- The hub ----
+
+// Decode, detect, mask and encode one frame of stream `index` on worker `worker`.
+// Empty result = the frame was not usable.
+using FrameJob = std::function<std::shared_ptr<const Jpeg>(int worker, size_t index, const Jpeg& jpeg)>;
+
+struct HubStream {
+    size_t index = 0;
+    std::string url;
+    Url parts;
+    sockaddr_storage address{};
+    socklen_t address_size = 0;
+    bool resolved = false;
+    EventLoop* loop = nullptr;
+    bool error_printed = false;
+
+    // Owned by the stream's loop thread.
+    bool busy = false;  // a frame of this stream is with the workers
+    Jpeg pending;       // newest frame that arrived meanwhile
+    std::shared_ptr<const Jpeg> latest;
+    uint64_t sequence = 0;
+    std::vector<std::coroutine_handle<>> viewers;
+
+    // Read by the status line from another thread.
+    std::atomic<bool> connected{false};
+    std::atomic<uint64_t> frames_in{0};
+    std::atomic<uint64_t> frames_masked{0};
+    std::atomic<uint64_t> frames_skipped{0};
+    std::atomic<uint64_t> reconnects{0};
+};
+
+// `co_await next_frame(stream, viewer, seen)`: wait until the stream has a
+// frame newer than `seen`, or the viewer's socket has something to read
+// (usually: the viewer hung up). Whichever comes first, the other wait is
+// cancelled. Only on the stream's loop.
+auto next_frame(HubStream& s, Socket& viewer, uint64_t seen) {
+    struct Awaiter {
+        HubStream& s;
+        Socket& viewer;
+        uint64_t seen;
+        std::coroutine_handle<> self;
+        bool await_ready() { return s.sequence != seen; }
+        void await_suspend(std::coroutine_handle<> h) {
+            self = h;
+            s.viewers.push_back(h);
+            viewer.reader = h;
+        }
+        void await_resume() {
+            if (self) {
+                viewer.reader = {};
+                s.viewers.erase(std::remove(s.viewers.begin(), s.viewers.end(), self), s.viewers.end());
+            }
+        }
+    };
+    return Awaiter{s, viewer, seen, {}};
+}
+
+class Hub {
+public:
+    Hub(std::vector<std::unique_ptr<HubStream>>& streams, WorkerPool& pool, const FrameJob& job,
+        const std::atomic<bool>& stop)
+        : streams_(streams), pool_(pool), job_(job), stop_(stop) {}
+
+    std::atomic<uint64_t> viewers{0};
+
+    Task camera(HubStream& s) {
+        co_await s.loop->schedule();
+        auto backoff = std::chrono::milliseconds(1000);
+        while (!stop_) {
+            std::string reason;
+            if (s.resolved) {
+                Socket sock(*s.loop, socket(s.address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+                if (co_await open_stream(sock, s, reason)) {
+                    s.connected = true;
+                    s.error_printed = false;
+                    backoff = std::chrono::milliseconds(1000);
+                    reason = co_await read_frames(sock, s);
+                    s.connected = false;
+                }
+            } else {
+                reason = "cannot resolve " + s.parts.host;
+            }
+            if (stop_) {
+                break;
+            }
+            // One message per failure streak, not one per retry.
+            if (!s.error_printed) {
+                std::cerr << "hub: stream " << s.index << " (" << s.url << "): " << reason << ", retrying" << std::endl;
+                s.error_printed = true;
+            }
+            s.reconnects++;
+            co_await s.loop->sleep_for(backoff);
+            backoff = std::min(backoff * 2, std::chrono::milliseconds(30000));
+        }
+    }
+
+    Task listen(Socket& server) {
+        co_await server.loop->schedule();
+        while (!stop_) {
+            const int fd = accept4(server.fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd >= 0) {
+                viewer(*server.loop, fd);
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                co_await readable(server);
+            } else if (errno == EMFILE || errno == ENFILE) {
+                // Out of file descriptors: back off instead of spinning.
+                co_await server.loop->sleep_for(std::chrono::milliseconds(100));
+            }
+        }
+    }
+
+private:
+    Op<bool> open_stream(Socket& sock, HubStream& s, std::string& reason) {
+        if (sock.fd < 0) {
+            reason = std::strerror(errno);
+            co_return false;
+        }
+        // Notice cameras that vanish without closing the connection.
+        int on = 1;
+        int idle = 30;
+        int interval = 10;
+        setsockopt(sock.fd, SOL_SOCKET, SO_KEEPALIVE, &on, sizeof(on));
+        setsockopt(sock.fd, IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+        setsockopt(sock.fd, IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+        if (connect(sock.fd, reinterpret_cast<const sockaddr*>(&s.address), s.address_size) != 0 &&
+            errno != EINPROGRESS) {
+            reason = std::strerror(errno);
+            co_return false;
+        }
+        sock.can_write = false;  // wait for the connect to finish
+        co_await writable(sock);
+        int error = 0;
+        socklen_t size = sizeof(error);
+        getsockopt(sock.fd, SOL_SOCKET, SO_ERROR, &error, &size);
+        if (error != 0) {
+            reason = std::strerror(error);
+            co_return false;
+        }
+        const std::string request = "GET " + s.parts.path + " HTTP/1.0\r\nHost: " + s.parts.host +
+                                    "\r\nUser-Agent: face_pixelate\r\n\r\n";
+        if (!co_await send_all(sock, request.data(), request.size())) {
+            reason = "connection closed";
+            co_return false;
+        }
+        co_return true;
+    }
+
+    // Read until the connection ends. Returns why it ended.
+    Op<std::string> read_frames(Socket& sock, HubStream& s) {
+        // Bigger than any sane frame; a stream that never delimits is broken.
+        const size_t kMaxBuffer = 16 * 1024 * 1024;
+        std::string buf;
+        size_t headers_end = std::string::npos;
+        while (headers_end == std::string::npos) {
+            if (!co_await read_some(sock, buf) || buf.size() > 64 * 1024) {
+                co_return std::string("no HTTP response");
+            }
+            headers_end = buf.find("\r\n\r\n");
+        }
+        const std::string headers = buf.substr(0, headers_end + 2);
+        if (headers.compare(0, 5, "HTTP/") != 0 || headers.find(" 200 ") == std::string::npos) {
+            co_return "HTTP " + headers.substr(0, headers.find('\r'));
+        }
+        const std::string type = header_value(headers, "Content-Type");
+        const size_t at = lower(type).find("boundary=");
+        if (at == std::string::npos) {
+            co_return "not an MJPEG stream (Content-Type: " + type + ")";
+        }
+        std::string boundary = type.substr(at + 9, type.find(';', at) - (at + 9));
+        boundary.erase(std::remove(boundary.begin(), boundary.end(), '"'), boundary.end());
+        MjpegParser parser(boundary);
+        buf.erase(0, headers_end + 2);  // keep "\r\n": the first delimiter may follow right away
+
+        Jpeg frame;
+        while (!stop_) {
+            const int parts = parser.parse(buf, frame);
+            if (parts > 0) {
+                s.frames_in += parts;
+                s.frames_skipped += parts - 1;  // several arrived at once; only the newest counts
+                submit(s, std::move(frame));
+                frame.clear();
+            }
+            if (buf.size() > kMaxBuffer) {
+                co_return std::string("no frame boundary in 16 MB");
+            }
+            if (!co_await read_some(sock, buf)) {
+                co_return std::string("connection closed");
+            }
+        }
+        co_return std::string("stopped");
+    }
+
+    // Send a frame to the workers, or park it if one is already there. Only
+    // the newest parked frame is kept: a slow stream skips frames rather than
+    // queueing them.
+    void submit(HubStream& s, Jpeg frame) {
+        if (s.busy) {
+            if (!s.pending.empty()) {
+                s.frames_skipped++;
+            }
+            s.pending = std::move(frame);
+            return;
+        }
+        s.busy = true;
+        auto input = std::make_shared<Jpeg>(std::move(frame));
+        pool_.submit([this, &s, input, &job = job_](int worker) {
+            std::shared_ptr<const Jpeg> masked = job(worker, s.index, *input);
+            // Runs only while the loops do, i.e. while the hub exists.
+            s.loop->post([this, &s, masked] { finished(s, masked); });
+        });
+    }
+
+    // Back on the stream's loop: publish the frame and wake its viewers.
+    void finished(HubStream& s, std::shared_ptr<const Jpeg> masked) {
+        s.busy = false;
+        if (masked) {
+            s.frames_masked++;
+            s.latest = std::move(masked);
+            s.sequence++;
+            std::vector<std::coroutine_handle<>> waiting;
+            waiting.swap(s.viewers);
+            for (std::coroutine_handle<> h : waiting) {
+                h.resume();
+            }
+        }
+        if (!s.pending.empty()) {
+            submit(s, std::exchange(s.pending, {}));
+        }
+    }
+
+    Task viewer(EventLoop& accepting, int fd) {
+        Socket sock(accepting, fd);
+        std::string request;
+        size_t end = std::string::npos;
+        while (end == std::string::npos) {
+            if (!co_await read_some(sock, request) || request.size() > 8192) {
+                co_return;
+            }
+            end = request.find("\r\n\r\n");
+        }
+        // "GET /12.mjpg HTTP/1.1"
+        std::string path;
+        if (request.compare(0, 4, "GET ") == 0) {
+            path = request.substr(4, request.find(' ', 4) - 4);
+        }
+        size_t index = 0;
+        char* rest = nullptr;
+        if (path.size() > 1) {
+            index = std::strtoul(path.c_str() + 1, &rest, 10);
+        }
+        if (path == "/") {
+            std::string body;
+            for (const auto& s : streams_) {
+                body += "/" + std::to_string(s->index) + ".mjpg " + (s->connected ? "connected " : "waiting ") +
+                        s->url + "\n";
+            }
+            const std::string reply = "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " +
+                                      std::to_string(body.size()) + "\r\n\r\n" + body;
+            co_await send_all(sock, reply.data(), reply.size());
+            co_return;
+        }
+        if (rest == nullptr || std::strcmp(rest, ".mjpg") != 0 || index >= streams_.size()) {
+            const std::string reply = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+            co_await send_all(sock, reply.data(), reply.size());
+            co_return;
+        }
+
+        // Serve from the stream's own loop, so its frames need no locking.
+        // After schedule() this coroutine runs on that loop's thread only.
+        HubStream& s = *streams_[index];
+        if (sock.loop != s.loop) {
+            sock.unwatch();
+            co_await s.loop->schedule();
+            sock.watch(*s.loop);
+        }
+        const std::string header =
+            "HTTP/1.0 200 OK\r\nCache-Control: no-cache\r\nConnection: close\r\n"
+            "Content-Type: multipart/x-mixed-replace; boundary=frame\r\n\r\n";
+        if (!co_await send_all(sock, header.data(), header.size())) {
+            co_return;
+        }
+        viewers++;
+        uint64_t seen = 0;
+        while (!stop_) {
+            if (std::exchange(sock.can_read, false) && peer_closed(sock)) {
+                break;
+            }
+            co_await next_frame(s, sock, seen);
+            if (s.sequence == seen) {
+                // Woken by the socket, not by a frame.
+                if (peer_closed(sock)) {
+                    break;
+                }
+                continue;
+            }
+            // Whatever arrived while the last frame was sending is skipped;
+            // a slow viewer always gets the newest frame.
+            seen = s.sequence;
+            std::shared_ptr<const Jpeg> jpeg = s.latest;
+            const std::string part = "--frame\r\nContent-Type: image/jpeg\r\nContent-Length: " +
+                                     std::to_string(jpeg->size()) + "\r\n\r\n";
+            if (!co_await send_all(sock, part.data(), part.size()) ||
+                !co_await send_all(sock, reinterpret_cast<const char*>(jpeg->data()), jpeg->size()) ||
+                !co_await send_all(sock, "\r\n", 2)) {
+                break;
+            }
+        }
+        viewers--;
+    }
+
+    std::vector<std::unique_ptr<HubStream>>& streams_;
+    WorkerPool& pool_;
+    const FrameJob& job_;
+    const std::atomic<bool>& stop_;
+};
+
+// ---- Setup and status ----
+
+std::atomic<bool> g_stop{false};
+
+void on_signal(int) {
+    g_stop = true;
+}
+
+int open_server(int port) {
+    const int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    int on = 1;
+    int off = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off));  // IPv4 too
+    sockaddr_in6 address{};
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_any;
+    address.sin6_port = htons(static_cast<uint16_t>(port));
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 1024) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Every stream and viewer is a socket; the default limit of 1024 is too low.
+void raise_fd_limit(size_t needed) {
+    rlimit limit{};
+    if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur >= limit.rlim_max) {
+        return;
+    }
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+    if (limit.rlim_cur < needed) {
+        std::cerr << "hub: open file limit " << limit.rlim_cur << " is below " << needed
+                  << "; raise it with ulimit -n" << std::endl;
+    }
+}
+
+// "Threads:" and "VmRSS:" (kB) from /proc/self/status.
+void read_process_status(long& threads, long& rss_kb) {
+    std::ifstream file("/proc/self/status");
+    std::string key;
+    while (file >> key) {
+        if (key == "Threads:") {
+            file >> threads;
+        } else if (key == "VmRSS:") {
+            file >> rss_kb;
+        }
+        file.ignore(1 << 20, '\n');
+    }
+}
+
+long context_switches() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+struct HubTotals {
+    size_t connected = 0;
+    uint64_t frames_in = 0;
+    uint64_t frames_masked = 0;
+    uint64_t frames_skipped = 0;
+    uint64_t reconnects = 0;
+    long switches = 0;
+    Clock::time_point when = Clock::now();
+};
+
+HubTotals totals(const std::vector<std::unique_ptr<HubStream>>& streams) {
+    HubTotals t;
+    for (const auto& s : streams) {
+        t.connected += s->connected ? 1 : 0;
+        t.frames_in += s->frames_in;
+        t.frames_masked += s->frames_masked;
+        t.frames_skipped += s->frames_skipped;
+        t.reconnects += s->reconnects;
+    }
+    t.switches = context_switches();
+    return t;
+}
+
+// "hub: 1873/2000 connected, 412.0 frames/s in, 409.5 masked, 2.5 skipped, 3 reconnects;
+//  6 viewers; 9 threads, 412 MB RSS, 1520 context switches/s"
+void print_status(const char* label, size_t streams, uint64_t viewers, const HubTotals& from, const HubTotals& to) {
+    const double seconds = std::max(1e-3, std::chrono::duration<double>(to.when - from.when).count());
+    long threads = 0;
+    long rss_kb = 0;
+    read_process_status(threads, rss_kb);
+    std::cout << label << " " << to.connected << "/" << streams << " connected, "
+              << (to.frames_in - from.frames_in) / seconds << " frames/s in, "
+              << (to.frames_masked - from.frames_masked) / seconds << " masked, "
+              << (to.frames_skipped - from.frames_skipped) / seconds << " skipped, "
+              << to.reconnects - from.reconnects << " reconnects; " << viewers << " viewers; " << threads
+              << " threads, " << rss_kb / 1024 << " MB RSS, " << (to.switches - from.switches) / seconds
+              << " context switches/s" << std::endl;
+}
+
+int run_hub(const HubConfig& cfg, const std::vector<std::string>& inputs, int workers, const FrameJob& job) {
+    std::vector<std::unique_ptr<EventLoop>> loops;
+    for (int i = 0; i < std::max(1, cfg.io_threads); ++i) {
+        loops.push_back(std::make_unique<EventLoop>());
+        if (!loops.back()->ok()) {
+            std::cerr << "hub: epoll: " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<std::unique_ptr<HubStream>> streams;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        auto s = std::make_unique<HubStream>();
+        s->index = i;
+        s->url = inputs[i];
+        if (!parse_url(s->url, s->parts)) {
+            std::cerr << "hub: not an http:// URL: " << s->url << std::endl;
+            return 1;
+        }
+        // Resolve once up front; getaddrinfo blocks and would stall a loop.
+        addrinfo hints{};
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        if (getaddrinfo(s->parts.host.c_str(), s->parts.port.c_str(), &hints, &found) == 0 && found != nullptr) {
+            std::memcpy(&s->address, found->ai_addr, found->ai_addrlen);
+            s->address_size = found->ai_addrlen;
+            s->resolved = true;
+            freeaddrinfo(found);
+        }
+        s->loop = loops[i % loops.size()].get();
+        streams.push_back(std::move(s));
+    }
+    raise_fd_limit(streams.size() * 2 + 64);
+
+    int server_fd = -1;
+    if (cfg.port > 0) {
+        server_fd = open_server(cfg.port);
+        if (server_fd < 0) {
+            std::cerr << "hub: cannot listen on port " << cfg.port << ": " << std::strerror(errno) << std::endl;
+            return 1;
+        }
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    std::cout << "hub: " << streams.size() << " streams on " << loops.size() << " I/O "
+              << (loops.size() == 1 ? "thread" : "threads") << ", " << workers << " workers";
+    if (server_fd >= 0) {
+        std::cout << ", serving http://0.0.0.0:" << cfg.port << "/<n>.mjpg";
+    }
+    std::cout << std::endl;
+
+    {
+        // Outlives the hub: it joins jobs still running, which use `job`,
+        // the streams and the loops, all declared before it.
+        WorkerPool pool(workers);
+        Hub hub(streams, pool, job, g_stop);
+        std::unique_ptr<Socket> server;
+        if (server_fd >= 0) {
+            server = std::make_unique<Socket>(*loops[0], server_fd);
+            hub.listen(*server);
+        }
+        for (auto& s : streams) {
+            hub.camera(*s);
+        }
+        std::vector<std::thread> threads;
+        for (auto& loop : loops) {
+            threads.emplace_back([&loop] { loop->run(g_stop); });
+        }
+
+        const HubTotals start = totals(streams);
+        HubTotals last = start;
+        while (!g_stop) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+            if (cfg.status_interval_s > 0 &&
+                Clock::now() - last.when >= std::chrono::seconds(cfg.status_interval_s)) {
+                HubTotals now = totals(streams);
+                print_status("hub:", streams.size(), hub.viewers, last, now);
+                last = now;
+            }
+        }
+        // Before the loops wind down and mark streams disconnected.
+        const HubTotals end = totals(streams);
+        for (std::thread& t : threads) {
+            t.join();
+        }
+        print_status("hub total:", streams.size(), hub.viewers, start, end);
+        // Cameras and viewers still waiting in the (stopped) loops: free them
+        // and close their sockets while the loops and streams still exist.
+        Task::destroy_all();
+    }
+    return 0;
+}
+
+}  // namespace
+
+int run_stream_hub(const AnonymizerConfig& anon, const HubConfig& cfg) {
+    std::vector<std::string> inputs;
+    if (!read_input_list(cfg.inputs_file, inputs)) {
+        std::cerr << "No inputs listed in " << cfg.inputs_file << std::endl;
+        return 1;
+    }
+    const int workers = cfg.workers > 0 ? cfg.workers : available_cpus();
+
+    // One detector and one tracker set per worker thread / stream; the pool
+    // is the parallelism, so OpenCV itself runs single-threaded.
+    cv::setNumThreads(1);
+    std::vector<YuNetDetector> detectors;
+    for (int i = 0; i < workers; ++i) {
+        cv::Ptr<cv::FaceDetectorYN> net = create_yunet(anon, cv::Size(320, 240));
+        if (net.empty()) {
+            std::cerr << "Failed to create YuNet detector. Check model path: " << anon.model_path << std::endl;
+            return 1;
+        }
+        detectors.emplace_back(net, anon.face_padding);
+    }
+    // A stream has at most one frame with the workers, so its tracker is
+    // never used by two threads at once.
+    std::vector<FaceTracker> trackers(inputs.size(), FaceTracker(anon.hold_frames));
+    const std::vector<int> encode_params = {cv::IMWRITE_JPEG_QUALITY, cfg.jpeg_quality};
+
+    FrameJob job = [&](int worker, size_t index, const Jpeg& jpeg) -> std::shared_ptr<const Jpeg> {
+        cv::Mat frame = cv::imdecode(jpeg, cv::IMREAD_COLOR);
+        if (frame.empty()) {
+            return nullptr;
+        }
+        mask_boxes(frame, trackers[index].update(detectors[worker].detect(frame)), anon.mask_style, anon.pixel_block);
+        auto masked = std::make_shared<Jpeg>();
+        cv::imencode(".jpg", frame, *masked, encode_params);
+        return masked;
+    };
+    return run_hub(cfg, inputs, workers, job);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "face_anonymizer.hpp"
+
+#include <string>
+
+// Hub mode: thousands of mostly idle MJPEG cameras in one process (Linux,
+// needs make HUB=1, which also builds with C++20).
+//
+// A thread per camera costs a stack and a context switch per frame, even for
+// a camera that sends one frame every few seconds. In hub mode every camera
+// connection is a C++20 coroutine on an epoll event loop instead: it sleeps
+// (a few hundred bytes, no thread) until its socket has data, collects the
+// next JPEG, and hands it to a small worker pool that decodes, detects, masks
+// and encodes it. The masked streams are served back as MJPEG over HTTP from
+// the same event loops. A handful of threads serve all cameras and viewers.
+//
+// Inputs are HTTP URLs of multipart MJPEG streams (what most IP cameras offer
+// as "MJPEG" or "video.cgi"); each viewer gets http://<host>:<port>/<n>.mjpg.
+struct HubConfig {
+    // Text file with one http:// MJPEG URL per line, as for --prefork.
+    std::string inputs_file;
+    // Port serving the masked streams (0 = no server).
+    int port = 8090;
+    // Event loop threads for all camera and viewer connections.
+    int io_threads = 1;
+    // Threads that decode, detect, mask and encode (0 = one per available core).
+    int workers = 0;
+    // JPEG quality of the masked frames.
+    int jpeg_quality = 80;
+    // Seconds between status lines (0 = only at exit).
+    int status_interval_s = 10;
+};
+
+// Runs until SIGINT/SIGTERM. Returns a process exit code.
+int run_stream_hub(const AnonymizerConfig& anon, const HubConfig& cfg);
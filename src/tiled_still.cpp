@@ -0,0 +1,547 @@
+#include "tiled_still.hpp"
+
+#include "container_limits.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <tiffio.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Smallest face, in pixels, that YuNet reliably finds.
+constexpr int kMinFace = 20;
+
+// Random access to the pixels of a tiled or stripped 8-bit TIFF.
+// Decoded tiles/strips are kept in a small LRU cache bounded in bytes.
+class TiffReader {
+public:
+    explicit TiffReader(size_t cache_limit) : cache_limit_(cache_limit) {}
+    ~TiffReader() {
+        if (tif_) {
+            TIFFClose(tif_);
+        }
+    }
+
+    bool open(const std::string& path, std::string& error) {
+        tif_ = TIFFOpen(path.c_str(), "r");
+        if (!tif_) {
+            error = "cannot open";
+            return false;
+        }
+        uint32_t w = 0, h = 0;
+        uint16_t bps = 0, spp = 0, planar = 0;
+        TIFFGetField(tif_, TIFFTAG_IMAGEWIDTH, &w);
+        TIFFGetField(tif_, TIFFTAG_IMAGELENGTH, &h);
+        TIFFGetFieldDefaulted(tif_, TIFFTAG_BITSPERSAMPLE, &bps);
+        TIFFGetFieldDefaulted(tif_, TIFFTAG_SAMPLESPERPIXEL, &spp);
+        TIFFGetFieldDefaulted(tif_, TIFFTAG_PLANARCONFIG, &planar);
+        TIFFGetFieldDefaulted(tif_, TIFFTAG_PHOTOMETRIC, &photometric_);
+        TIFFGetFieldDefaulted(tif_, TIFFTAG_COMPRESSION, &compression_);
+        if (bps != 8 || planar != PLANARCONFIG_CONTIG || (spp != 1 && spp != 3 && spp != 4)) {
+            error = "only 8-bit, interleaved gray/RGB/RGBA TIFFs are supported";
+            return false;
+        }
+        // Pixels are used as gray or RGB(A). JPEG-compressed YCbCr is decoded to
+        // RGB by libtiff (and written back as RGB); other color models are refused.
+        if (photometric_ == PHOTOMETRIC_YCBCR && compression_ == COMPRESSION_JPEG && spp == 3) {
+            TIFFSetField(tif_, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+            photometric_ = PHOTOMETRIC_RGB;
+        }
+        const bool gray = photometric_ == PHOTOMETRIC_MINISBLACK && spp == 1;
+        const bool rgb = photometric_ == PHOTOMETRIC_RGB && spp >= 3;
+        if (!gray && !rgb) {
+            error = "only min-is-black gray and RGB(A) TIFFs are supported (photometric " +
+                    std::to_string(photometric_) + "); convert palette, min-is-white, YCbCr or CMYK images first";
+            return false;
+        }
+        size_ = cv::Size(static_cast<int>(w), static_cast<int>(h));
+        channels_ = spp;
+
+        tiled_ = TIFFIsTiled(tif_) != 0;
+        if (tiled_) {
+            uint32_t tw = 0, th = 0;
+            TIFFGetField(tif_, TIFFTAG_TILEWIDTH, &tw);
+            TIFFGetField(tif_, TIFFTAG_TILELENGTH, &th);
+            block_ = cv::Size(static_cast<int>(tw), static_cast<int>(th));
+        } else {
+            // A strip is a tile as wide as the image.
+            uint32_t rows = 0;
+            TIFFGetFieldDefaulted(tif_, TIFFTAG_ROWSPERSTRIP, &rows);
+            block_ = cv::Size(size_.width, static_cast<int>(std::min<uint32_t>(rows, h)));
+        }
+        if (block_.width <= 0 || block_.height <= 0) {
+            error = "invalid tile/strip layout";
+            return false;
+        }
+        // Blocks are decoded whole. A file written as one huge strip would be
+        // decoded into memory in one piece, so refuse blocks the cache cannot hold.
+        const size_t block_bytes = static_cast<size_t>(block_.width) * block_.height * channels_;
+        if (block_bytes > cache_limit_) {
+            error = (tiled_ ? "tiles of " : "strips of ") + std::to_string(block_.width) + "x" +
+                    std::to_string(block_.height) + " px (" + std::to_string(block_bytes >> 20) +
+                    " MB each) are too big to read piece by piece; rewrite it tiled first, e.g. "
+                    "tiffcp -t -w 256 -l 256 in.tif out.tif";
+            return false;
+        }
+        blocks_across_ = (size_.width + block_.width - 1) / block_.width;
+        return true;
+    }
+
+    cv::Size size() const { return size_; }
+    int channels() const { return channels_; }
+    uint16_t photometric() const { return photometric_; }
+    uint16_t compression() const { return compression_; }
+    size_t peak_cache_bytes() const { return peak_bytes_; }
+
+    // Pixels of `rect` (image coordinates). Thread-safe. Empty on read errors.
+    cv::Mat read_region(const cv::Rect& rect) {
+        cv::Mat out(rect.size(), CV_8UC(channels_));
+        std::lock_guard<std::mutex> guard(lock_);
+        for (int by = rect.y / block_.height; by <= (rect.y + rect.height - 1) / block_.height; ++by) {
+            for (int bx = rect.x / block_.width; bx <= (rect.x + rect.width - 1) / block_.width; ++bx) {
+                const cv::Mat* block = load_block(bx, by);
+                if (!block) {
+                    return cv::Mat();
+                }
+                cv::Rect block_rect(bx * block_.width, by * block_.height, block_.width, block_.height);
+                cv::Rect overlap = block_rect & rect;
+                (*block)(overlap - block_rect.tl()).copyTo(out(overlap - rect.tl()));
+            }
+        }
+        return out;
+    }
+
+private:
+    // Decoded block (bx, by), from the cache when possible. Caller holds lock_.
+    const cv::Mat* load_block(int bx, int by) {
+        int key = by * blocks_across_ + bx;
+        auto it = index_.find(key);
+        if (it != index_.end()) {
+            lru_.splice(lru_.begin(), lru_, it->second);
+            return &it->second->second;
+        }
+
+        cv::Mat block(block_, CV_8UC(channels_));
+        tmsize_t bytes = static_cast<tmsize_t>(block.total() * block.elemSize());
+        tmsize_t got = tiled_
+            ? TIFFReadEncodedTile(tif_, TIFFComputeTile(tif_, bx * block_.width, by * block_.height, 0, 0), block.data, bytes)
+            : TIFFReadEncodedStrip(tif_, static_cast<tstrip_t>(by), block.data, bytes);
+        if (got < 0) {
+            return nullptr;
+        }
+
+        lru_.emplace_front(key, std::move(block));
+        index_[key] = lru_.begin();
+        bytes_ += static_cast<size_t>(bytes);
+        peak_bytes_ = std::max(peak_bytes_, bytes_);
+        // Always keep the newest block, even if it alone exceeds the limit.
+        while (bytes_ > cache_limit_ && lru_.size() > 1) {
+            auto& victim = lru_.back();
+            bytes_ -= victim.second.total() * victim.second.elemSize();
+            index_.erase(victim.first);
+            lru_.pop_back();
+        }
+        return &lru_.front().second;
+    }
+
+    TIFF* tif_ = nullptr;
+    cv::Size size_;
+    int channels_ = 0;
+    uint16_t photometric_ = PHOTOMETRIC_RGB;
+    uint16_t compression_ = COMPRESSION_NONE;
+    bool tiled_ = false;
+    cv::Size block_;
+    int blocks_across_ = 1;
+
+    std::mutex lock_;
+    size_t cache_limit_;
+    size_t bytes_ = 0;
+    size_t peak_bytes_ = 0;
+    std::list<std::pair<int, cv::Mat>> lru_;
+    std::unordered_map<int, std::list<std::pair<int, cv::Mat>>::iterator> index_;
+};
+
+// Writes a tiled TIFF in row-major tile order.
+class TiffTileWriter {
+public:
+    ~TiffTileWriter() {
+        if (tif_) {
+            TIFFClose(tif_);
+        }
+    }
+
+    bool open(const std::string& path, cv::Size size, int channels, uint16_t photometric,
+              uint16_t compression, int tile) {
+        tif_ = TIFFOpen(path.c_str(), size.area() * static_cast<double>(channels) > 4e9 ? "w8" : "w");
+        if (!tif_) {
+            return false;
+        }
+        TIFFSetField(tif_, TIFFTAG_IMAGEWIDTH, static_cast<uint32_t>(size.width));
+        TIFFSetField(tif_, TIFFTAG_IMAGELENGTH, static_cast<uint32_t>(size.height));
+        TIFFSetField(tif_, TIFFTAG_BITSPERSAMPLE, 8);
+        TIFFSetField(tif_, TIFFTAG_SAMPLESPERPIXEL, channels);
+        TIFFSetField(tif_, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tif_, TIFFTAG_PHOTOMETRIC, photometric);
+        TIFFSetField(tif_, TIFFTAG_COMPRESSION, compression);
+        TIFFSetField(tif_, TIFFTAG_TILEWIDTH, static_cast<uint32_t>(tile));
+        TIFFSetField(tif_, TIFFTAG_TILELENGTH, static_cast<uint32_t>(tile));
+        if (channels == 4) {
+            uint16_t extra = EXTRASAMPLE_UNASSALPHA;
+            TIFFSetField(tif_, TIFFTAG_EXTRASAMPLES, 1, &extra);
+        }
+        buffer_.create(tile, tile, CV_8UC(channels));
+        return true;
+    }
+
+    // `pixels` covers the tile at (x, y); edge tiles may be smaller than a full tile.
+    bool write_tile(int x, int y, const cv::Mat& pixels) {
+        buffer_.setTo(cv::Scalar::all(0));
+        pixels.copyTo(buffer_(cv::Rect(0, 0, pixels.cols, pixels.rows)));
+        ttile_t index = TIFFComputeTile(tif_, static_cast<uint32_t>(x), static_cast<uint32_t>(y), 0, 0);
+        tmsize_t bytes = static_cast<tmsize_t>(buffer_.total() * buffer_.elemSize());
+        return TIFFWriteEncodedTile(tif_, index, buffer_.data, bytes) >= 0;
+    }
+
+private:
+    TIFF* tif_ = nullptr;
+    cv::Mat buffer_;
+};
+
+// YuNet wants BGR; TIFF stores RGB (or gray / RGBA).
+void to_bgr(const cv::Mat& pixels, cv::Mat& bgr) {
+    if (pixels.channels() == 1) {
+        cv::cvtColor(pixels, bgr, cv::COLOR_GRAY2BGR);
+    } else if (pixels.channels() == 4) {
+        cv::cvtColor(pixels, bgr, cv::COLOR_RGBA2BGR);
+    } else {
+        cv::cvtColor(pixels, bgr, cv::COLOR_RGB2BGR);
+    }
+}
+
+// Start offsets of windows of `tile` covering [0, length) with `overlap`.
+std::vector<int> tile_starts(int length, int tile, int overlap) {
+    std::vector<int> starts;
+    int step = std::max(1, tile - overlap);
+    for (int s = 0;; s += step) {
+        if (s + tile >= length) {
+            starts.push_back(std::max(0, length - tile));
+            break;
+        }
+        starts.push_back(s);
+    }
+    return starts;
+}
+
+// Replace overlapping boxes by their bounding box until all boxes are disjoint.
+// Each pixel then belongs to at most one mosaic grid, which keeps seams consistent.
+std::vector<cv::Rect> merge_overlapping(std::vector<cv::Rect> boxes) {
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < boxes.size() && !merged; ++i) {
+            for (size_t j = i + 1; j < boxes.size(); ++j) {
+                if ((boxes[i] & boxes[j]).area() > 0) {
+                    boxes[i] |= boxes[j];
+                    boxes.erase(boxes.begin() + static_cast<std::ptrdiff_t>(j));
+                    merged = true;
+                    break;
+                }
+            }
+        }
+    }
+    return boxes;
+}
+
+// Mosaic the part of `box` inside `write_rect`. `region` holds the pixels of
+// `region_rect`, which must extend at least one block past `write_rect` so every
+// touched cell is complete. Cells are anchored at the box corner in image
+// coordinates, so neighbouring tiles compute identical cell colors.
+void pixelate_box_on_grid(cv::Mat& region, const cv::Rect& region_rect, const cv::Rect& box,
+                          const cv::Rect& write_rect, int block) {
+    cv::Rect target = box & write_rect;
+    if (target.area() <= 0) {
+        return;
+    }
+    int cx0 = (target.x - box.x) / block;
+    int cx1 = (target.x + target.width - 1 - box.x) / block;
+    int cy0 = (target.y - box.y) / block;
+    int cy1 = (target.y + target.height - 1 - box.y) / block;
+    for (int cy = cy0; cy <= cy1; ++cy) {
+        for (int cx = cx0; cx <= cx1; ++cx) {
+            cv::Rect cell = cv::Rect(box.x + cx * block, box.y + cy * block, block, block) & box;
+            cv::Scalar color = cv::mean(region((cell & region_rect) - region_rect.tl()));
+            region((cell & write_rect) - region_rect.tl()).setTo(color);
+        }
+    }
+}
+
+}  // namespace
+
+int run_tiled_still(const AnonymizerConfig& anon, const TiledStillConfig& cfg) {
+    TiffReader reader(cfg.cache_bytes);
+    std::string error;
+    if (!reader.open(cfg.input_path, error)) {
+        std::cerr << "Failed to read TIFF " << cfg.input_path << ": " << error << std::endl;
+        return 1;
+    }
+    const cv::Size size = reader.size();
+    const int tile = std::max(64, cfg.detect_tile);
+    const int overlap = std::min(std::max(0, cfg.detect_overlap), tile / 2);
+    const int block = std::max(2, anon.pixel_block);
+    if (anon.mask_style != MaskStyle::Pixelate) {
+        std::cerr << "Tiled mode only supports pixelation; using it instead of blur." << std::endl;
+    }
+
+    // 1) Detection on overlapping tiles, in parallel.
+    auto tiles_of = [&](cv::Size image) {
+        std::vector<cv::Rect> rects;
+        for (int y : tile_starts(image.height, tile, overlap)) {
+            for (int x : tile_starts(image.width, tile, overlap)) {
+                rects.push_back(cv::Rect(x, y, std::min(tile, image.width), std::min(tile, image.height)));
+            }
+        }
+        return rects;
+    };
+    const std::vector<cv::Rect> tiles = tiles_of(size);
+
+    // Overview pyramid. A face bigger than the overlap can be cut by every tile,
+    // so each level is `step` times smaller than the one before, small enough
+    // that such a face fits in one tile of the next level, large enough that
+    // it is still kMinFace px there. Levels are added until one fits in a tile.
+    struct Level {
+        cv::Size size;
+        // Image pixels per level pixel.
+        double fx = 1.0;
+        double fy = 1.0;
+        // Whole level, when it fits in the cache budget. Bigger levels are
+        // never held in memory; their tiles are shrunk from the image on demand.
+        cv::Mat pixels;
+    };
+    const int step = std::max(2, overlap / kMinFace);
+    std::vector<Level> levels;
+    int first_kept = -1;
+    for (double factor = step; (levels.empty() ? std::max(size.width, size.height)
+                                               : std::max(levels.back().size.width, levels.back().size.height)) > tile;
+         factor *= step) {
+        Level level;
+        level.size = cv::Size(std::max(1, static_cast<int>(std::ceil(size.width / factor))),
+                              std::max(1, static_cast<int>(std::ceil(size.height / factor))));
+        level.fx = size.width / static_cast<double>(level.size.width);
+        level.fy = size.height / static_cast<double>(level.size.height);
+        if (level.size.area() * 3.0 <= static_cast<double>(cfg.cache_bytes)) {
+            level.pixels = cv::Mat(level.size, CV_8UC3, cv::Scalar::all(0));
+            if (first_kept < 0) {
+                first_kept = static_cast<int>(levels.size());
+            }
+        }
+        levels.push_back(level);
+    }
+
+    // Image rect `r` in the coordinates of `level`, rounded outwards.
+    auto to_level = [](const Level& level, const cv::Rect& r) {
+        cv::Rect scaled(cv::Point(static_cast<int>(r.x / level.fx), static_cast<int>(r.y / level.fy)),
+                        cv::Point(static_cast<int>(std::ceil(r.br().x / level.fx)),
+                                  static_cast<int>(std::ceil(r.br().y / level.fy))));
+        return clamp_rect(scaled, level.size.width, level.size.height);
+    };
+
+    // Pixels of `rect` (level coordinates) of a level that is not kept, shrunk
+    // from the image in tile-sized pieces, so only one piece is decoded at a time.
+    auto shrink_region = [&](const Level& level, const cv::Rect& rect, cv::Mat& out) {
+        out.create(rect.size(), CV_8UC3);
+        out.setTo(cv::Scalar::all(0));
+        const cv::Rect src = clamp_rect(
+            cv::Rect(cv::Point(static_cast<int>(rect.x * level.fx), static_cast<int>(rect.y * level.fy)),
+                     cv::Point(static_cast<int>(std::ceil(rect.br().x * level.fx)),
+                               static_cast<int>(std::ceil(rect.br().y * level.fy)))),
+            size.width, size.height);
+        cv::Mat bgr, small;
+        for (int y = src.y; y < src.br().y; y += tile) {
+            for (int x = src.x; x < src.br().x; x += tile) {
+                const cv::Rect piece = cv::Rect(x, y, tile, tile) & src;
+                cv::Mat pixels = reader.read_region(piece);
+                if (pixels.empty()) {
+                    return false;
+                }
+                to_bgr(pixels, bgr);
+                const cv::Rect dst = to_level(level, piece) & rect;
+                if (dst.area() > 0) {
+                    cv::resize(bgr, small, dst.size(), 0, 0, cv::INTER_AREA);
+                    small.copyTo(out(dst - rect.tl()));
+                }
+            }
+        }
+        return true;
+    };
+
+    int workers = cfg.threads > 0 ? cfg.threads : available_cpus();
+    workers = std::min<int>(workers, static_cast<int>(tiles.size()));
+    if (workers > 1) {
+        // Parallelism comes from tiles; keep OpenCV from spawning threads per tile too.
+        cv::setNumThreads(1);
+    }
+
+    // Runs job(detector, i) for every i < count on the worker threads, each with its own detector.
+    std::atomic<bool> failed{false};
+    auto run_parallel = [&](size_t count, const std::function<bool(YuNetDetector&, size_t)>& job) {
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> pool;
+        for (int t = 0; t < workers; ++t) {
+            pool.emplace_back([&] {
+                cv::Ptr<cv::FaceDetectorYN> net = create_yunet(anon, cv::Size(tile, tile));
+                if (net.empty()) {
+                    failed = true;
+                    return;
+                }
+                // Padding is applied later in image coordinates, so tile edges do not clip it.
+                YuNetDetector detector(net, 0.0f);
+                for (size_t i = next++; i < count && !failed; i = next++) {
+                    if (!job(detector, i)) {
+                        failed = true;
+                    }
+                }
+            });
+        }
+        for (auto& t : pool) {
+            t.join();
+        }
+    };
+
+    std::mutex results_lock;
+    std::vector<cv::Rect> boxes;
+    // Full-resolution tiles; each is also shrunk into the first kept level.
+    run_parallel(tiles.size(), [&](YuNetDetector& detector, size_t i) {
+        thread_local cv::Mat bgr, small;
+        const cv::Rect& r = tiles[i];
+        cv::Mat pixels = reader.read_region(r);
+        if (pixels.empty()) {
+            return false;
+        }
+        to_bgr(pixels, bgr);
+        std::vector<cv::Rect> found = detector.detect(bgr);
+
+        cv::Rect dst;
+        if (first_kept >= 0) {
+            dst = to_level(levels[first_kept], r);
+            if (dst.area() > 0) {
+                cv::resize(bgr, small, dst.size(), 0, 0, cv::INTER_AREA);
+            }
+        }
+
+        std::lock_guard<std::mutex> guard(results_lock);
+        for (const auto& f : found) {
+            boxes.push_back(f + r.tl());
+        }
+        if (dst.area() > 0) {
+            small.copyTo(levels[first_kept].pixels(dst));
+        }
+        return true;
+    });
+    if (failed) {
+        std::cerr << "Detection failed (model or TIFF read error)." << std::endl;
+        return 1;
+    }
+
+    // Kept levels after the first come from the one before. Every level is
+    // detected in tiles like the full image; boxes are scaled back to the image.
+    for (size_t l = 0; l < levels.size() && !failed; ++l) {
+        Level& level = levels[l];
+        if (static_cast<int>(l) > first_kept && first_kept >= 0) {
+            cv::resize(levels[l - 1].pixels, level.pixels, level.size, 0, 0, cv::INTER_AREA);
+        }
+        const std::vector<cv::Rect> level_tiles = tiles_of(level.size);
+        run_parallel(level_tiles.size(), [&](YuNetDetector& detector, size_t i) {
+            thread_local cv::Mat bgr;
+            const cv::Rect& r = level_tiles[i];
+            if (level.pixels.empty()) {
+                if (!shrink_region(level, r, bgr)) {
+                    return false;
+                }
+            } else {
+                level.pixels(r).copyTo(bgr);
+            }
+            std::vector<cv::Rect> found = detector.detect(bgr);
+            std::lock_guard<std::mutex> guard(results_lock);
+            for (const auto& f : found) {
+                boxes.push_back(cv::Rect(static_cast<int>((f.x + r.x) * level.fx), static_cast<int>((f.y + r.y) * level.fy),
+                                         static_cast<int>(std::ceil(f.width * level.fx)),
+                                         static_cast<int>(std::ceil(f.height * level.fy))));
+            }
+            return true;
+        });
+    }
+    if (failed) {
+        std::cerr << "Detection failed on the overview levels." << std::endl;
+        return 1;
+    }
+    const size_t raw_faces = boxes.size();
+    for (auto& b : boxes) {
+        b = expand_rect(b, anon.face_padding, size.width, size.height);
+    }
+    boxes = merge_overlapping(boxes);
+
+    // 2) Masking, streamed tile by tile into a tiled TIFF.
+    const int out_tile = std::max(16, cfg.output_tile / 16 * 16);
+    TiffTileWriter writer;
+    if (!writer.open(cfg.output_path, size, reader.channels(), reader.photometric(), reader.compression(), out_tile)) {
+        std::cerr << "Failed to create TIFF " << cfg.output_path << std::endl;
+        return 1;
+    }
+    for (int y = 0; y < size.height; y += out_tile) {
+        for (int x = 0; x < size.width; x += out_tile) {
+            cv::Rect tile_rect = clamp_rect(cv::Rect(x, y, out_tile, out_tile), size.width, size.height);
+            std::vector<cv::Rect> hits;
+            for (const auto& b : boxes) {
+                if ((b & tile_rect).area() > 0) {
+                    hits.push_back(b);
+                }
+            }
+
+            // Face-free tiles are copied as they are; others get a halo for complete cells.
+            cv::Rect region_rect = tile_rect;
+            if (!hits.empty()) {
+                region_rect = clamp_rect(
+                    cv::Rect(x - block, y - block, tile_rect.width + 2 * block, tile_rect.height + 2 * block),
+                    size.width, size.height);
+            }
+            cv::Mat region = reader.read_region(region_rect);
+            if (region.empty()) {
+                std::cerr << "Failed to read TIFF region." << std::endl;
+                return 1;
+            }
+            for (const auto& b : hits) {
+                pixelate_box_on_grid(region, region_rect, b, tile_rect, block);
+            }
+            if (!writer.write_tile(x, y, region(tile_rect - region_rect.tl()))) {
+                std::cerr << "Failed to write TIFF tile." << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    std::cout << "Tiled still: " << size.width << "x" << size.height << ", " << tiles.size()
+              << " detection tiles on " << workers << " threads, " << levels.size() << " overview levels";
+    if (!levels.empty()) {
+        std::cout << " (largest " << levels[0].size.width << "x" << levels[0].size.height << ", "
+                  << (levels.size() - (first_kept < 0 ? levels.size() : first_kept)) << " kept in memory)";
+    }
+    std::cout << ", " << raw_faces << " detections -> "
+              << boxes.size() << " masked regions, peak tile cache "
+              << reader.peak_cache_bytes() / (1024.0 * 1024.0) << " MB" << std::endl;
+    return 0;
+}
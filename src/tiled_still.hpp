@@ -0,0 +1,38 @@
+#pragma once
+
+#include "face_anonymizer.hpp"
+
+#include <cstddef>
+#include <string>
+
+// Still-image mode for huge (hundreds of megapixels) TIFFs.
+//
+// The image is never held in memory as a whole:
+//   1) Detection: overlapping tiles are read and run through YuNet on several
+//      threads. A pyramid of overview images, detected in tiles the same way,
+//      catches faces too big to fit inside one tile (see `detect_overlap`).
+//      Overview levels bigger than `cache_bytes` are never held in memory:
+//      each of their tiles is shrunk from the input when it is needed.
+//   2) Masking: the output is written as a tiled TIFF, one tile at a time.
+//      Mosaic cells are laid out on a grid anchored at each face box, and every
+//      tile is read with a one-block halo, so cells crossing tile seams get
+//      the same color on both sides.
+struct TiledStillConfig {
+    std::string input_path;
+    std::string output_path;
+    // Detection tile edge and overlap. Faces up to `detect_overlap` pixels are
+    // always fully inside some tile; bigger ones are found on an overview level
+    // where they are at least 20 px. Each level is detect_overlap / 20 times
+    // smaller than the last, so a larger overlap means smaller overviews.
+    int detect_tile = 1024;
+    int detect_overlap = 256;
+    // Tile edge of the written TIFF (multiple of 16, as TIFF requires).
+    int output_tile = 256;
+    // Detection threads (0 = one per core the container may use).
+    int threads = 0;
+    // Cap for decoded input tiles/strips kept around for reuse.
+    size_t cache_bytes = 64u << 20;
+};
+
+// Returns a process exit code.
+int run_tiled_still(const AnonymizerConfig& anon, const TiledStillConfig& cfg);
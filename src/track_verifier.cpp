@@ -0,0 +1,110 @@
+#include "track_verifier.hpp"
+
+#include "face_anonymizer.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <utility>
+
+namespace {
+
+int64_t us_since(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t).count();
+}
+
+}  // namespace
+
+void VerifierStats::print(std::ostream& out) const {
+    double full_ms = full_frames ? full_us / 1000.0 / full_frames : 0.0;
+    double check_ms = checks ? verify_us / 1000.0 / checks : 0.0;
+    double frame_ms = verify_frames ? verify_us / 1000.0 / verify_frames : 0.0;
+    out << "verifier: full detection on " << full_frames << "/" << frames << " frames, avg " << full_ms << " ms; "
+        << checks << " crop checks, avg " << check_ms << " ms each (" << frame_ms << " ms per verified frame), "
+        << lost << " tracks lost" << std::endl;
+}
+
+TrackVerifier::TrackVerifier(std::unique_ptr<FaceDetector> full, cv::Ptr<cv::FaceDetectorYN> verifier,
+                             float face_padding, VerifierConfig cfg)
+    : full_(std::move(full)),
+      verifier_(std::move(verifier)),
+      face_padding_(face_padding),
+      cfg_(cfg),
+      stats_(std::make_shared<VerifierStats>()) {
+    verifier_->setInputSize(cv::Size(cfg_.crop_size, cfg_.crop_size));
+}
+
+bool TrackVerifier::verify(const cv::Mat& frame, const cv::Rect& box, cv::Rect& found) {
+    // Square crop centered on the box, clamped to the frame.
+    int side = static_cast<int>(std::max(box.width, box.height) * cfg_.crop_scale);
+    cv::Point center(box.x + box.width / 2, box.y + box.height / 2);
+    cv::Rect area = clamp_rect(cv::Rect(center.x - side / 2, center.y - side / 2, side, side), frame.cols, frame.rows);
+    if (area.width < 8 || area.height < 8) {
+        return false;
+    }
+
+    // The verifier input is always crop_size x crop_size; a crop cut by the frame edge is stretched.
+    const cv::Mat* input = &crop_;
+    cv::resize(frame(area), crop_, cv::Size(cfg_.crop_size, cfg_.crop_size), 0, 0, cv::INTER_LINEAR);
+    if (crop_.channels() == 4) {
+        cv::cvtColor(crop_, bgr_, cv::COLOR_BGRA2BGR);
+        input = &bgr_;
+    }
+    verifier_->detect(*input, faces_);
+    if (faces_.rows == 0) {
+        return false;
+    }
+
+    // More than one face in the crop: keep the one nearest the predicted center.
+    const double sx = static_cast<double>(area.width) / cfg_.crop_size;
+    const double sy = static_cast<double>(area.height) / cfg_.crop_size;
+    double best = -1.0;
+    cv::Rect best_box;
+    for (int i = 0; i < faces_.rows; ++i) {
+        const float* row = faces_.ptr<float>(i);
+        cv::Rect r(area.x + cvRound(row[0] * sx), area.y + cvRound(row[1] * sy), cvRound(row[2] * sx),
+                   cvRound(row[3] * sy));
+        double dx = r.x + r.width / 2.0 - center.x;
+        double dy = r.y + r.height / 2.0 - center.y;
+        double d = dx * dx + dy * dy;
+        if (best < 0.0 || d < best) {
+            best = d;
+            best_box = r;
+        }
+    }
+    found = expand_rect(best_box, face_padding_, frame.cols, frame.rows);
+    return found.width > 0 && found.height > 0;
+}
+
+std::vector<cv::Rect> TrackVerifier::detect(const cv::Mat& frame) {
+    stats_->frames++;
+    // New faces are only found here, so this runs on schedule even with no tracks.
+    if (force_full_ || ++since_full_ >= cfg_.detect_every || (skip_check_ && skip_check_())) {
+        auto start = std::chrono::steady_clock::now();
+        tracks_ = full_->detect(frame);
+        stats_->full_us += us_since(start);
+        stats_->full_frames++;
+        since_full_ = 0;
+        force_full_ = false;
+        return tracks_;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<cv::Rect> kept;
+    for (const cv::Rect& box : tracks_) {
+        cv::Rect found;
+        if (verify(frame, box, found)) {
+            kept.push_back(found);
+        } else {
+            stats_->lost++;
+            // A face went missing (or turned away): look at the whole frame next time.
+            force_full_ = true;
+        }
+    }
+    stats_->checks += tracks_.size();
+    stats_->verify_us += us_since(start);
+    stats_->verify_frames++;
+    tracks_ = std::move(kept);
+    return tracks_;
+}
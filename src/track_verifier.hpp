@@ -0,0 +1,76 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/objdetect.hpp>
+
+#include "pipeline.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+// Cheap track confirmation between full-frame detections.
+//
+// A full detection runs only every `detect_every` frames. On the frames between,
+// each face found last time is checked on its own: a small square crop around
+// its box is scaled to `crop_size` and given to a second YuNet instance, whose
+// input size never changes. If the face is still there its box follows it; if
+// not, the track is dropped and the next frame gets a full detection again.
+// A face that enters between full detections is found at the next one.
+struct VerifierConfig {
+    // Full-frame detection every this many frames (1 = verifier off).
+    int detect_every = 1;
+    // Edge of the verifier input in pixels.
+    int crop_size = 128;
+    // Crop edge relative to the larger side of the (padded) face box.
+    float crop_scale = 2.0f;
+};
+
+struct VerifierStats {
+    uint64_t frames = 0;
+    uint64_t full_frames = 0;
+    int64_t full_us = 0;
+    uint64_t verify_frames = 0;
+    uint64_t checks = 0;
+    int64_t verify_us = 0;
+    uint64_t lost = 0;
+
+    void print(std::ostream& out) const;
+};
+
+// Detector stage around any full-frame detector stage.
+class TrackVerifier {
+public:
+    // `verifier` must be its own YuNet instance; it is kept at crop_size x crop_size.
+    TrackVerifier(std::unique_ptr<FaceDetector> full, cv::Ptr<cv::FaceDetectorYN> verifier, float face_padding,
+                  VerifierConfig cfg);
+
+    std::vector<cv::Rect> detect(const cv::Mat& frame);
+
+    // Asked on every frame the full detector would skip; true runs it anyway.
+    // AdaptiveScaleDetector::skip_check() keeps its sweeps on schedule this way.
+    void set_skip_check(std::function<bool()> check) { skip_check_ = std::move(check); }
+
+    // Stays valid after the stage is moved into a pipeline.
+    std::shared_ptr<const VerifierStats> stats() const { return stats_; }
+
+private:
+    // Look for the face of `box` in a crop around it. False if it is gone.
+    bool verify(const cv::Mat& frame, const cv::Rect& box, cv::Rect& found);
+
+    std::unique_ptr<FaceDetector> full_;
+    cv::Ptr<cv::FaceDetectorYN> verifier_;
+    float face_padding_;
+    VerifierConfig cfg_;
+    std::vector<cv::Rect> tracks_;
+    int since_full_ = 0;
+    bool force_full_ = true;
+    std::function<bool()> skip_check_;
+    cv::Mat crop_;
+    cv::Mat bgr_;
+    cv::Mat faces_;
+    std::shared_ptr<VerifierStats> stats_;
+};
@@ -0,0 +1,121 @@
+#include "tracker_state.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <utility>
+
+namespace {
+
+const char* kMagic = "face_pixelate_tracker";
+const int kVersion = 1;
+
+long long unix_ms_now() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+               std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+}  // namespace
+
+bool save_tracker_state(const std::string& path, const FaceTracker& tracker, cv::Size frame_size) {
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        const auto& boxes = tracker.last_boxes();
+        out << kMagic << ' ' << kVersion << '\n'
+            << "saved_ms " << unix_ms_now() << '\n'
+            << "frame_size " << frame_size.width << ' ' << frame_size.height << '\n'
+            << "missed_frames " << tracker.missed_frames() << '\n'
+            << "boxes " << boxes.size() << '\n';
+        for (const auto& b : boxes) {
+            out << b.x << ' ' << b.y << ' ' << b.width << ' ' << b.height << '\n';
+        }
+        if (!out.flush()) {
+            return false;
+        }
+    }
+    // rename() replaces the old snapshot in one step, so a crash never leaves half a file.
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool load_tracker_state(const std::string& path, FaceTracker& tracker, cv::Size frame_size,
+                        std::chrono::milliseconds max_age) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+
+    std::string magic, key;
+    int version = 0;
+    long long saved_ms = 0;
+    int width = 0, height = 0, missed = 0;
+    size_t count = 0;
+    if (!(in >> magic >> version) || magic != kMagic || version != kVersion) {
+        return false;
+    }
+    if (!(in >> key >> saved_ms) || key != "saved_ms" ||
+        !(in >> key >> width >> height) || key != "frame_size" ||
+        !(in >> key >> missed) || key != "missed_frames" ||
+        !(in >> key >> count) || key != "boxes") {
+        return false;
+    }
+
+    // Too old, or from a different camera mode: the boxes no longer mean anything.
+    long long age_ms = unix_ms_now() - saved_ms;
+    if (age_ms < 0 || age_ms > max_age.count()) {
+        return false;
+    }
+    if (cv::Size(width, height) != frame_size) {
+        return false;
+    }
+
+    std::vector<cv::Rect> boxes;
+    for (size_t i = 0; i < count; ++i) {
+        cv::Rect b;
+        if (!(in >> b.x >> b.y >> b.width >> b.height)) {
+            return false;
+        }
+        b = clamp_rect(b, frame_size.width, frame_size.height);
+        if (b.width > 0 && b.height > 0) {
+            boxes.push_back(b);
+        }
+    }
+    tracker.restore(boxes, missed);
+    return true;
+}
+
+PersistentTracker::PersistentTracker(FaceTracker tracker, std::string path, cv::Size frame_size,
+                                     std::chrono::milliseconds interval)
+    : tracker_(std::move(tracker)),
+      path_(std::move(path)),
+      frame_size_(frame_size),
+      interval_(interval),
+      last_save_(std::chrono::steady_clock::now()) {}
+
+PersistentTracker::PersistentTracker(PersistentTracker&& other) noexcept
+    : tracker_(std::move(other.tracker_)),
+      path_(std::move(other.path_)),
+      frame_size_(other.frame_size_),
+      interval_(other.interval_),
+      last_save_(other.last_save_) {
+    other.path_.clear();
+}
+
+PersistentTracker::~PersistentTracker() {
+    if (!path_.empty()) {
+        save_tracker_state(path_, tracker_, frame_size_);
+    }
+}
+
+std::vector<cv::Rect> PersistentTracker::update(const std::vector<cv::Rect>& detected) {
+    std::vector<cv::Rect> boxes = tracker_.update(detected);
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_save_ >= interval_) {
+        save_tracker_state(path_, tracker_, frame_size_);
+        last_save_ = now;
+    }
+    return boxes;
+}
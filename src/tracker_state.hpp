@@ -0,0 +1,47 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include "face_anonymizer.hpp"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Small on-disk snapshot of FaceTracker state, so a restarted process masks
+// faces from its very first frame instead of waiting for fresh detections.
+//
+// File format (text, a few hundred bytes):
+//   face_pixelate_tracker 1
+//   saved_ms <unix time in ms>
+//   frame_size <w> <h>
+//   missed_frames <n>
+//   boxes <count>
+//   <x> <y> <w> <h>    (one line per box)
+
+// Write atomically (temp file + rename). Returns false on I/O errors.
+bool save_tracker_state(const std::string& path, const FaceTracker& tracker, cv::Size frame_size);
+
+// Restore into `tracker` if the snapshot exists, matches `frame_size` and is at
+// most `max_age` old. Returns true when state was restored.
+bool load_tracker_state(const std::string& path, FaceTracker& tracker, cv::Size frame_size,
+                        std::chrono::milliseconds max_age);
+
+// Tracker stage that snapshots its state every `interval` and once more on shutdown.
+class PersistentTracker {
+public:
+    PersistentTracker(FaceTracker tracker, std::string path, cv::Size frame_size, std::chrono::milliseconds interval);
+    PersistentTracker(PersistentTracker&& other) noexcept;
+    PersistentTracker& operator=(PersistentTracker&&) = delete;
+    ~PersistentTracker();
+
+    std::vector<cv::Rect> update(const std::vector<cv::Rect>& detected);
+
+private:
+    FaceTracker tracker_;
+    // Empty once moved from, so only the live instance writes on shutdown.
+    std::string path_;
+    cv::Size frame_size_;
+    std::chrono::milliseconds interval_;
+    std::chrono::steady_clock::time_point last_save_;
+};
@@ -0,0 +1,1256 @@
+#include "yunet_engine.hpp"
+
+#include <opencv2/core/hal/intrin.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <numeric>
+#include <utility>
+
+// ---------------------------------------------------------------------------
+// Network description
+// ---------------------------------------------------------------------------
+
+namespace {
+
+enum class Op { Conv, MaxPool, UpsampleAdd };
+
+struct Layer {
+    Op op = Op::Conv;
+    // Tensor ids. UpsampleAdd: out = in + upsample2x(in2).
+    int in = -1;
+    int in2 = -1;
+    int out = -1;
+    // Conv only. Weights are [cout][cin / group][k][k].
+    int cin = 0, cout = 0, kernel = 0, stride = 1, pad = 0, group = 1;
+    bool relu = false;
+    std::vector<float> weights;
+    std::vector<float> bias;
+};
+
+enum HeadKind { kCls = 0, kObj = 1, kBbox = 2, kKps = 3 };
+const int kStrides[3] = {8, 16, 32};
+const int kHeadChannels[4] = {1, 1, 4, 10};
+
+}  // namespace
+
+struct YuNetModel {
+    std::vector<Layer> layers;
+    // Tensor 0 is the input image.
+    int tensors = 1;
+    // Head tensor per level (stride 8, 16, 32) and kind.
+    int heads[3][4];
+    // Whether the graph applies a sigmoid to that head.
+    bool sigmoid[3][4];
+    size_t weight_bytes = 0;
+};
+
+// ---------------------------------------------------------------------------
+// ONNX reading: a minimal protobuf decoder for the few messages we need.
+// ---------------------------------------------------------------------------
+
+namespace {
+
+struct PbReader {
+    const uint8_t* p = nullptr;
+    const uint8_t* end = nullptr;
+    bool ok = true;
+
+    uint64_t varint() {
+        uint64_t v = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7) {
+            uint8_t b = *p++;
+            v |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                return v;
+            }
+        }
+        ok = false;
+        return 0;
+    }
+
+    // Next field. Length-delimited fields come back in `bytes`, others in `value`.
+    bool next(int& field, int& wire, uint64_t& value, PbReader& bytes) {
+        if (!ok || p >= end) {
+            return false;
+        }
+        uint64_t key = varint();
+        field = static_cast<int>(key >> 3);
+        wire = static_cast<int>(key & 7);
+        if (wire == 0) {
+            value = varint();
+        } else if (wire == 1 && end - p >= 8) {
+            std::memcpy(&value, p, 8);
+            p += 8;
+        } else if (wire == 5 && end - p >= 4) {
+            uint32_t v;
+            std::memcpy(&v, p, 4);
+            value = v;
+            p += 4;
+        } else if (wire == 2) {
+            uint64_t n = varint();
+            if (static_cast<uint64_t>(end - p) < n) {
+                ok = false;
+                return false;
+            }
+            bytes = PbReader{p, p + n, true};
+            p += n;
+        } else {
+            ok = false;
+        }
+        return ok;
+    }
+
+    std::string str() const { return std::string(reinterpret_cast<const char*>(p), end - p); }
+};
+
+float bits_to_float(uint32_t bits) {
+    float f;
+    std::memcpy(&f, &bits, 4);
+    return f;
+}
+
+// Repeated int64 fields may be packed or not.
+void read_ints(int wire, uint64_t value, PbReader bytes, std::vector<int64_t>& out) {
+    if (wire == 0) {
+        out.push_back(static_cast<int64_t>(value));
+        return;
+    }
+    while (bytes.ok && bytes.p < bytes.end) {
+        out.push_back(static_cast<int64_t>(bytes.varint()));
+    }
+}
+
+void read_floats(int wire, uint64_t value, PbReader bytes, std::vector<float>& out) {
+    if (wire == 5) {
+        out.push_back(bits_to_float(static_cast<uint32_t>(value)));
+        return;
+    }
+    size_t n = (bytes.end - bytes.p) / 4;
+    size_t old = out.size();
+    out.resize(old + n);
+    std::memcpy(out.data() + old, bytes.p, n * 4);
+}
+
+struct OnnxTensor {
+    std::vector<int64_t> dims;
+    std::vector<float> data;  // float tensors only
+};
+
+struct OnnxAttr {
+    std::vector<int64_t> ints;
+    std::vector<float> floats;
+    std::string s;
+};
+
+struct OnnxNode {
+    std::string op;
+    std::vector<std::string> inputs;
+    std::vector<std::string> outputs;
+    std::map<std::string, OnnxAttr> attrs;
+
+    std::vector<int64_t> ints(const std::string& name) const {
+        auto it = attrs.find(name);
+        return it == attrs.end() ? std::vector<int64_t>() : it->second.ints;
+    }
+    int64_t get_int(const std::string& name, int64_t fallback) const {
+        auto v = ints(name);
+        return v.empty() ? fallback : v[0];
+    }
+};
+
+struct OnnxGraph {
+    std::vector<OnnxNode> nodes;
+    std::map<std::string, OnnxTensor> initializers;
+    std::vector<std::string> inputs;
+    std::vector<std::string> outputs;
+};
+
+const int kOnnxFloat = 1;
+
+OnnxTensor parse_tensor(PbReader r, std::string& name) {
+    OnnxTensor t;
+    int type = 0;
+    std::vector<float> raw;
+    int field, wire;
+    uint64_t value = 0;
+    PbReader bytes;
+    while (r.next(field, wire, value, bytes)) {
+        if (field == 1) {
+            read_ints(wire, value, bytes, t.dims);
+        } else if (field == 2) {
+            type = static_cast<int>(value);
+        } else if (field == 4) {
+            read_floats(wire, value, bytes, t.data);
+        } else if (field == 8) {
+            name = bytes.str();
+        } else if (field == 9) {
+            read_floats(2, 0, bytes, raw);
+        }
+    }
+    if (type != kOnnxFloat) {
+        t.data.clear();
+    } else if (t.data.empty()) {
+        t.data = std::move(raw);
+    }
+    return t;
+}
+
+OnnxNode parse_node(PbReader r) {
+    OnnxNode node;
+    int field, wire;
+    uint64_t value = 0;
+    PbReader bytes;
+    while (r.next(field, wire, value, bytes)) {
+        if (field == 1) {
+            node.inputs.push_back(bytes.str());
+        } else if (field == 2) {
+            node.outputs.push_back(bytes.str());
+        } else if (field == 4) {
+            node.op = bytes.str();
+        } else if (field == 5) {
+            OnnxAttr attr;
+            std::string name;
+            int afield, awire;
+            uint64_t avalue = 0;
+            PbReader abytes;
+            while (bytes.next(afield, awire, avalue, abytes)) {
+                if (afield == 1) {
+                    name = abytes.str();
+                } else if (afield == 2 || afield == 7) {
+                    read_floats(awire, avalue, abytes, attr.floats);
+                } else if (afield == 3 || afield == 8) {
+                    read_ints(awire, avalue, abytes, attr.ints);
+                } else if (afield == 4) {
+                    attr.s = abytes.str();
+                }
+            }
+            node.attrs[name] = std::move(attr);
+        }
+    }
+    return node;
+}
+
+// ValueInfoProto: only the name is needed.
+std::string parse_value_name(PbReader r) {
+    int field, wire;
+    uint64_t value = 0;
+    PbReader bytes;
+    while (r.next(field, wire, value, bytes)) {
+        if (field == 1) {
+            return bytes.str();
+        }
+    }
+    return "";
+}
+
+bool parse_onnx(const std::vector<uchar>& data, OnnxGraph& graph) {
+    PbReader model{data.data(), data.data() + data.size(), true};
+    int field, wire;
+    uint64_t value = 0;
+    PbReader bytes;
+    bool found = false;
+    while (model.next(field, wire, value, bytes)) {
+        if (field != 7) {
+            continue;
+        }
+        found = true;
+        PbReader g = bytes;
+        PbReader item;
+        while (g.next(field, wire, value, item)) {
+            if (field == 1) {
+                graph.nodes.push_back(parse_node(item));
+            } else if (field == 5) {
+                std::string name;
+                OnnxTensor t = parse_tensor(item, name);
+                graph.initializers[name] = std::move(t);
+            } else if (field == 11) {
+                graph.inputs.push_back(parse_value_name(item));
+            } else if (field == 12) {
+                graph.outputs.push_back(parse_value_name(item));
+            }
+        }
+        if (!g.ok) {
+            return false;
+        }
+    }
+    return found && model.ok;
+}
+
+// ---------------------------------------------------------------------------
+// Graph -> layer list, with BatchNorm folding and ReLU fusion.
+// ---------------------------------------------------------------------------
+
+bool fail(const std::string& why) {
+    std::cerr << "Built-in YuNet: " << why << std::endl;
+    return false;
+}
+
+bool build_model(const OnnxGraph& g, YuNetModel& m) {
+    // How many nodes read each value: only a single-use conv output may be fused.
+    std::map<std::string, int> uses;
+    for (const OnnxNode& n : g.nodes) {
+        for (const std::string& in : n.inputs) {
+            uses[in]++;
+        }
+    }
+    for (const std::string& out : g.outputs) {
+        uses[out]++;
+    }
+
+    struct Value {
+        int tensor = -1;
+        int layer = -1;  // producing layer, for fusion
+        bool sigmoid = false;
+    };
+    std::map<std::string, Value> values;
+    for (const std::string& in : g.inputs) {
+        if (!g.initializers.count(in)) {
+            values[in] = Value{0, -1, false};
+            break;
+        }
+    }
+    // Resize outputs wait for the Add that consumes them.
+    std::map<std::string, int> upsampled;
+
+    auto value_of = [&](const std::string& name, Value& v) {
+        auto it = values.find(name);
+        if (it == values.end()) {
+            return false;
+        }
+        v = it->second;
+        return true;
+    };
+    auto weights_of = [&](const std::string& name) -> const OnnxTensor* {
+        auto it = g.initializers.find(name);
+        return it == g.initializers.end() || it->second.data.empty() ? nullptr : &it->second;
+    };
+
+    for (const OnnxNode& n : g.nodes) {
+        Value x;
+        if (n.inputs.empty() || n.outputs.size() != 1) {
+            return fail("unexpected " + n.op + " node");
+        }
+        const std::string& out = n.outputs[0];
+        if (n.op == "Add") {
+            // One side comes from a 2x nearest Resize: fuse the two.
+            int side = upsampled.count(n.inputs[0]) ? 0 : upsampled.count(n.inputs[1]) ? 1 : -1;
+            if (n.inputs.size() != 2 || side < 0 || !value_of(n.inputs[1 - side], x)) {
+                return fail("only Add(x, Resize(y)) is supported");
+            }
+            Layer l;
+            l.op = Op::UpsampleAdd;
+            l.in = x.tensor;
+            l.in2 = upsampled[n.inputs[side]];
+            l.out = m.tensors++;
+            values[out] = Value{l.out, static_cast<int>(m.layers.size()), false};
+            m.layers.push_back(std::move(l));
+            continue;
+        }
+        if (!value_of(n.inputs[0], x)) {
+            return fail("input of " + n.op + " node not found");
+        }
+
+        if (n.op == "Conv") {
+            const OnnxTensor* w = n.inputs.size() > 1 ? weights_of(n.inputs[1]) : nullptr;
+            const OnnxTensor* b = n.inputs.size() > 2 ? weights_of(n.inputs[2]) : nullptr;
+            if (!w || w->dims.size() != 4 || w->dims[2] != w->dims[3]) {
+                return fail("Conv without square 2D weights");
+            }
+            Layer l;
+            l.op = Op::Conv;
+            l.group = static_cast<int>(n.get_int("group", 1));
+            l.cout = static_cast<int>(w->dims[0]);
+            l.cin = static_cast<int>(w->dims[1]) * l.group;
+            l.kernel = static_cast<int>(w->dims[2]);
+            std::vector<int64_t> strides = n.ints("strides");
+            std::vector<int64_t> pads = n.ints("pads");
+            std::vector<int64_t> dilations = n.ints("dilations");
+            l.stride = strides.empty() ? 1 : static_cast<int>(strides[0]);
+            l.pad = pads.empty() ? 0 : static_cast<int>(pads[0]);
+            for (int64_t s : strides) {
+                if (s != l.stride) {
+                    return fail("Conv with different strides per axis");
+                }
+            }
+            for (int64_t p : pads) {
+                if (p != l.pad) {
+                    return fail("Conv with asymmetric padding");
+                }
+            }
+            for (int64_t d : dilations) {
+                if (d != 1) {
+                    return fail("dilated Conv");
+                }
+            }
+            l.weights = w->data;
+            l.bias = b ? b->data : std::vector<float>(l.cout, 0.0f);
+            if (l.bias.size() != static_cast<size_t>(l.cout) ||
+                l.weights.size() != static_cast<size_t>(l.cout) * (l.cin / l.group) * l.kernel * l.kernel) {
+                return fail("Conv weight size mismatch");
+            }
+            l.in = x.tensor;
+            l.out = m.tensors++;
+            values[out] = Value{l.out, static_cast<int>(m.layers.size()), false};
+            m.layers.push_back(std::move(l));
+        } else if (n.op == "BatchNormalization" || n.op == "Relu") {
+            // Fold into the conv that feeds it, if nothing else reads the conv output.
+            if (x.layer < 0 || m.layers[x.layer].op != Op::Conv || uses[n.inputs[0]] != 1) {
+                return fail(n.op + " that does not follow a Conv");
+            }
+            Layer& conv = m.layers[x.layer];
+            if (n.op == "Relu") {
+                conv.relu = true;
+            } else {
+                const OnnxTensor* scale = weights_of(n.inputs[1]);
+                const OnnxTensor* shift = weights_of(n.inputs[2]);
+                const OnnxTensor* mean = weights_of(n.inputs[3]);
+                const OnnxTensor* var = weights_of(n.inputs[4]);
+                auto eps_it = n.attrs.find("epsilon");
+                float eps = eps_it == n.attrs.end() || eps_it->second.floats.empty() ? 1e-5f : eps_it->second.floats[0];
+                if (conv.relu || !scale || !shift || !mean || !var) {
+                    return fail("unsupported BatchNormalization");
+                }
+                size_t per_out = conv.weights.size() / conv.cout;
+                for (int c = 0; c < conv.cout; ++c) {
+                    float k = scale->data[c] / std::sqrt(var->data[c] + eps);
+                    for (size_t i = 0; i < per_out; ++i) {
+                        conv.weights[c * per_out + i] *= k;
+                    }
+                    conv.bias[c] = (conv.bias[c] - mean->data[c]) * k + shift->data[c];
+                }
+            }
+            values[out] = x;
+        } else if (n.op == "MaxPool") {
+            std::vector<int64_t> k = n.ints("kernel_shape");
+            std::vector<int64_t> s = n.ints("strides");
+            std::vector<int64_t> p = n.ints("pads");
+            bool pads_zero = std::all_of(p.begin(), p.end(), [](int64_t v) { return v == 0; });
+            if (k != std::vector<int64_t>{2, 2} || s != std::vector<int64_t>{2, 2} || !pads_zero ||
+                n.get_int("ceil_mode", 0) != 0) {
+                return fail("only 2x2 stride 2 MaxPool is supported");
+            }
+            Layer l;
+            l.op = Op::MaxPool;
+            l.in = x.tensor;
+            l.out = m.tensors++;
+            values[out] = Value{l.out, static_cast<int>(m.layers.size()), false};
+            m.layers.push_back(std::move(l));
+        } else if (n.op == "Resize") {
+            const OnnxTensor* scales = n.inputs.size() > 2 ? weights_of(n.inputs[2]) : nullptr;
+            auto mode = n.attrs.find("mode");
+            if (!scales || scales->data != std::vector<float>{1.0f, 1.0f, 2.0f, 2.0f} || mode == n.attrs.end() ||
+                mode->second.s != "nearest") {
+                return fail("only 2x nearest Resize is supported");
+            }
+            upsampled[out] = x.tensor;
+        } else if (n.op == "Transpose" || n.op == "Reshape" || n.op == "Sigmoid") {
+            // Head layout changes: the decoder reads the conv output directly.
+            x.sigmoid = x.sigmoid || n.op == "Sigmoid";
+            x.layer = -1;
+            values[out] = x;
+        } else {
+            return fail("unsupported operator " + n.op);
+        }
+    }
+
+    // Outputs are named like "cls_8", "bbox_32".
+    const char* kinds[4] = {"cls", "obj", "bbox", "kps"};
+    int found = 0;
+    for (int level = 0; level < 3; ++level) {
+        for (int kind = 0; kind < 4; ++kind) {
+            std::string name = std::string(kinds[kind]) + "_" + std::to_string(kStrides[level]);
+            Value v;
+            if (!value_of(name, v)) {
+                return fail("no output " + name + " (expected the 2023mar YuNet model)");
+            }
+            const Layer* producer = nullptr;
+            for (const Layer& l : m.layers) {
+                if (l.out == v.tensor) {
+                    producer = &l;
+                }
+            }
+            if (!producer || producer->op != Op::Conv || producer->cout != kHeadChannels[kind]) {
+                return fail("unexpected shape of output " + name);
+            }
+            m.heads[level][kind] = v.tensor;
+            m.sigmoid[level][kind] = v.sigmoid;
+            found++;
+        }
+    }
+    for (const Layer& l : m.layers) {
+        m.weight_bytes += (l.weights.size() + l.bias.size()) * sizeof(float);
+    }
+    return found == 12;
+}
+
+// ---------------------------------------------------------------------------
+// Memory plan: tensor shapes and arena offsets for one input size.
+// ---------------------------------------------------------------------------
+
+struct Shape {
+    int c = 0, h = 0, w = 0;
+    size_t size() const { return static_cast<size_t>(c) * h * w; }
+};
+
+struct Plan {
+    cv::Size input;
+    // Input padded up to a multiple of 32, like FaceDetectorYN.
+    cv::Size padded;
+    std::vector<Shape> shapes;
+    std::vector<size_t> offsets;
+    // Row buffers for the strided stem conv, after the tensors.
+    size_t scratch_offset = 0;
+    int scratch_bands = 0;
+    size_t scratch_stride = 0;
+    size_t floats = 0;
+};
+
+// Offsets are kept 64-byte aligned.
+size_t align_floats(size_t n) {
+    return (n + 15) / 16 * 16;
+}
+
+// First-fit allocator over a linear arena.
+class ArenaAllocator {
+public:
+    size_t alloc(size_t n) {
+        for (size_t i = 0; i < free_.size(); ++i) {
+            if (free_[i].second >= n) {
+                size_t off = free_[i].first;
+                free_[i].first += n;
+                free_[i].second -= n;
+                if (free_[i].second == 0) {
+                    free_.erase(free_.begin() + i);
+                }
+                return off;
+            }
+        }
+        // Grow, reusing a free block at the very end.
+        if (!free_.empty() && free_.back().first + free_.back().second == top_) {
+            size_t off = free_.back().first;
+            free_.pop_back();
+            top_ = off + n;
+            return off;
+        }
+        size_t off = top_;
+        top_ += n;
+        return off;
+    }
+
+    void release(size_t off, size_t n) {
+        auto it = std::lower_bound(free_.begin(), free_.end(), std::make_pair(off, size_t(0)));
+        it = free_.insert(it, std::make_pair(off, n));
+        // Merge with the neighbours.
+        size_t i = it - free_.begin();
+        if (i + 1 < free_.size() && free_[i].first + free_[i].second == free_[i + 1].first) {
+            free_[i].second += free_[i + 1].second;
+            free_.erase(free_.begin() + i + 1);
+        }
+        if (i > 0 && free_[i - 1].first + free_[i - 1].second == free_[i].first) {
+            free_[i - 1].second += free_[i].second;
+            free_.erase(free_.begin() + i);
+        }
+    }
+
+    size_t top() const { return top_; }
+
+private:
+    std::vector<std::pair<size_t, size_t>> free_;
+    size_t top_ = 0;
+};
+
+bool is_stem_conv(const Layer& l, const Shape& in) {
+    return l.op == Op::Conv && l.kernel == 3 && l.stride == 2 && l.pad == 1 && l.group == 1 && in.w % 2 == 0;
+}
+
+bool make_plan(const YuNetModel& m, cv::Size input, Plan& plan) {
+    plan = Plan();
+    plan.input = input;
+    plan.padded = cv::Size((input.width - 1) / 32 * 32 + 32, (input.height - 1) / 32 * 32 + 32);
+    plan.shapes.assign(m.tensors, Shape());
+    plan.shapes[0] = Shape{3, plan.padded.height, plan.padded.width};
+
+    for (const Layer& l : m.layers) {
+        const Shape& in = plan.shapes[l.in];
+        Shape out;
+        if (l.op == Op::Conv) {
+            if (in.c != l.cin) {
+                return false;
+            }
+            out = Shape{l.cout, (in.h + 2 * l.pad - l.kernel) / l.stride + 1, (in.w + 2 * l.pad - l.kernel) / l.stride + 1};
+        } else if (l.op == Op::MaxPool) {
+            out = Shape{in.c, in.h / 2, in.w / 2};
+        } else {
+            const Shape& small = plan.shapes[l.in2];
+            if (small.c != in.c || small.h * 2 != in.h || small.w * 2 != in.w) {
+                return false;
+            }
+            out = in;
+        }
+        if (out.h <= 0 || out.w <= 0) {
+            return false;
+        }
+        plan.shapes[l.out] = out;
+    }
+
+    // Last layer that reads each tensor; heads stay alive until decoding.
+    const int end = static_cast<int>(m.layers.size());
+    std::vector<int> last_use(m.tensors, -1);
+    for (int i = 0; i < end; ++i) {
+        last_use[m.layers[i].in] = i;
+        if (m.layers[i].in2 >= 0) {
+            last_use[m.layers[i].in2] = i;
+        }
+    }
+    for (int level = 0; level < 3; ++level) {
+        for (int kind = 0; kind < 4; ++kind) {
+            last_use[m.heads[level][kind]] = end;
+        }
+    }
+
+    ArenaAllocator arena;
+    plan.offsets.assign(m.tensors, 0);
+    plan.offsets[0] = arena.alloc(align_floats(plan.shapes[0].size()));
+    for (int i = 0; i < end; ++i) {
+        const Layer& l = m.layers[i];
+        plan.offsets[l.out] = arena.alloc(align_floats(plan.shapes[l.out].size()));
+        for (int t : {l.in, l.in2}) {
+            if (t >= 0 && last_use[t] == i) {
+                arena.release(plan.offsets[t], align_floats(plan.shapes[t].size()));
+            }
+        }
+        if (is_stem_conv(l, plan.shapes[l.in])) {
+            // Per band: one even/odd split input row.
+            plan.scratch_bands = std::max(plan.scratch_bands, std::min(64, plan.shapes[l.out].h));
+            plan.scratch_stride = std::max(plan.scratch_stride, align_floats(plan.shapes[l.in].w + 4));
+        }
+    }
+    plan.scratch_offset = arena.top();
+    plan.floats = plan.scratch_offset + plan.scratch_stride * plan.scratch_bands;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Kernels. Tensors are planar (channel after channel), rows contiguous.
+// ---------------------------------------------------------------------------
+
+inline float act(float v, bool relu) {
+    return relu && v < 0.0f ? 0.0f : v;
+}
+
+// 1x1 convolution: out[co] = b[co] + sum_ci w[co][ci] * in[ci], pixel by pixel.
+// Register block of 4 output channels x 8 pixels; pixels are split into tiles
+// that run in parallel.
+void conv_pointwise(const Layer& l, const float* in, float* out, int hw) {
+    const int kTile = 512;
+    const int tiles = (hw + kTile - 1) / kTile;
+    const int cin = l.cin;
+    const int cout = l.cout;
+    const float* w = l.weights.data();
+    const float* b = l.bias.data();
+    cv::parallel_for_(cv::Range(0, tiles), [&](const cv::Range& r) {
+        for (int t = r.start; t < r.end; ++t) {
+            const int p0 = t * kTile;
+            const int p1 = std::min(hw, p0 + kTile);
+            int co = 0;
+            for (; co + 4 <= cout; co += 4) {
+                const float* w0 = w + co * cin;
+                const float* w1 = w0 + cin;
+                const float* w2 = w1 + cin;
+                const float* w3 = w2 + cin;
+                float* o0 = out + static_cast<size_t>(co) * hw;
+                float* o1 = o0 + hw;
+                float* o2 = o1 + hw;
+                float* o3 = o2 + hw;
+                int p = p0;
+#if CV_SIMD128
+                const cv::v_float32x4 zero = cv::v_setzero_f32();
+                for (; p + 8 <= p1; p += 8) {
+                    cv::v_float32x4 a0 = cv::v_setall_f32(b[co]), a1 = a0;
+                    cv::v_float32x4 b0 = cv::v_setall_f32(b[co + 1]), b1 = b0;
+                    cv::v_float32x4 c0 = cv::v_setall_f32(b[co + 2]), c1 = c0;
+                    cv::v_float32x4 d0 = cv::v_setall_f32(b[co + 3]), d1 = d0;
+                    const float* x = in + p;
+                    for (int ci = 0; ci < cin; ++ci, x += hw) {
+                        cv::v_float32x4 x0 = cv::v_load(x), x1 = cv::v_load(x + 4);
+                        cv::v_float32x4 k = cv::v_setall_f32(w0[ci]);
+                        a0 = cv::v_fma(x0, k, a0);
+                        a1 = cv::v_fma(x1, k, a1);
+                        k = cv::v_setall_f32(w1[ci]);
+                        b0 = cv::v_fma(x0, k, b0);
+                        b1 = cv::v_fma(x1, k, b1);
+                        k = cv::v_setall_f32(w2[ci]);
+                        c0 = cv::v_fma(x0, k, c0);
+                        c1 = cv::v_fma(x1, k, c1);
+                        k = cv::v_setall_f32(w3[ci]);
+                        d0 = cv::v_fma(x0, k, d0);
+                        d1 = cv::v_fma(x1, k, d1);
+                    }
+                    if (l.relu) {
+                        a0 = cv::v_max(a0, zero);
+                        a1 = cv::v_max(a1, zero);
+                        b0 = cv::v_max(b0, zero);
+                        b1 = cv::v_max(b1, zero);
+                        c0 = cv::v_max(c0, zero);
+                        c1 = cv::v_max(c1, zero);
+                        d0 = cv::v_max(d0, zero);
+                        d1 = cv::v_max(d1, zero);
+                    }
+                    cv::v_store(o0 + p, a0);
+                    cv::v_store(o0 + p + 4, a1);
+                    cv::v_store(o1 + p, b0);
+                    cv::v_store(o1 + p + 4, b1);
+                    cv::v_store(o2 + p, c0);
+                    cv::v_store(o2 + p + 4, c1);
+                    cv::v_store(o3 + p, d0);
+                    cv::v_store(o3 + p + 4, d1);
+                }
+#endif
+                for (; p < p1; ++p) {
+                    float s0 = b[co], s1 = b[co + 1], s2 = b[co + 2], s3 = b[co + 3];
+                    for (int ci = 0; ci < cin; ++ci) {
+                        float x = in[static_cast<size_t>(ci) * hw + p];
+                        s0 += w0[ci] * x;
+                        s1 += w1[ci] * x;
+                        s2 += w2[ci] * x;
+                        s3 += w3[ci] * x;
+                    }
+                    o0[p] = act(s0, l.relu);
+                    o1[p] = act(s1, l.relu);
+                    o2[p] = act(s2, l.relu);
+                    o3[p] = act(s3, l.relu);
+                }
+            }
+            // Head convs have 1 or 10 outputs: the rest one by one.
+            for (; co < cout; ++co) {
+                const float* wc = w + co * cin;
+                float* o = out + static_cast<size_t>(co) * hw;
+                int p = p0;
+#if CV_SIMD128
+                for (; p + 4 <= p1; p += 4) {
+                    cv::v_float32x4 a = cv::v_setall_f32(b[co]);
+                    const float* x = in + p;
+                    for (int ci = 0; ci < cin; ++ci, x += hw) {
+                        a = cv::v_fma(cv::v_load(x), cv::v_setall_f32(wc[ci]), a);
+                    }
+                    if (l.relu) {
+                        a = cv::v_max(a, cv::v_setzero_f32());
+                    }
+                    cv::v_store(o + p, a);
+                }
+#endif
+                for (; p < p1; ++p) {
+                    float s = b[co];
+                    for (int ci = 0; ci < cin; ++ci) {
+                        s += wc[ci] * in[static_cast<size_t>(ci) * hw + p];
+                    }
+                    o[p] = act(s, l.relu);
+                }
+            }
+        }
+    });
+}
+
+// 3x3 depthwise convolution, stride 1, padding 1. Channels run in parallel.
+void conv_depthwise3x3(const Layer& l, const float* in, float* out, int h, int w) {
+    cv::parallel_for_(cv::Range(0, l.cout), [&](const cv::Range& r) {
+        for (int c = r.start; c < r.end; ++c) {
+            const float* k = l.weights.data() + c * 9;
+            const float bias = l.bias[c];
+            const float* src = in + static_cast<size_t>(c) * h * w;
+            float* dst = out + static_cast<size_t>(c) * h * w;
+#if CV_SIMD128
+            cv::v_float32x4 kv[9];
+            for (int i = 0; i < 9; ++i) {
+                kv[i] = cv::v_setall_f32(k[i]);
+            }
+            const cv::v_float32x4 vbias = cv::v_setall_f32(bias);
+            const cv::v_float32x4 zero = cv::v_setzero_f32();
+#endif
+            for (int y = 0; y < h; ++y) {
+                const float* rows[3] = {y > 0 ? src + (y - 1) * w : nullptr, src + y * w,
+                                        y + 1 < h ? src + (y + 1) * w : nullptr};
+                float* d = dst + y * w;
+                // Border pixels (and the tail) with bounds checks.
+                auto at = [&](int x) {
+                    float s = bias;
+                    for (int ky = 0; ky < 3; ++ky) {
+                        if (!rows[ky]) {
+                            continue;
+                        }
+                        for (int kx = 0; kx < 3; ++kx) {
+                            int xx = x + kx - 1;
+                            if (xx >= 0 && xx < w) {
+                                s += k[ky * 3 + kx] * rows[ky][xx];
+                            }
+                        }
+                    }
+                    return act(s, l.relu);
+                };
+                d[0] = at(0);
+                int x = 1;
+#if CV_SIMD128
+                for (; x + 4 <= w - 1; x += 4) {
+                    cv::v_float32x4 a = vbias;
+                    for (int ky = 0; ky < 3; ++ky) {
+                        if (rows[ky]) {
+                            const float* s = rows[ky] + x;
+                            a = cv::v_fma(cv::v_load(s - 1), kv[ky * 3], a);
+                            a = cv::v_fma(cv::v_load(s), kv[ky * 3 + 1], a);
+                            a = cv::v_fma(cv::v_load(s + 1), kv[ky * 3 + 2], a);
+                        }
+                    }
+                    if (l.relu) {
+                        a = cv::v_max(a, zero);
+                    }
+                    cv::v_store(d + x, a);
+                }
+#endif
+                for (; x < w; ++x) {
+                    d[x] = at(x);
+                }
+            }
+        }
+    });
+}
+
+// 3x3 convolution, stride 2, padding 1, all input channels (the stem). Each
+// input row is split into even and odd columns first, so the strided reads
+// become plain vector loads. Bands of output rows run in parallel.
+void conv_stem(const Layer& l, const float* in, const Shape& is, float* out, const Shape& os, float* scratch,
+               size_t scratch_stride, int bands) {
+    const int half = is.w / 2;
+    bands = std::min(bands, os.h);
+    cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& r) {
+        for (int band = r.start; band < r.end; ++band) {
+            // odd[0] is the left padding, odd[j + 1] = row[2j + 1]; even[j] = row[2j].
+            float* even = scratch + band * scratch_stride;
+            float* odd = even + half + 1;
+            const int y0 = os.h * band / bands;
+            const int y1 = os.h * (band + 1) / bands;
+            for (int y = y0; y < y1; ++y) {
+                for (int co = 0; co < l.cout; ++co) {
+                    float* o = out + (static_cast<size_t>(co) * os.h + y) * os.w;
+                    std::fill(o, o + os.w, l.bias[co]);
+                }
+                for (int ci = 0; ci < l.cin; ++ci) {
+                    for (int ky = 0; ky < 3; ++ky) {
+                        const int iy = 2 * y + ky - 1;
+                        if (iy < 0 || iy >= is.h) {
+                            continue;
+                        }
+                        const float* row = in + (static_cast<size_t>(ci) * is.h + iy) * is.w;
+                        odd[0] = 0.0f;
+                        for (int j = 0; j < half; ++j) {
+                            even[j] = row[2 * j];
+                            odd[j + 1] = row[2 * j + 1];
+                        }
+                        for (int co = 0; co < l.cout; ++co) {
+                            const float* k = l.weights.data() + ((co * l.cin + ci) * 3 + ky) * 3;
+                            float* o = out + (static_cast<size_t>(co) * os.h + y) * os.w;
+                            int x = 0;
+#if CV_SIMD128
+                            const cv::v_float32x4 k0 = cv::v_setall_f32(k[0]);
+                            const cv::v_float32x4 k1 = cv::v_setall_f32(k[1]);
+                            const cv::v_float32x4 k2 = cv::v_setall_f32(k[2]);
+                            for (; x + 4 <= os.w; x += 4) {
+                                cv::v_float32x4 a = cv::v_load(o + x);
+                                a = cv::v_fma(cv::v_load(odd + x), k0, a);
+                                a = cv::v_fma(cv::v_load(even + x), k1, a);
+                                a = cv::v_fma(cv::v_load(odd + x + 1), k2, a);
+                                cv::v_store(o + x, a);
+                            }
+#endif
+                            for (; x < os.w; ++x) {
+                                o[x] += k[0] * odd[x] + k[1] * even[x] + k[2] * odd[x + 1];
+                            }
+                        }
+                    }
+                }
+                if (l.relu) {
+                    for (int co = 0; co < l.cout; ++co) {
+                        float* o = out + (static_cast<size_t>(co) * os.h + y) * os.w;
+                        for (int x = 0; x < os.w; ++x) {
+                            o[x] = act(o[x], true);
+                        }
+                    }
+                }
+            }
+        }
+    });
+}
+
+// Any other convolution (not used by the stock model, kept for variants).
+void conv_generic(const Layer& l, const float* in, const Shape& is, float* out, const Shape& os) {
+    const int cin_g = l.cin / l.group;
+    const int cout_g = l.cout / l.group;
+    cv::parallel_for_(cv::Range(0, l.cout), [&](const cv::Range& r) {
+        for (int co = r.start; co < r.end; ++co) {
+            const int g = co / cout_g;
+            const float* k = l.weights.data() + static_cast<size_t>(co) * cin_g * l.kernel * l.kernel;
+            float* o = out + static_cast<size_t>(co) * os.h * os.w;
+            for (int oy = 0; oy < os.h; ++oy) {
+                for (int ox = 0; ox < os.w; ++ox) {
+                    float s = l.bias[co];
+                    for (int ci = 0; ci < cin_g; ++ci) {
+                        const float* src = in + static_cast<size_t>(g * cin_g + ci) * is.h * is.w;
+                        for (int ky = 0; ky < l.kernel; ++ky) {
+                            const int iy = oy * l.stride - l.pad + ky;
+                            if (iy < 0 || iy >= is.h) {
+                                continue;
+                            }
+                            for (int kx = 0; kx < l.kernel; ++kx) {
+                                const int ix = ox * l.stride - l.pad + kx;
+                                if (ix >= 0 && ix < is.w) {
+                                    s += k[(ci * l.kernel + ky) * l.kernel + kx] * src[iy * is.w + ix];
+                                }
+                            }
+                        }
+                    }
+                    o[oy * os.w + ox] = act(s, l.relu);
+                }
+            }
+        }
+    });
+}
+
+void max_pool2x2(const float* in, const Shape& is, float* out, const Shape& os) {
+    cv::parallel_for_(cv::Range(0, os.c), [&](const cv::Range& r) {
+        for (int c = r.start; c < r.end; ++c) {
+            for (int y = 0; y < os.h; ++y) {
+                const float* a = in + (static_cast<size_t>(c) * is.h + 2 * y) * is.w;
+                const float* b = a + is.w;
+                float* o = out + (static_cast<size_t>(c) * os.h + y) * os.w;
+                for (int x = 0; x < os.w; ++x) {
+                    o[x] = std::max(std::max(a[2 * x], a[2 * x + 1]), std::max(b[2 * x], b[2 * x + 1]));
+                }
+            }
+        }
+    });
+}
+
+// out = skip + nearest 2x upsample of small (the pyramid's top-down path).
+void upsample_add(const float* skip, const float* small, const Shape& ss, float* out, const Shape& os) {
+    cv::parallel_for_(cv::Range(0, os.c), [&](const cv::Range& r) {
+        for (int c = r.start; c < r.end; ++c) {
+            for (int y = 0; y < os.h; ++y) {
+                const float* s = skip + (static_cast<size_t>(c) * os.h + y) * os.w;
+                const float* u = small + (static_cast<size_t>(c) * ss.h + y / 2) * ss.w;
+                float* o = out + (static_cast<size_t>(c) * os.h + y) * os.w;
+                for (int x = 0; x < os.w; ++x) {
+                    o[x] = s[x] + u[x / 2];
+                }
+            }
+        }
+    });
+}
+
+void run_layer(const Layer& l, const Plan& plan, float* arena) {
+    const Shape& is = plan.shapes[l.in];
+    const Shape& os = plan.shapes[l.out];
+    const float* in = arena + plan.offsets[l.in];
+    float* out = arena + plan.offsets[l.out];
+    if (l.op == Op::MaxPool) {
+        max_pool2x2(in, is, out, os);
+    } else if (l.op == Op::UpsampleAdd) {
+        upsample_add(in, arena + plan.offsets[l.in2], plan.shapes[l.in2], out, os);
+    } else if (l.kernel == 1 && l.stride == 1 && l.pad == 0 && l.group == 1) {
+        conv_pointwise(l, in, out, is.h * is.w);
+    } else if (l.kernel == 3 && l.stride == 1 && l.pad == 1 && l.group == l.cin && l.cin == l.cout) {
+        conv_depthwise3x3(l, in, out, is.h, is.w);
+    } else if (is_stem_conv(l, is)) {
+        conv_stem(l, in, is, out, os, arena + plan.scratch_offset, plan.scratch_stride, plan.scratch_bands);
+    } else {
+        conv_generic(l, in, is, out, os);
+    }
+}
+
+inline float sigmoid(float v) {
+    return 1.0f / (1.0f + std::exp(-v));
+}
+
+// Same overlap measure as cv::dnn::NMSBoxes on integer boxes.
+float overlap(const cv::Rect& a, const cv::Rect& b) {
+    int x1 = std::max(a.x, b.x), y1 = std::max(a.y, b.y);
+    int x2 = std::min(a.x + a.width, b.x + b.width), y2 = std::min(a.y + a.height, b.y + b.height);
+    float inter = static_cast<float>(std::max(0, x2 - x1)) * std::max(0, y2 - y1);
+    float uni = static_cast<float>(a.area()) + b.area() - inter;
+    return uni > 0.0f ? inter / uni : 0.0f;
+}
+
+}  // namespace
+
+std::shared_ptr<const YuNetModel> load_yunet_model(const std::vector<uchar>& onnx) {
+    OnnxGraph graph;
+    if (!parse_onnx(onnx, graph)) {
+        fail("cannot parse the ONNX file");
+        return nullptr;
+    }
+    auto model = std::make_shared<YuNetModel>();
+    if (!build_model(graph, *model)) {
+        return nullptr;
+    }
+    return model;
+}
+
+size_t yunet_weight_bytes(const YuNetModel& model) {
+    return model.weight_bytes;
+}
+
+size_t yunet_arena_bytes(const YuNetModel& model, cv::Size input_size) {
+    Plan plan;
+    return make_plan(model, input_size, plan) ? plan.floats * sizeof(float) : 0;
+}
+
+struct YuNetEngine::Impl {
+    std::shared_ptr<const YuNetModel> model;
+    float score_threshold = 0.9f;
+    float nms_threshold = 0.3f;
+    int top_k = 5000;
+    Plan plan;
+    std::vector<float> arena;
+
+    // Decoding buffers, reused between calls.
+    std::vector<std::array<float, 15>> candidates;
+    std::vector<cv::Rect> boxes;
+    std::vector<int> order;
+    std::vector<int> keep;
+    cv::Mat result;
+
+    void decode() {
+        candidates.clear();
+        const float* base = arena.data();
+        for (int level = 0; level < 3; ++level) {
+            const int stride = kStrides[level];
+            const Shape& s = plan.shapes[model->heads[level][kCls]];
+            const int hw = s.h * s.w;
+            const float* cls = base + plan.offsets[model->heads[level][kCls]];
+            const float* obj = base + plan.offsets[model->heads[level][kObj]];
+            const float* bbox = base + plan.offsets[model->heads[level][kBbox]];
+            const float* kps = base + plan.offsets[model->heads[level][kKps]];
+            const bool cls_sig = model->sigmoid[level][kCls];
+            const bool obj_sig = model->sigmoid[level][kObj];
+            for (int r = 0; r < s.h; ++r) {
+                for (int c = 0; c < s.w; ++c) {
+                    const int idx = r * s.w + c;
+                    float cs = cls_sig ? sigmoid(cls[idx]) : cls[idx];
+                    float os = obj_sig ? sigmoid(obj[idx]) : obj[idx];
+                    cs = std::min(1.0f, std::max(0.0f, cs));
+                    os = std::min(1.0f, std::max(0.0f, os));
+                    const float score = std::sqrt(cs * os);
+                    if (score < score_threshold) {
+                        continue;
+                    }
+                    std::array<float, 15> f;
+                    // Planar head outputs: channel k of cell idx is at k * hw + idx.
+                    const float cx = (c + bbox[idx]) * stride;
+                    const float cy = (r + bbox[hw + idx]) * stride;
+                    const float w = std::exp(bbox[2 * hw + idx]) * stride;
+                    const float h = std::exp(bbox[3 * hw + idx]) * stride;
+                    f[0] = cx - w / 2.0f;
+                    f[1] = cy - h / 2.0f;
+                    f[2] = w;
+                    f[3] = h;
+                    for (int n = 0; n < 5; ++n) {
+                        f[4 + 2 * n] = (kps[(2 * n) * hw + idx] + c) * stride;
+                        f[5 + 2 * n] = (kps[(2 * n + 1) * hw + idx] + r) * stride;
+                    }
+                    f[14] = score;
+                    candidates.push_back(f);
+                }
+            }
+        }
+    }
+
+    // Greedy NMS in score order, as cv::dnn::NMSBoxes does it.
+    void suppress() {
+        keep.clear();
+        if (candidates.size() <= 1) {
+            keep.assign(candidates.size(), 0);
+            return;
+        }
+        boxes.clear();
+        order.clear();
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            const auto& f = candidates[i];
+            boxes.emplace_back(static_cast<int>(f[0]), static_cast<int>(f[1]), static_cast<int>(f[2]),
+                               static_cast<int>(f[3]));
+            if (f[14] > score_threshold) {
+                order.push_back(static_cast<int>(i));
+            }
+        }
+        std::stable_sort(order.begin(), order.end(),
+                         [&](int a, int b) { return candidates[a][14] > candidates[b][14]; });
+        if (top_k > 0 && order.size() > static_cast<size_t>(top_k)) {
+            order.resize(top_k);
+        }
+        for (int i : order) {
+            bool kept = true;
+            for (int k : keep) {
+                if (overlap(boxes[i], boxes[k]) > nms_threshold) {
+                    kept = false;
+                    break;
+                }
+            }
+            if (kept) {
+                keep.push_back(i);
+            }
+        }
+    }
+};
+
+YuNetEngine::YuNetEngine(std::shared_ptr<const YuNetModel> model, cv::Size input_size, float score_threshold,
+                         float nms_threshold, int top_k)
+    : impl_(std::make_unique<Impl>()) {
+    impl_->model = std::move(model);
+    impl_->score_threshold = score_threshold;
+    impl_->nms_threshold = nms_threshold;
+    impl_->top_k = top_k;
+    setInputSize(input_size);
+}
+
+YuNetEngine::~YuNetEngine() = default;
+
+void YuNetEngine::setInputSize(const cv::Size& input_size) {
+    if (input_size == impl_->plan.input && !impl_->arena.empty()) {
+        return;
+    }
+    if (input_size.width <= 0 || input_size.height <= 0 || !make_plan(*impl_->model, input_size, impl_->plan)) {
+        CV_Error(cv::Error::StsBadArg, "Built-in YuNet cannot run at this input size");
+    }
+    // The arena only grows, so alternating sizes do not reallocate.
+    if (impl_->arena.size() < impl_->plan.floats) {
+        impl_->arena.assign(impl_->plan.floats, 0.0f);
+    }
+}
+
+cv::Size YuNetEngine::getInputSize() {
+    return impl_->plan.input;
+}
+
+void YuNetEngine::setScoreThreshold(float score_threshold) {
+    impl_->score_threshold = score_threshold;
+}
+
+float YuNetEngine::getScoreThreshold() {
+    return impl_->score_threshold;
+}
+
+void YuNetEngine::setNMSThreshold(float nms_threshold) {
+    impl_->nms_threshold = nms_threshold;
+}
+
+float YuNetEngine::getNMSThreshold() {
+    return impl_->nms_threshold;
+}
+
+void YuNetEngine::setTopK(int top_k) {
+    impl_->top_k = top_k;
+}
+
+int YuNetEngine::getTopK() {
+    return impl_->top_k;
+}
+
+size_t YuNetEngine::arena_bytes() const {
+    return impl_->plan.floats * sizeof(float);
+}
+
+int YuNetEngine::detect(cv::InputArray image, cv::OutputArray faces) {
+    Impl& s = *impl_;
+    cv::Mat img = image.getMat();
+    if (img.empty() || img.type() != CV_8UC3) {
+        CV_Error(cv::Error::StsBadArg, "Built-in YuNet expects an 8-bit BGR image");
+    }
+    if (img.size() != s.plan.input) {
+        CV_Error(cv::Error::StsBadArg, "Size does not match. Call setInputSize(size) if input size does not match");
+    }
+
+    // BGR bytes -> three float planes, zero padded to the planned size. The
+    // padding is rewritten every call because the arena space is shared.
+    const int pw = s.plan.padded.width;
+    const int ph = s.plan.padded.height;
+    float* planes = s.arena.data() + s.plan.offsets[0];
+    const size_t plane = static_cast<size_t>(pw) * ph;
+    for (int y = 0; y < ph; ++y) {
+        float* b = planes + static_cast<size_t>(y) * pw;
+        float* g = b + plane;
+        float* r = g + plane;
+        int x = 0;
+        if (y < img.rows) {
+            const uchar* src = img.ptr<uchar>(y);
+            for (; x < img.cols; ++x) {
+                b[x] = src[3 * x];
+                g[x] = src[3 * x + 1];
+                r[x] = src[3 * x + 2];
+            }
+        }
+        std::fill(b + x, b + pw, 0.0f);
+        std::fill(g + x, g + pw, 0.0f);
+        std::fill(r + x, r + pw, 0.0f);
+    }
+
+    for (const Layer& l : s.model->layers) {
+        run_layer(l, s.plan, s.arena.data());
+    }
+    s.decode();
+    s.suppress();
+
+    if (s.keep.empty()) {
+        faces.release();
+        return 1;
+    }
+    s.result.create(static_cast<int>(s.keep.size()), 15, CV_32FC1);
+    for (size_t i = 0; i < s.keep.size(); ++i) {
+        std::copy(s.candidates[s.keep[i]].begin(), s.candidates[s.keep[i]].end(), s.result.ptr<float>(static_cast<int>(i)));
+    }
+    s.result.copyTo(faces);
+    return 1;
+}
+
+namespace {
+
+// Intersection over union of two face rows (x, y, w, h first).
+double row_iou(const float* a, const float* b) {
+    double x1 = std::max(a[0], b[0]), y1 = std::max(a[1], b[1]);
+    double x2 = std::min(a[0] + a[2], b[0] + b[2]), y2 = std::min(a[1] + a[3], b[1] + b[3]);
+    double inter = std::max(0.0, x2 - x1) * std::max(0.0, y2 - y1);
+    double uni = static_cast<double>(a[2]) * a[3] + static_cast<double>(b[2]) * b[3] - inter;
+    return uni > 0.0 ? inter / uni : 0.0;
+}
+
+}  // namespace
+
+YuNetParity compare_yunet_faces(const cv::Mat& reference, const cv::Mat& engine) {
+    YuNetParity p;
+    p.reference_faces = reference.rows;
+    p.engine_faces = engine.rows;
+    for (int i = 0; i < reference.rows; ++i) {
+        const float* r = reference.ptr<float>(i);
+        int best = -1;
+        double best_iou = 0.5;
+        for (int j = 0; j < engine.rows; ++j) {
+            double v = row_iou(r, engine.ptr<float>(j));
+            if (v > best_iou) {
+                best_iou = v;
+                best = j;
+            }
+        }
+        if (best < 0) {
+            continue;
+        }
+        p.matched++;
+        const float* o = engine.ptr<float>(best);
+        for (int c = 0; c < 14; ++c) {
+            p.max_coord = std::max(p.max_coord, static_cast<double>(std::abs(r[c] - o[c])));
+        }
+        p.max_score = std::max(p.max_score, static_cast<double>(std::abs(r[14] - o[14])));
+    }
+    return p;
+}
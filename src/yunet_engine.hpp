@@ -0,0 +1,79 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+#include <opencv2/objdetect.hpp>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Built-in YuNet inference, without OpenCV's DNN module.
+//
+// YuNet is a small fixed network: a 3x3 stem, pointwise + depthwise 3x3 units,
+// max pools, a three-level feature pyramid and tiny heads. The loader reads the
+// layer graph and weights straight from the .onnx file, folds any
+// BatchNormalization into the convolution before it and fuses each ReLU into
+// its convolution. Kernels are written for this network (pointwise, depthwise
+// 3x3, strided 3x3 stem) with OpenCV's universal SIMD intrinsics, and every
+// intermediate tensor lives in one arena planned once per input size, so
+// detect() does not allocate.
+//
+// Output rows are the same as cv::FaceDetectorYN's (same padding, decoding and
+// NMS), so the engine can be used anywhere FaceDetectorYN is.
+
+// Parsed layers and weights. Immutable, so one copy is shared by every engine.
+struct YuNetModel;
+
+// Parse an ONNX YuNet (2023mar layout). Returns empty and prints why on failure.
+std::shared_ptr<const YuNetModel> load_yunet_model(const std::vector<uchar>& onnx);
+
+// Bytes of weights held by the model.
+size_t yunet_weight_bytes(const YuNetModel& model);
+
+// Bytes of the tensor arena an engine needs at this input size (0 if it does not fit the network).
+size_t yunet_arena_bytes(const YuNetModel& model, cv::Size input_size);
+
+// How the rows of two detectors on the same image compare. Each reference face
+// is paired with the other detector's face that overlaps it most (IoU > 0.5).
+struct YuNetParity {
+    int reference_faces = 0;
+    int engine_faces = 0;
+    int matched = 0;
+    // Largest box/landmark difference in pixels, and largest score difference.
+    double max_coord = 0.0;
+    double max_score = 0.0;
+
+    // Same faces, boxes and landmarks within 1 px, scores within 0.01.
+    bool same() const {
+        return matched == reference_faces && matched == engine_faces && max_coord < 1.0 && max_score < 0.01;
+    }
+};
+
+YuNetParity compare_yunet_faces(const cv::Mat& reference, const cv::Mat& engine);
+
+class YuNetEngine : public cv::FaceDetectorYN {
+public:
+    YuNetEngine(std::shared_ptr<const YuNetModel> model, cv::Size input_size, float score_threshold,
+                float nms_threshold, int top_k);
+    ~YuNetEngine() override;
+
+    void setInputSize(const cv::Size& input_size) override;
+    cv::Size getInputSize() override;
+    void setScoreThreshold(float score_threshold) override;
+    float getScoreThreshold() override;
+    void setNMSThreshold(float nms_threshold) override;
+    float getNMSThreshold() override;
+    void setTopK(int top_k) override;
+    int getTopK() override;
+
+    // 8-bit BGR image of the input size in, one row per face out (x, y, w, h,
+    // 5 landmarks, score), like FaceDetectorYN::detect.
+    int detect(cv::InputArray image, cv::OutputArray faces) override;
+
+    size_t arena_bytes() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};